@@ -0,0 +1,350 @@
+#!/usr/bin/env python3
+"""Build the flash asset region read by DotMatrixAssetStore (source/DotMatrixAssets.h).
+
+    python3 asset_pack.py logo=logo.rgb spin=spin.gif news=news.txt -o assets.bin
+    python3 asset_pack.py --compress logo=logo.png --merge MICROBIT.hex -o combined.hex
+    python3 asset_pack.py --list assets.bin
+
+Each entry is name=path. The kind of asset depends on the extension:
+
+    .rgb         raw RGB888 frames at the panel size; several frames make an animation
+                 shown --frame-ms apart
+    .png .gif    converted to the panel size with Pillow; a GIF's frames make an
+    .jpg .bmp    animation at its mean frame duration
+    .txt         text for the `show` console command
+    anything     stored as raw bytes
+
+--compress stores image and animation frames LZ-compressed when that is smaller; the
+device decodes them while sending. The output is a .bin, or Intel HEX when -o ends in
+.hex. Flashing by drag and drop erases the whole chip, so --merge the region into the
+firmware hex and flash the combined file rather than flashing the two one after the
+other.
+"""
+
+from __future__ import annotations
+
+import argparse
+import struct
+import sys
+import zlib
+from pathlib import Path
+from typing import Iterator, List, NamedTuple, Tuple
+
+WIDTH = 32
+HEIGHT = 32
+FRAME_BYTES = WIDTH * HEIGHT * 3
+
+# Match DOTMATRIX_ASSET_FLASH_START and DOTMATRIX_ASSET_FLASH_SIZE of the firmware.
+FLASH_START = 0x6C000
+FLASH_SIZE = 0x8000
+
+REGION_MAGIC = 0x31414D44
+TAG = 0x54455341
+NAME_MAX = 31
+
+RAW = 0
+IMAGE = 1
+ANIMATION = 2
+TEXT = 3
+FORMAT_NAMES = {RAW: "raw", IMAGE: "image", ANIMATION: "animation", TEXT: "text"}
+
+FLAG_COMPRESSED = 0x01
+FLAG_DELETED = 0x02
+
+# DotMatrixAssetRecord.
+RECORD = struct.Struct("<IIIIIBBBBHH")
+
+MAX_LITERALS = 128
+MIN_MATCH = 3
+MAX_MATCH = 130
+WINDOW = 256
+
+IMAGE_EXTENSIONS = {".png", ".gif", ".jpg", ".jpeg", ".bmp"}
+
+
+def set_panel_size(size: int) -> None:
+    """Match DOTMATRIX_PANEL_WIDTH and DOTMATRIX_PANEL_HEIGHT of the firmware."""
+
+    global WIDTH, HEIGHT, FRAME_BYTES
+    WIDTH = HEIGHT = size
+    FRAME_BYTES = WIDTH * HEIGHT * 3
+
+
+class Asset(NamedTuple):
+    name: str
+    format: int
+    frames: List[bytes]
+    frame_ms: int
+    data: bytes
+
+
+def align4(n: int) -> int:
+    return (n + 3) & ~3
+
+
+def fnv1a(data: bytes) -> int:
+    h = 2166136261
+    for byte in data:
+        h = ((h ^ byte) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def lz_compress(data: bytes) -> bytes:
+    """The format DotMatrixAssetStream::read() decodes: a token below 0x80 is followed by
+    token + 1 literal bytes; one from 0x80 copies (token & 0x7F) + 3 bytes starting
+    `next byte + 1` back in the output."""
+
+    out = bytearray()
+    literals = bytearray()
+
+    def flush() -> None:
+        for i in range(0, len(literals), MAX_LITERALS):
+            run = literals[i : i + MAX_LITERALS]
+            out.append(len(run) - 1)
+            out.extend(run)
+        literals.clear()
+
+    i = 0
+    while i < len(data):
+        best_length = best_distance = 0
+        for distance in range(1, min(WINDOW, i) + 1):
+            length = 0
+            while (length < MAX_MATCH and i + length < len(data)
+                   and data[i + length - distance] == data[i + length]):
+                length += 1
+            if length > best_length:
+                best_length, best_distance = length, distance
+                if length == MAX_MATCH:
+                    break
+        if best_length >= MIN_MATCH:
+            flush()
+            out += bytes([0x80 | (best_length - MIN_MATCH), best_distance - 1])
+            i += best_length
+        else:
+            literals.append(data[i])
+            i += 1
+    flush()
+    return bytes(out)
+
+
+def lz_decompress(data: bytes) -> bytes:
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        token = data[i]
+        i += 1
+        if token < 0x80:
+            out += data[i : i + token + 1]
+            i += token + 1
+        else:
+            distance = data[i] + 1
+            i += 1
+            for _ in range((token & 0x7F) + MIN_MATCH):
+                out.append(out[-distance])
+    return bytes(out)
+
+
+def load_image(path: Path) -> Tuple[List[bytes], int]:
+    try:
+        from PIL import Image, ImageSequence
+    except ImportError:
+        raise SystemExit(f"{path}: converting images needs Pillow (pip install pillow)")
+
+    frames = []
+    durations = []
+    with Image.open(path) as image:
+        for frame in ImageSequence.Iterator(image):
+            durations.append(frame.info.get("duration", 100) or 100)
+            frames.append(frame.convert("RGB").resize((WIDTH, HEIGHT)).tobytes())
+    return frames, round(sum(durations) / len(durations))
+
+
+def load(entry: str, frame_ms: int) -> Asset:
+    name, sep, path_text = entry.partition("=")
+    if not sep or not name:
+        raise SystemExit(f"{entry}: expected name=path")
+    if len(name.encode()) > NAME_MAX:
+        raise SystemExit(f"{name}: names are at most {NAME_MAX} bytes")
+
+    path = Path(path_text)
+    suffix = path.suffix.lower()
+    if suffix in IMAGE_EXTENSIONS:
+        frames, frame_ms = load_image(path)
+    elif suffix == ".rgb":
+        data = path.read_bytes()
+        if not data or len(data) % FRAME_BYTES:
+            raise SystemExit(f"{path}: not a whole number of {WIDTH}x{HEIGHT} RGB888 frames")
+        frames = [data[i : i + FRAME_BYTES] for i in range(0, len(data), FRAME_BYTES)]
+    elif suffix == ".txt":
+        return Asset(name, TEXT, [], 0, path.read_text().strip().encode("latin-1", "replace"))
+    else:
+        return Asset(name, RAW, [], 0, path.read_bytes())
+
+    if len(frames) > 0xFFFF:
+        raise SystemExit(f"{path}: too many frames")
+    kind = ANIMATION if len(frames) > 1 else IMAGE
+    return Asset(name, kind, frames, frame_ms if kind == ANIMATION else 0, b"".join(frames))
+
+
+def payload(asset: Asset, compress: bool) -> Tuple[bytes, int]:
+    """The bytes stored and the record flags. Compressed frames follow a table of where
+    each one starts, so the device can open any frame without decoding the others."""
+
+    if not compress or not asset.frames:
+        return asset.data, 0
+
+    packed = [lz_compress(frame) for frame in asset.frames]
+    for frame, data in zip(asset.frames, packed):
+        assert lz_decompress(data) == frame
+    table = bytearray()
+    offset = 0
+    for data in packed:
+        table += struct.pack("<I", offset)
+        offset += len(data)
+    stored = bytes(table) + b"".join(packed)
+    if len(stored) >= len(asset.data):
+        return asset.data, 0
+    return stored, FLAG_COMPRESSED
+
+
+def record(asset: Asset, compress: bool) -> bytes:
+    name = asset.name.encode()
+    data, flags = payload(asset, compress)
+    header = RECORD.pack(TAG, fnv1a(name), len(data), len(asset.data),
+                         zlib.crc32(name + data), asset.format, flags, len(name), 0xFF,
+                         asset.frame_ms, max(len(asset.frames), 1))
+    pad = lambda b: b + b"\xff" * (align4(len(b)) - len(b))
+    return header + pad(name) + pad(data)
+
+
+def region(records: List[bytes], size: int) -> bytes:
+    image = struct.pack("<II", REGION_MAGIC, size) + b"".join(records)
+    if len(image) > size:
+        raise SystemExit(f"assets need {len(image)} bytes, the region holds {size}")
+    return image
+
+
+def parse_region(image: bytes) -> Iterator[Tuple[int, str, int, int, int, int, int, int, bool]]:
+    if struct.unpack_from("<I", image)[0] != REGION_MAGIC:
+        raise SystemExit("not an asset region")
+    offset = 8
+    while offset + RECORD.size <= len(image):
+        tag, _, length, raw, crc, kind, flags, name_length, _, frame_ms, frames = \
+            RECORD.unpack_from(image, offset)
+        if tag != TAG:
+            break
+        start = offset + RECORD.size
+        name = image[start : start + name_length]
+        data = image[start + align4(name_length) : start + align4(name_length) + length]
+        yield (offset, name.decode("latin-1"), kind, flags, length, raw, frame_ms, frames,
+               zlib.crc32(name + data) == crc)
+        offset = start + align4(name_length) + align4(length)
+
+
+def hex_record(kind: int, address: int, data: bytes) -> str:
+    body = bytes([len(data), (address >> 8) & 0xFF, address & 0xFF, kind]) + data
+    return ":" + (body + bytes([-sum(body) & 0xFF])).hex().upper()
+
+
+def to_hex(image: bytes, base: int) -> List[str]:
+    lines = []
+    upper = None
+    for offset in range(0, len(image), 16):
+        address = base + offset
+        if address >> 16 != upper:
+            upper = address >> 16
+            lines.append(hex_record(4, 0, struct.pack(">H", upper)))
+        lines.append(hex_record(0, address & 0xFFFF, image[offset : offset + 16]))
+    return lines
+
+
+def hex_extent(lines: List[str]) -> Tuple[int, int]:
+    """The lowest and highest data address written by a hex file."""
+
+    upper = 0
+    low, high = None, 0
+    for line in lines:
+        if not line.startswith(":"):
+            continue
+        raw = bytes.fromhex(line[1:])
+        count, address, kind = raw[0], (raw[1] << 8) | raw[2], raw[3]
+        if kind == 4:
+            upper = struct.unpack(">H", raw[4:6])[0] << 16
+        elif kind == 2:
+            upper = struct.unpack(">H", raw[4:6])[0] << 4
+        elif kind == 0:
+            start = upper + address
+            low = start if low is None else min(low, start)
+            high = max(high, start + count)
+    return low or 0, high
+
+
+def merge(firmware: Path, lines: List[str], base: int, size: int) -> List[str]:
+    original = [l.strip() for l in firmware.read_text().splitlines() if l.strip()]
+    low, high = hex_extent(original)
+    if low < base + size and high > base:
+        raise SystemExit(f"{firmware} writes 0x{low:x}-0x{high:x}, over the asset region "
+                         f"0x{base:x}-0x{base + size:x}")
+    body = [l for l in original if l[7:9] != "01"]
+    return body + lines + [":00000001FF"]
+
+
+def main() -> int:
+    ap = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter
+    )
+    ap.add_argument("entries", nargs="*", help="name=path")
+    ap.add_argument("-o", "--output", help="region as .bin, or Intel HEX for .hex")
+    ap.add_argument("--compress", action="store_true", help="LZ-compress image frames")
+    ap.add_argument("--frame-ms", type=int, default=100,
+                    help="frame time of .rgb animations")
+    ap.add_argument("--size", type=int, choices=(16, 32, 64), default=32,
+                    help="panel width and height")
+    ap.add_argument("--base", type=lambda s: int(s, 0), default=FLASH_START,
+                    help="flash address of the region")
+    ap.add_argument("--region", type=lambda s: int(s, 0), default=FLASH_SIZE,
+                    help="region size in bytes")
+    ap.add_argument("--merge", type=Path, help="firmware hex to add the region to")
+    ap.add_argument("--list", type=Path, metavar="BIN", help="list the assets in a .bin")
+    args = ap.parse_args()
+    set_panel_size(args.size)
+
+    if args.list:
+        for offset, name, kind, flags, length, raw, frame_ms, frames, ok in \
+                parse_region(args.list.read_bytes()):
+            state = "deleted" if flags & FLAG_DELETED else FORMAT_NAMES.get(kind, "?")
+            print(f"0x{offset:05x} {name:<{NAME_MAX}} {state:<9} {length:6d} B"
+                  f"{f' of {raw}' if flags & FLAG_COMPRESSED else ''}"
+                  f"{f', {frames} frames at {frame_ms} ms' if kind == ANIMATION else ''}"
+                  f"{'' if ok else ', BAD CRC'}")
+        return 0
+
+    if not args.entries or not args.output:
+        ap.error("give name=path entries and -o, or --list")
+
+    assets = [load(entry, args.frame_ms) for entry in args.entries]
+    records = [record(asset, args.compress) for asset in assets]
+    image = region(records, args.region)
+
+    output = Path(args.output)
+    if output.suffix.lower() == ".hex":
+        lines = to_hex(image, args.base)
+        if args.merge:
+            lines = merge(args.merge, lines, args.base, args.region)
+        else:
+            lines.append(":00000001FF")
+        output.write_text("\n".join(lines) + "\n")
+    elif args.merge:
+        ap.error("--merge writes a .hex")
+    else:
+        output.write_bytes(image)
+
+    for asset, data in zip(assets, records):
+        print(f"{asset.name:<{NAME_MAX}} {FORMAT_NAMES[asset.format]:<9} {len(data):6d} B",
+              file=sys.stderr)
+    print(f"{len(image)} of {args.region} bytes used at 0x{args.base:x}", file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -1,115 +1,232 @@
-#!/usr/bin/env uv run -s
-# /// script
-# dependencies = [
-#     "Pillow"
-# ]
-# ///
+#!/usr/bin/env python3
+"""Generate a packed font translation unit for the panel's text mode.
 
-from pathlib import Path
-from PIL import Image, ImageDraw, ImageFont
-
-FONT_WIDTH = 16  # 16
-FONT_HEIGHT = 32  # 32
-
-FONT_PATH = "/Users/jamesdevine/Downloads/Rain-DRM3.otf"
-
-OUTPUT_PATH = f"font-{FONT_WIDTH}x{FONT_HEIGHT}.cpp"
-
-SEPARATOR_8_16 = bytearray([0x02, 0xFF, 0xFF, 0xFF])
-SEPARATOR_16_32 = bytearray([0x05, 0xFF, 0xFF, 0xFF])
-
-# Calculate bytes per character
-BYTES_PER_ROW = (FONT_WIDTH + 7) // 8  # Round up to nearest byte
-BYTES_PER_CHAR = BYTES_PER_ROW * FONT_HEIGHT
+    python3 font-gen.py fonts/rain-drm3.bdf build/generated/rain-drm3.cpp
 
-font = ImageFont.truetype(FONT_PATH, 20)
-write_handle = Path(OUTPUT_PATH).open("w")
+BDF sources are parsed directly and need nothing beyond the standard library,
+which is how the build generates its font (see CMakeLists.txt). OTF/TTF sources
+are rasterised with Pillow instead and need `--geometry`.
 
-# Generate all 256 ASCII characters (or at least printable + your set)
-write_handle.write(
-    f"// Generated font data: {FONT_WIDTH}x{FONT_HEIGHT} pixels, {BYTES_PER_CHAR} bytes per character\n\n"
-)
-write_handle.write("#include <stdint.h>\n\n")
+The panel only understands 8x16 and 16x32 glyph cells. For BDF sources the
+smallest cell that holds the font's bounding box is picked unless `--geometry`
+is given.
+"""
 
-write_handle.write("// Separator bytes between characters\n")
+from __future__ import annotations
 
-
-if FONT_WIDTH == 8 and FONT_HEIGHT == 16:
-    write_handle.write('extern "C" const uint32_t BITMAP_SIZE = 16;\n')
-    write_handle.write(
-        f'extern "C" const uint32_t SEPARATOR_LEN = {len(SEPARATOR_8_16)};\n'
-    )
-    write_handle.write(
-        f'extern "C" const uint8_t separator[{len(SEPARATOR_8_16)}] = {{'
-    )
-    separator = SEPARATOR_8_16
-elif FONT_WIDTH == 16 and FONT_HEIGHT == 32:
-    write_handle.write('extern "C" const uint32_t BITMAP_SIZE = 64;\n')
-    write_handle.write(
-        f'extern "C" const uint32_t SEPARATOR_LEN = {len(SEPARATOR_16_32)};\n'
-    )
-    write_handle.write(
-        f'extern "C" const uint8_t separator[{len(SEPARATOR_16_32)}] = {{'
+import argparse
+import sys
+from pathlib import Path
+from typing import Dict, List, Tuple
+
+FIRST_CODEPOINT = 0x20
+LAST_CODEPOINT = 0x7E
+
+# (width, height) -> separator the panel expects before each glyph bitmap
+GEOMETRIES = {
+    (8, 16): bytes([0x02, 0xFF, 0xFF, 0xFF]),
+    (16, 32): bytes([0x05, 0xFF, 0xFF, 0xFF]),
+}
+
+# Blank columns left between glyphs when text is rendered proportionally
+GLYPH_SPACING = 1
+
+# A glyph is a list of rows, each a list of 0/1 pixels
+Glyph = List[List[int]]
+
+
+class FontSourceError(ValueError):
+    pass
+
+
+def parse_bdf(path: Path):
+    """Return ((bbox_w, bbox_h), ascent, descent, {codepoint: (bbx, rows)})."""
+
+    bbox = None
+    ascent = descent = None
+    glyphs: Dict[int, Tuple[Tuple[int, int, int, int], List[int]]] = {}
+
+    encoding = -1
+    bbx = (0, 0, 0, 0)
+    rows: List[int] = []
+    in_bitmap = False
+
+    for line in path.read_text(encoding="latin-1").splitlines():
+        parts = line.split()
+        if not parts:
+            continue
+        key = parts[0]
+
+        if in_bitmap:
+            if key == "ENDCHAR":
+                in_bitmap = False
+                glyphs[encoding] = (bbx, rows)
+            else:
+                rows.append(int(key, 16))
+        elif key == "FONTBOUNDINGBOX":
+            bbox = (int(parts[1]), int(parts[2]))
+        elif key == "FONT_ASCENT":
+            ascent = int(parts[1])
+        elif key == "FONT_DESCENT":
+            descent = int(parts[1])
+        elif key == "ENCODING":
+            encoding = int(parts[1])
+        elif key == "BBX":
+            bbx = tuple(int(p) for p in parts[1:5])
+        elif key == "BITMAP":
+            rows = []
+            in_bitmap = True
+
+    if bbox is None or ascent is None or descent is None:
+        raise FontSourceError(f"{path}: missing FONTBOUNDINGBOX or FONT_ASCENT/FONT_DESCENT")
+
+    return bbox, ascent, descent, glyphs
+
+
+def pick_geometry(font_w: int, font_h: int) -> Tuple[int, int]:
+    for w, h in sorted(GEOMETRIES):
+        if font_w <= w and font_h <= h:
+            return w, h
+    return max(GEOMETRIES)
+
+
+def bdf_glyphs(path: Path, geometry) -> Tuple[Tuple[int, int], Dict[int, Glyph]]:
+    (bbox_w, _), ascent, descent, source = parse_bdf(path)
+    width, height = geometry or pick_geometry(bbox_w, ascent + descent)
+
+    # Centre the font's ascent/descent box in the cell, then place each glyph by
+    # its bounding box relative to the baseline.
+    baseline = (height - (ascent + descent)) // 2 + ascent
+    left = (width - bbox_w) // 2
+
+    glyphs: Dict[int, Glyph] = {}
+    for code in range(FIRST_CODEPOINT, LAST_CODEPOINT + 1):
+        cell = [[0] * width for _ in range(height)]
+        if code in source:
+            (w, h, xoff, yoff), rows = source[code]
+            row_bits = (w + 7) // 8 * 8
+            top = baseline - yoff - h
+            for y, value in enumerate(rows):
+                for x in range(w):
+                    cx, cy = left + xoff + x, top + y
+                    if value >> (row_bits - 1 - x) & 1 and 0 <= cx < width and 0 <= cy < height:
+                        cell[cy][cx] = 1
+        glyphs[code] = cell
+
+    return (width, height), glyphs
+
+
+def outline_glyphs(path: Path, size: int, geometry) -> Tuple[Tuple[int, int], Dict[int, Glyph]]:
+    from PIL import Image, ImageDraw, ImageFont
+
+    if geometry is None:
+        raise FontSourceError("--geometry is required for outline fonts")
+    width, height = geometry
+    font = ImageFont.truetype(str(path), size)
+
+    glyphs: Dict[int, Glyph] = {}
+    for code in range(FIRST_CODEPOINT, LAST_CODEPOINT + 1):
+        image = Image.new("1", (width, height), 0)
+        draw = ImageDraw.Draw(image)
+        _, _, text_width, text_height = draw.textbbox((0, 0), text=chr(code), font=font)
+        position = ((width - text_width) // 2, (height - text_height) // 2)
+        draw.text(position, chr(code), fill=1, font=font)
+        glyphs[code] = [[image.getpixel((x, y)) & 1 for x in range(width)] for y in range(height)]
+
+    return (width, height), glyphs
+
+
+def pack(glyph: Glyph) -> bytes:
+    """Rows of little-endian bytes; bit n of a row is column n."""
+    out = bytearray()
+    for row in glyph:
+        for start in range(0, len(row), 8):
+            out.append(sum(bit << i for i, bit in enumerate(row[start:start + 8])))
+    return bytes(out)
+
+
+def metrics(glyph: Glyph, width: int) -> Tuple[int, int]:
+    """Return (first inked column, advance width) of a glyph."""
+    columns = [x for x in range(width) if any(row[x] for row in glyph)]
+    if not columns:
+        # Blank glyphs such as space still move the pen
+        return 0, width // 3
+    return columns[0], columns[-1] - columns[0] + 1 + GLYPH_SPACING
+
+
+def hex_list(values) -> str:
+    return ", ".join(f"0x{v:02X}" for v in values)
+
+
+def write_cpp(out: Path, source: Path, geometry: Tuple[int, int], glyphs: Dict[int, Glyph]) -> None:
+    width, height = geometry
+    separator = GEOMETRIES[geometry]
+    codes = sorted(glyphs)
+    packed = [pack(glyphs[c]) for c in codes]
+    glyph_metrics = [metrics(glyphs[c], width) for c in codes]
+    bitmap_size = len(packed[0])
+
+    lines = [
+        f"// Generated from {source.name} by font-gen.py: {width}x{height} pixels, "
+        f"{bitmap_size} bytes per character. Do not edit.",
+        "",
+        "#include <stdint.h>",
+        "",
+        "// Glyph geometry in pixels",
+        f'extern "C" constexpr uint32_t GLYPH_WIDTH = {width};',
+        f'extern "C" constexpr uint32_t GLYPH_HEIGHT = {height};',
+        "",
+        "// Separator bytes between characters",
+        f'extern "C" constexpr uint32_t BITMAP_SIZE = {bitmap_size};',
+        f'extern "C" constexpr uint32_t SEPARATOR_LEN = {len(separator)};',
+        f'extern "C" constexpr uint8_t separator[{len(separator)}] = {{{hex_list(separator)}}};',
+        "",
+        "// Word aligned so glyph rows can be read a whole row at a time",
+        f'extern "C" alignas(4) constexpr uint8_t font_data[{len(codes)}][{bitmap_size}] = {{',
+    ]
+    for code, bitmap in zip(codes, packed):
+        lines.append(f"    {{{hex_list(bitmap)}}}, // 0x{code:02X} '{chr(code)}'")
+    lines.append("};")
+    lines.append("")
+    lines.append("// Proportional metrics: first inked column and advance width per glyph")
+    for name, index in (("font_left", 0), ("font_advance", 1)):
+        values = ", ".join(str(m[index]) for m in glyph_metrics)
+        lines.append(f'extern "C" constexpr uint8_t {name}[{len(codes)}] = {{{values}}};')
+
+    out.parent.mkdir(parents=True, exist_ok=True)
+    out.write_text("\n".join(lines) + "\n")
+
+
+def parse_geometry(text: str) -> Tuple[int, int]:
+    w, _, h = text.partition("x")
+    geometry = (int(w), int(h))
+    if geometry not in GEOMETRIES:
+        raise argparse.ArgumentTypeError(f"unsupported geometry {text}; use 8x16 or 16x32")
+    return geometry
+
+
+def main() -> int:
+    ap = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter
     )
-    separator = SEPARATOR_16_32
-
-for i, byte in enumerate(separator):
-    write_handle.write(f"0x{byte:02X}")
-    if i < len(separator) - 1:
-        write_handle.write(", ")
-write_handle.write("};\n\n")
-
-write_handle.write(
-    f'extern "C" const uint8_t font_data[{126 - 32 + 1}][{BYTES_PER_CHAR}] = {{\n'
-)
-
-# Generate for all ASCII characters (0-255)
-for ascii_code in range(256):
-    char = chr(ascii_code)
-
-    # Create blank image
-    image = Image.new("1", (FONT_WIDTH, FONT_HEIGHT), 0)
-    draw = ImageDraw.Draw(image)
-
-    # Only render printable characters
-    if 32 <= ascii_code <= 126:
-        _, _, text_width, text_height = draw.textbbox((0, 0), text=char, font=font)
-        text_x = (FONT_WIDTH - text_width) // 2
-        text_y = (FONT_HEIGHT - text_height) // 2
-        draw.text((text_x, text_y), char, fill=1, font=font)
-    else:
-        continue
-
-    bitmap = bytearray()
-
-    # Pack bits row by row
-    for y in range(FONT_HEIGHT):
-        byte = 0
-        bit_pos = 0
-
-        for x in range(FONT_WIDTH):
-            pixel = image.getpixel((x, y))
-            byte |= (pixel & 1) << bit_pos
-            bit_pos += 1
-
-            # When we've filled a byte (or reached end of row), append it
-            if bit_pos == 8 or x == FONT_WIDTH - 1:
-                bitmap.append(byte)
-                byte = 0
-                bit_pos = 0
-
-    # Write the byte array
-    write_handle.write("    {")
-    for i, byte in enumerate(bitmap):
-        write_handle.write(f"0x{byte:02X}")
-        if i < len(bitmap) - 1:
-            write_handle.write(", ")
-
-    # Add readable comment
-    if 32 <= ascii_code <= 126:
-        write_handle.write(f"}}, // 0x{ascii_code:02X} '{char}'\n")
-    else:
-        write_handle.write(f"}}, // 0x{ascii_code:02X}\n")
-write_handle.write("};\n")
-write_handle.close()
-print(f"Font data written to {OUTPUT_PATH}")
+    ap.add_argument("source", type=Path, help="BDF, OTF or TTF font")
+    ap.add_argument("output", type=Path, help="C++ file to write")
+    ap.add_argument("--geometry", type=parse_geometry, help="glyph cell, 8x16 or 16x32")
+    ap.add_argument("--size", type=int, default=20, help="point size for outline fonts")
+    args = ap.parse_args()
+
+    try:
+        if args.source.suffix.lower() == ".bdf":
+            geometry, glyphs = bdf_glyphs(args.source, args.geometry)
+        else:
+            geometry, glyphs = outline_glyphs(args.source, args.size, args.geometry)
+    except FontSourceError as e:
+        print(f"font-gen.py: {e}", file=sys.stderr)
+        return 1
+
+    write_cpp(args.output, args.source, geometry, glyphs)
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+"""Decode the binary log records written by DotMatrixLog.
+
+    python3 log_decode.py build/MICROBIT capture.bin
+    python3 log_decode.py build/MICROBIT --port /dev/ttyACM0
+
+The firmware does not format log messages. Each record carries the address of its
+format string, so the ELF the board was flashed with is needed to turn records back
+into text. Anything on the serial line that is not a record (plain printf output) is
+passed through unchanged. Reading a port directly needs pyserial.
+"""
+
+from __future__ import annotations
+
+import argparse
+import re
+import struct
+import sys
+from pathlib import Path
+from typing import BinaryIO, List, Optional, Tuple
+
+MAGIC = b"DL"
+HEADER = struct.Struct("<2sBBII")
+MAX_ARGS = 4
+LEVELS = {1: "E", 2: "W", 3: "I", 4: "D"}
+
+SHT_PROGBITS = 1
+SHF_ALLOC = 0x2
+
+# printf conversion: flags, width, precision, length modifier, conversion
+CONVERSION = re.compile(r"%([-+ #0]*)(\d*)(?:\.(\d+))?(hh|h|ll|l|z|t|j)?([diouxXcsp%])")
+
+
+class ElfError(ValueError):
+    pass
+
+
+class Image:
+    """The allocated, initialised sections of a 32 bit little-endian ELF."""
+
+    def __init__(self, path: Path):
+        data = path.read_bytes()
+        if data[:4] != b"\x7fELF" or data[4] != 1 or data[5] != 1:
+            raise ElfError(f"{path}: not a 32 bit little-endian ELF")
+
+        shoff, = struct.unpack_from("<I", data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", data, 0x2E)
+
+        self.sections: List[Tuple[int, bytes]] = []
+        for i in range(shnum):
+            _, kind, flags, addr, offset, size = struct.unpack_from("<IIIIII", data, shoff + i * shentsize)
+            if kind == SHT_PROGBITS and flags & SHF_ALLOC and size:
+                self.sections.append((addr, data[offset:offset + size]))
+
+    def string(self, address: int) -> Optional[str]:
+        for base, content in self.sections:
+            if base <= address < base + len(content):
+                end = content.find(b"\0", address - base)
+                if end < 0:
+                    return None
+                return content[address - base:end].decode("latin-1")
+        return None
+
+
+def to_signed(value: int) -> int:
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def format_record(image: Image, fmt: str, args: List[int]) -> str:
+    values = iter(args)
+
+    def convert(m: re.Match) -> str:
+        flags, width, precision, _, conversion = m.groups()
+        if conversion == "%":
+            return "%"
+        value = next(values, 0)
+        spec = "%" + flags + width + (f".{precision}" if precision else "")
+        if conversion in "di":
+            return (spec + "d") % to_signed(value)
+        if conversion == "u":
+            return (spec + "d") % value
+        if conversion == "c":
+            return (spec + "c") % chr(value & 0xFF)
+        if conversion == "s":
+            return (spec + "s") % (image.string(value) or f"<0x{value:08x}>")
+        if conversion == "p":
+            return f"0x{value:08x}"
+        return (spec + conversion) % value
+
+    return CONVERSION.sub(convert, fmt)
+
+
+def decode(image: Image, stream: BinaryIO, out, follow: bool = False) -> None:
+    buffer = b""
+    while True:
+        data = getattr(stream, "read1", stream.read)(4096)
+        if not data:
+            if follow:
+                continue
+            break
+        buffer += data
+
+        while True:
+            start = buffer.find(MAGIC)
+            if start < 0:
+                # Keep a trailing 'D' that may start the next record.
+                keep = 1 if buffer.endswith(MAGIC[:1]) else 0
+                out.write(buffer[:len(buffer) - keep].decode("latin-1"))
+                buffer = buffer[len(buffer) - keep:]
+                break
+
+            out.write(buffer[:start].decode("latin-1"))
+            buffer = buffer[start:]
+            if len(buffer) < HEADER.size:
+                break
+
+            _, level, count, timestamp, address = HEADER.unpack_from(buffer)
+            fmt = image.string(address) if level in LEVELS and count <= MAX_ARGS else None
+            if fmt is None:
+                # Text that happens to contain "DL"
+                out.write(buffer[:1].decode("latin-1"))
+                buffer = buffer[1:]
+                continue
+
+            size = HEADER.size + 4 * count
+            if len(buffer) < size:
+                break
+            args = list(struct.unpack_from(f"<{count}I", buffer, HEADER.size))
+            buffer = buffer[size:]
+
+            out.write(f"{timestamp / 1e6:12.6f} [{LEVELS[level]}] {format_record(image, fmt, args)}\n")
+        out.flush()
+
+
+def main() -> int:
+    ap = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter
+    )
+    ap.add_argument("elf", type=Path, help="firmware ELF, e.g. build/MICROBIT")
+    ap.add_argument("capture", type=Path, nargs="?", help="raw serial capture (default: stdin)")
+    ap.add_argument("--port", help="read from a serial port instead")
+    ap.add_argument("--baud", type=int, default=115200)
+    args = ap.parse_args()
+
+    try:
+        image = Image(args.elf)
+    except (OSError, ElfError) as e:
+        print(f"log_decode.py: {e}", file=sys.stderr)
+        return 1
+
+    if args.port:
+        import serial
+
+        stream = serial.Serial(args.port, args.baud, timeout=0.1)
+    elif args.capture:
+        stream = args.capture.open("rb")
+    else:
+        stream = sys.stdin.buffer
+
+    try:
+        decode(image, stream, sys.stdout, follow=bool(args.port))
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
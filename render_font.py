@@ -21,9 +21,8 @@ from typing import Iterable, List, Sequence, Tuple
 
 
 def _default_font_path() -> Path:
-    candidates = [
-        Path("./source") / "font-16x32.cpp",
-        Path("./source") / "font-8x16.cpp",
+    # Fonts are generated into build/generated/ from fonts/*.bdf by the build
+    candidates = sorted(Path("./build/generated").glob("*.cpp")) + [
         Path("./font-16x32.cpp"),
         Path("./font-8x16.cpp"),
     ]
@@ -188,7 +187,7 @@ def main() -> int:
         "--font",
         type=Path,
         default=FONT_CPP_DEFAULT,
-        help="Path to C++ font file (default: tries source/font-16x32.cpp then source/font-8x16.cpp)",
+        help="Path to C++ font file (default: the font generated in build/generated/)",
     )
     ap.add_argument(
         "--select",
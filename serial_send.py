@@ -0,0 +1,289 @@
+#!/usr/bin/env python3
+"""Stream frames from the host to the panel over the micro:bit's serial port.
+
+    python3 serial_send.py --port /dev/ttyACM0                      # test pattern
+    ffmpeg -i clip.mp4 -vf scale=32:32 -f rawvideo -pix_fmt rgb24 - \\
+        | python3 serial_send.py --port /dev/ttyACM0 -
+    python3 serial_send.py --dry-run frames.rgb                       # sizes only
+
+Input is raw RGB888 frames at the panel size (--size, 32 x 32 by default, so 3072
+bytes per frame). Without an input file a
+moving test pattern is sent. The script sends the `ingest` console command, switches
+to --baud once the device answers, and then streams COBS-framed packets (see
+source/DotMatrixSerialIngest.h). Frames that change little go as deltas, with a full
+frame every --keyframe frames so a lost packet does not linger on the panel.
+
+Device status lines are echoed as they arrive. A throughput report is printed at the
+end. Needs pyserial unless --dry-run is given.
+"""
+
+from __future__ import annotations
+
+import argparse
+import math
+import sys
+import threading
+import time
+import zlib
+from pathlib import Path
+from typing import BinaryIO, Iterator, List, Optional
+
+WIDTH = 32
+HEIGHT = 32
+PIXELS = WIDTH * HEIGHT
+FRAME_BYTES = PIXELS * 3
+
+FULL = 1
+DELTA = 2
+END = 3
+
+MAX_RUN = 255
+
+CONSOLE_BAUD = 115200
+
+
+def set_panel_size(size: int) -> None:
+    """Match DOTMATRIX_PANEL_WIDTH and DOTMATRIX_PANEL_HEIGHT of the firmware."""
+
+    global WIDTH, HEIGHT, PIXELS, FRAME_BYTES
+    WIDTH = HEIGHT = size
+    PIXELS = WIDTH * HEIGHT
+    FRAME_BYTES = PIXELS * 3
+
+
+def cobs_encode(data: bytes) -> bytes:
+    """COBS-encode `data` and append the zero delimiter."""
+
+    out = bytearray()
+    block = bytearray()
+    for byte in data:
+        if byte == 0:
+            out.append(len(block) + 1)
+            out += block
+            block.clear()
+            continue
+        block.append(byte)
+        if len(block) == 254:
+            out.append(255)
+            out += block
+            block.clear()
+    out.append(len(block) + 1)
+    out += block
+    out.append(0)
+    return bytes(out)
+
+
+def packet(kind: int, sequence: int, payload: bytes = b"") -> bytes:
+    body = bytes([kind, sequence & 0xFF]) + payload
+    return cobs_encode(body + zlib.crc32(body).to_bytes(4, "little"))
+
+
+def delta_payload(previous: bytes, frame: bytes) -> bytes:
+    """Runs of changed pixels. A single unchanged pixel inside a run costs as much as
+    starting a new run, so runs are allowed to bridge it."""
+
+    changed = [previous[i * 3 : i * 3 + 3] != frame[i * 3 : i * 3 + 3] for i in range(PIXELS)]
+    out = bytearray()
+    i = 0
+    while i < PIXELS:
+        if not changed[i]:
+            i += 1
+            continue
+        start = end = i
+        while end + 1 < PIXELS and end + 1 - start < MAX_RUN:
+            if changed[end + 1]:
+                end += 1
+            elif end + 2 < PIXELS and end + 2 - start < MAX_RUN and changed[end + 2]:
+                end += 2
+            else:
+                break
+        count = end - start + 1
+        out += bytes([start % WIDTH, start // WIDTH, count])
+        out += frame[start * 3 : (end + 1) * 3]
+        i = end + 1
+    return bytes(out)
+
+
+def test_pattern() -> Iterator[bytes]:
+    """A hue sweep with a white square bouncing across it."""
+
+    n = 0
+    while True:
+        frame = bytearray(FRAME_BYTES)
+        span = WIDTH - 8
+        bx = abs((n % (2 * span)) - span)
+        by = abs(((n * 2 // 3) % (2 * span)) - span)
+        for y in range(HEIGHT):
+            for x in range(WIDTH):
+                p = (y * WIDTH + x) * 3
+                if bx <= x < bx + 8 and by <= y < by + 8:
+                    frame[p : p + 3] = b"\xff\xff\xff"
+                    continue
+                hue = (x + y + n) / 64.0 * 2 * math.pi
+                frame[p] = int(60 + 60 * math.sin(hue))
+                frame[p + 1] = int(60 + 60 * math.sin(hue + 2.1))
+                frame[p + 2] = int(60 + 60 * math.sin(hue + 4.2))
+        yield bytes(frame)
+        n += 1
+
+
+def read_frames(stream: BinaryIO) -> Iterator[bytes]:
+    while True:
+        frame = stream.read(FRAME_BYTES)
+        if len(frame) < FRAME_BYTES:
+            return
+        yield frame
+
+
+class Report:
+    def __init__(self) -> None:
+        self.start = time.monotonic()
+        self.frames = 0
+        self.full = 0
+        self.delta = 0
+        self.bytes = 0
+
+    def add(self, kind: int, wire: int) -> None:
+        self.frames += 1
+        self.full += kind == FULL
+        self.delta += kind == DELTA
+        self.bytes += wire
+
+    def print(self, baud: Optional[int], device: Optional[str]) -> None:
+        elapsed = max(time.monotonic() - self.start, 1e-6)
+        print(f"frames        {self.frames} ({self.full} full, {self.delta} delta)")
+        print(f"elapsed       {elapsed:.2f} s, {self.frames / elapsed:.1f} fps sent")
+        if self.frames:
+            print(f"bytes/frame   {self.bytes / self.frames:.0f} on the wire "
+                  f"(full frame {len(packet(FULL, 0, bytes(FRAME_BYTES)))})")
+        print(f"wire rate     {self.bytes / elapsed:.0f} B/s", end="")
+        if baud:
+            # 10 bits per byte with start and stop bits.
+            print(f", {100 * self.bytes * 10 / elapsed / baud:.0f}% of {baud} baud")
+        else:
+            print()
+        if device:
+            print(f"device        {device}")
+
+
+def start_ingest(link, baud: int) -> None:
+    link.reset_input_buffer()
+    link.write(f"\r\ningest {baud}\r\n".encode())
+    deadline = time.monotonic() + 3
+    while time.monotonic() < deadline:
+        line = link.readline().decode("latin-1").strip()
+        if line == f"ingest {baud}":
+            link.flush()
+            link.baudrate = baud
+            # A lone delimiter discards anything half-received before the switch.
+            link.write(b"\x00")
+            return
+    raise RuntimeError("device did not answer the ingest command")
+
+
+def echo_device(link, lines: List[str], done: threading.Event) -> None:
+    while not done.is_set():
+        raw = link.readline()
+        if not raw:
+            continue
+        line = raw.decode("latin-1").strip()
+        if line:
+            lines.append(line)
+            print(f"device: {line}", file=sys.stderr)
+
+
+def main() -> int:
+    ap = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter
+    )
+    ap.add_argument("input", nargs="?", help="raw RGB888 frames, '-' for stdin "
+                    "(default: test pattern)")
+    ap.add_argument("--port", help="serial port of the micro:bit")
+    ap.add_argument("--baud", type=int, default=1000000, help="ingest baud rate")
+    ap.add_argument("--fps", type=float, default=20, help="send rate, 0 for as fast as "
+                    "the link allows")
+    ap.add_argument("--frames", type=int, default=0, help="stop after this many frames")
+    ap.add_argument("--keyframe", type=int, default=50, help="full frame every N frames")
+    ap.add_argument("--size", type=int, choices=(16, 32, 64), default=32,
+                    help="panel width and height")
+    ap.add_argument("--dry-run", action="store_true", help="encode without a device")
+    args = ap.parse_args()
+    set_panel_size(args.size)
+
+    if not args.port and not args.dry_run:
+        ap.error("--port is required unless --dry-run is given")
+
+    if args.input == "-":
+        frames = read_frames(sys.stdin.buffer)
+    elif args.input:
+        frames = read_frames(Path(args.input).open("rb"))
+    else:
+        frames = test_pattern()
+        if args.dry_run and not args.frames:
+            args.frames = 100
+
+    link = None
+    device_lines: List[str] = []
+    done = threading.Event()
+    reader = None
+    if not args.dry_run:
+        import serial
+
+        link = serial.Serial(args.port, CONSOLE_BAUD, timeout=0.5)
+        start_ingest(link, args.baud)
+        reader = threading.Thread(target=echo_device, args=(link, device_lines, done),
+                                  daemon=True)
+        reader.start()
+
+    report = Report()
+    period = 1.0 / args.fps if args.fps > 0 else 0.0
+    next_slot = time.monotonic()
+    previous: Optional[bytes] = None
+    sequence = 0
+
+    try:
+        for frame in frames:
+            kind, payload = FULL, frame
+            if previous is not None and (not args.keyframe or report.frames % args.keyframe):
+                delta = delta_payload(previous, frame)
+                if len(delta) < FRAME_BYTES:
+                    kind, payload = DELTA, delta
+
+            data = packet(kind, sequence, payload)
+            if link:
+                link.write(data)
+            report.add(kind, len(data))
+            previous = frame
+            sequence += 1
+
+            if args.frames and report.frames >= args.frames:
+                break
+            if period:
+                next_slot += period
+                delay = next_slot - time.monotonic()
+                if delay > 0:
+                    time.sleep(delay)
+                else:
+                    next_slot = time.monotonic()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if link:
+            link.write(packet(END, sequence))
+            link.flush()
+            deadline = time.monotonic() + 2
+            while time.monotonic() < deadline and not any(
+                l.startswith("ingest done") for l in device_lines
+            ):
+                time.sleep(0.05)
+            done.set()
+            reader.join()
+            link.close()
+
+    summary = next((l for l in reversed(device_lines) if l.startswith("ingest")), None)
+    report.print(None if args.dry_run else args.baud, summary)
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -1,4 +1,9 @@
 #include "DotMatrix.h"
+#include "DotMatrixFont.h"
+#include "DotMatrixLog.h"
+#include "DotMatrixTrace.h"
+#include "DotMatrixProtocol.h"
+#include "DotMatrixPixelFormat.h"
 
 #include "ble.h"
 #include "ble_gap.h"
@@ -20,54 +25,216 @@ static inline uint32_t min_u32(uint32_t a, uint32_t b)
     return a < b ? a : b;
 }
 
-static int gattc_write_cmd_chunks(uint16_t conn_handle,
-                                 uint16_t value_handle,
-                                 uint32_t chunk_size,
-                                 const uint8_t *data,
-                                 uint32_t data_size,
-                                 MicroBit &uBit,
-                                 const char *label)
+static inline int min_int(int a, int b)
 {
-    const uint8_t *dataPtr = data;
-    uint32_t remaining = data_size;
+    return a < b ? a : b;
+}
+
+static inline int max_int(int a, int b)
+{
+    return a > b ? a : b;
+}
+
+// Link counters. There is one link, and it is only written from fibers.
+static DotMatrixStats link_stats;
+static uint32_t stats_since_ms = 0;
+
+// Bytes sent in the current one second window, for the peak rate.
+static uint32_t window_start_ms = 0;
+static uint32_t window_bytes = 0;
 
-    while (remaining > 0)
+constexpr uint32_t STATS_WINDOW_MS = 1000;
+
+static uint32_t now_ms()
+{
+    return (uint32_t)system_timer_current_time();
+}
+
+static void stats_record_write(uint32_t bytes)
+{
+    link_stats.bytesSent += bytes;
+    link_stats.writesSent++;
+
+    const uint32_t now = now_ms();
+    const uint32_t window = now - window_start_ms;
+    if (window >= STATS_WINDOW_MS)
     {
+        const uint32_t rate = (uint64_t)window_bytes * 1000 / window;
+        if (rate > link_stats.peakBytesPerSecond)
+            link_stats.peakBytesPerSecond = rate;
+        window_start_ms = now;
+        window_bytes = 0;
+    }
+    window_bytes += bytes;
+}
+
+static void stats_record_stall(uint32_t us)
+{
+    link_stats.stalls++;
+    link_stats.stallTimeUs += us;
+}
+
+static void stats_record_write_rsp(uint32_t us)
+{
+    uint32_t bucket = 0;
+    for (uint32_t ms = us / 1000; ms && bucket < DOTMATRIX_WRITE_RSP_BUCKETS - 1; ms >>= 1)
+        bucket++;
+    link_stats.writeRspHistogram[bucket]++;
+}
+
+static void stats_reset()
+{
+    memset(&link_stats, 0, sizeof(link_stats));
+    stats_since_ms = window_start_ms = now_ms();
+    window_bytes = 0;
+}
+
+// Largest ATT value a write command can carry on this link.
+constexpr uint32_t MAX_CHUNK_SIZE = NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3;
+
+// Packs a packet written in pieces into MTU-sized write commands, so a packet can be
+// streamed from several buffers (and from flash) without assembling it in RAM first.
+// Only the transmit fiber sends, so the staging buffer is shared.
+class ChunkWriter
+{
+public:
+    ChunkWriter(uint16_t conn_handle,
+                uint16_t value_handle,
+                uint32_t chunk_size,
+                const char *label)
+        : connHandle_(conn_handle)
+        , valueHandle_(value_handle)
+        , chunkSize_(min_u32(chunk_size, MAX_CHUNK_SIZE))
+        , label_(label)
+        , used_(0)
+    {
+    }
+
+    int write(const uint8_t *data, uint32_t length)
+    {
+        while (length > 0)
+        {
+            const uint32_t n = min_u32(chunkSize_ - used_, length);
+            memcpy(chunk_ + used_, data, n);
+            used_ += n;
+            data += n;
+            length -= n;
+
+            if (used_ == chunkSize_)
+            {
+                const int rc = flush();
+                if (rc != DEVICE_OK)
+                    return rc;
+            }
+        }
+
+        return DEVICE_OK;
+    }
+
+    // Sends whatever is staged as a final, possibly short, write.
+    int flush()
+    {
+        if (used_ == 0)
+            return DEVICE_OK;
+
         ble_gattc_write_params_t params;
         memset(&params, 0, sizeof(params));
         params.write_op = BLE_GATT_OP_WRITE_CMD;
-        params.handle = value_handle;
-
-        const uint32_t chunk = min_u32(chunk_size, remaining);
-        params.len = chunk;
-        params.p_value = (uint8_t *)dataPtr;
+        params.handle = valueHandle_;
+        params.len = used_;
+        params.p_value = chunk_;
         params.offset = 0;
 
         uint32_t err;
         do
         {
-            err = sd_ble_gattc_write(conn_handle, &params);
+            DOTMATRIX_TRACE_BEGIN(DOTMATRIX_TRACE_GATTC_WRITE, used_);
+            err = sd_ble_gattc_write(connHandle_, &params);
+            DOTMATRIX_TRACE_END(DOTMATRIX_TRACE_GATTC_WRITE);
+
             if (err == NRF_ERROR_RESOURCES)
+            {
+                DOTMATRIX_TRACE_SCOPE(DOTMATRIX_TRACE_STALL, 0);
+                const uint32_t start = (uint32_t)system_timer_current_time_us();
                 fiber_sleep(1);
+                stats_record_stall((uint32_t)system_timer_current_time_us() - start);
+            }
             else if (err != NRF_SUCCESS)
             {
-                uBit.serial.printf("%s write failed: 0x%lx\r\n", label, err);
+                DOTMATRIX_LOG_ERROR("%s write failed: 0x%lx", label_, err);
                 return DEVICE_INVALID_STATE;
             }
         } while (err == NRF_ERROR_RESOURCES);
 
-        dataPtr += chunk;
-        remaining -= chunk;
+        stats_record_write(used_);
+        used_ = 0;
+        return DEVICE_OK;
     }
 
-    return DEVICE_OK;
-}
+private:
+    const uint16_t connHandle_;
+    const uint16_t valueHandle_;
+    const uint32_t chunkSize_;
+    const char *label_;
+    uint32_t used_;
+
+    static uint8_t chunk_[MAX_CHUNK_SIZE];
+};
+
+uint8_t ChunkWriter::chunk_[MAX_CHUNK_SIZE];
+
+// An RGB888 image as a stream of pixel bytes, with a packet header written ahead of each
+// DOTMATRIX_IMAGE_CHUNK_SIZE bytes. Callers may split the stream anywhere.
+class ImageWriter
+{
+public:
+    ImageWriter(ChunkWriter &writer, uint32_t image_bytes)
+        : writer_(writer)
+        , imageBytes_(image_bytes)
+        , offset_(0)
+    {
+    }
+
+    int write(const uint8_t *rgb, uint32_t length)
+    {
+        while (length > 0)
+        {
+            const uint32_t inChunk = offset_ % DOTMATRIX_IMAGE_CHUNK_SIZE;
+            if (inChunk == 0)
+            {
+                uint8_t header[DOTMATRIX_IMAGE_HEADER_SIZE];
+                dotmatrix_encode_image_chunk_header(
+                    header, min_u32(imageBytes_ - offset_, DOTMATRIX_IMAGE_CHUNK_SIZE),
+                    imageBytes_, offset_ != 0);
+
+                const int rc = writer_.write(header, sizeof(header));
+                if (rc != DEVICE_OK)
+                    return rc;
+            }
+
+            const uint32_t n = min_u32(DOTMATRIX_IMAGE_CHUNK_SIZE - inChunk, length);
+            const int rc = writer_.write(rgb, n);
+            if (rc != DEVICE_OK)
+                return rc;
+
+            offset_ += n;
+            rgb += n;
+            length -= n;
+        }
+
+        return DEVICE_OK;
+    }
+
+private:
+    ChunkWriter &writer_;
+    const uint32_t imageBytes_;
+    uint32_t offset_;
+};
 
 static int gattc_write_req(uint16_t conn_handle,
                            uint16_t value_handle,
                            const uint8_t *data,
                            uint16_t data_len,
-                           MicroBit &uBit,
                            const char *label)
 {
     ble_gattc_write_params_t params;
@@ -78,150 +245,188 @@ static int gattc_write_req(uint16_t conn_handle,
     params.p_value = (uint8_t *)data;
     params.offset = 0;
 
+    DOTMATRIX_TRACE_BEGIN(DOTMATRIX_TRACE_GATTC_WRITE, data_len);
     const uint32_t err = sd_ble_gattc_write(conn_handle, &params);
+    DOTMATRIX_TRACE_END(DOTMATRIX_TRACE_GATTC_WRITE);
     if (err != NRF_SUCCESS)
     {
-        uBit.serial.printf("%s write failed: 0x%lx\r\n", label, err);
+        DOTMATRIX_LOG_ERROR("%s write failed: 0x%lx", label, err);
         return DEVICE_INVALID_STATE;
     }
 
     return DEVICE_OK;
 }
 
+// Far past any connection interval; a response this late is not coming.
+constexpr uint32_t WRITE_RSP_TIMEOUT_MS = 2000;
+
 static int gattc_write_req_wait(uint16_t conn_handle,
                                 uint16_t value_handle,
                                 const uint8_t *data,
                                 uint16_t data_len,
-                                MicroBit &uBit,
                                 volatile bool &write_in_progress,
                                 const char *label)
 {
+    DOTMATRIX_TRACE_SCOPE(DOTMATRIX_TRACE_WRITE_RSP, data_len);
+
+    const uint32_t start = (uint32_t)system_timer_current_time_us();
+
     write_in_progress = true;
-    const int rc = gattc_write_req(conn_handle, value_handle, data, data_len, uBit, label);
+    const int rc = gattc_write_req(conn_handle, value_handle, data, data_len, label);
     if (rc != DEVICE_OK)
     {
         write_in_progress = false;
         return rc;
     }
+    stats_record_write(data_len);
 
     while (write_in_progress)
+    {
+        if ((uint32_t)system_timer_current_time_us() - start > WRITE_RSP_TIMEOUT_MS * 1000)
+        {
+            write_in_progress = false;
+            DOTMATRIX_LOG_ERROR("%s write response timed out", label);
+            return DEVICE_INVALID_STATE;
+        }
         fiber_sleep(1);
+    }
+
+    stats_record_write_rsp((uint32_t)system_timer_current_time_us() - start);
 
     return DEVICE_OK;
 }
 
-// CRC32 lookup table (IEEE 802.3 polynomial: 0xEDB88320)
-static const uint32_t crc32_table[256] = {
-    0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f, 0xe963a535, 0x9e6495a3,
-    0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988, 0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91,
-    0x1db71064, 0x6ab020f2, 0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
-    0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9, 0xfa0f3d63, 0x8d080df5,
-    0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172, 0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b,
-    0x35b5a8fa, 0x42b2986c, 0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
-    0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423, 0xcfba9599, 0xb8bda50f,
-    0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924, 0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d,
-    0x76dc4190, 0x01db7106, 0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
-    0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d, 0x91646c97, 0xe6635c01,
-    0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e, 0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457,
-    0x65b0d9c6, 0x12b7e950, 0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
-    0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7, 0xa4d1c46d, 0xd3d6f4fb,
-    0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0, 0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9,
-    0x5005713c, 0x270241aa, 0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
-    0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81, 0xb7bd5c3b, 0xc0ba6cad,
-    0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a, 0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683,
-    0xe3630b12, 0x94643b84, 0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
-    0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb, 0x196c3671, 0x6e6b06e7,
-    0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc, 0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5,
-    0xd6d6a3e8, 0xa1d1937e, 0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
-    0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55, 0x316e8eef, 0x4669be79,
-    0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236, 0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f,
-    0xc5ba3bbe, 0xb2bd0b28, 0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
-    0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f, 0x72076785, 0x05005713,
-    0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38, 0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21,
-    0x86d3d2d4, 0xf1d4e242, 0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
-    0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69, 0x616bffd3, 0x166ccf45,
-    0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2, 0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db,
-    0xaed16a4a, 0xd9d65adc, 0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
-    0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693, 0x54de5729, 0x23d967bf,
-    0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94, 0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
-};
+constexpr uint32_t PANEL_WIDTH = DotMatrixPanel::width;
+constexpr uint32_t PANEL_HEIGHT = DotMatrixPanel::height;
 
-struct IDotMatrixDisplay
-{
-    uint16_t packet_length;
-    uint8_t command;
-    uint8_t subcommand;
-    uint8_t first_or_continuation;
-    uint32_t image_data_length;
-    uint8_t pixel_data[32 * 32 * 3];
-} __attribute__((packed));
-
-static IDotMatrixDisplay display_buffer;
-
-struct TextHeader
-{
-    uint16_t total_len;
-    uint8_t static_3;
-    uint8_t static_0;
-    uint8_t static_0_1;
-    uint32_t packet_length;
-    uint32_t crc;
-    uint8_t static_0_2;
-    uint8_t static_0_3;
-    uint8_t static_12;
-} __attribute__((packed));
-
-struct TextMetadata
-{
-    uint16_t number_of_characters;
-    uint8_t static_0;
-    uint8_t static_1;
-    uint8_t text_mode;
-    uint8_t text_speed;
-    uint8_t text_color_mode;
-    uint8_t text_color_r;
-    uint8_t text_color_g;
-    uint8_t text_color_b;
-    uint8_t text_color_bg_mode;
-    uint8_t bg_color_r;
-    uint8_t bg_color_g;
-    uint8_t bg_color_b;
-    uint8_t character_bitmaps[];
-} __attribute__((packed));
-
-struct ScoreboardPacket
-{
-    uint8_t command_start;
-    uint8_t placeholder;
-    uint8_t command_id;
-    uint8_t command_specifier;
-    uint16_t score0;
-    uint16_t score1;
-} __attribute__((packed));
-
-struct ImageModePacket
-{
-    uint8_t packet_length;
-    uint8_t placeholder;
-    uint8_t command_id;
-    uint8_t mode;
-    uint8_t enable_diy;
-} __attribute__((packed));
-
-const ImageModePacket IMAGE_MODE_DDIY_ENABLE = {
-    5,
-    0,
-    4,
-    1,
-    1, // mode 1 = enable DIY
-};
+using Format = DotMatrixFramebufferFormat;
+constexpr bool HAVE_FRAMEBUFFER = DOTMATRIX_PIXEL_FORMAT != DOTMATRIX_PIXEL_FORMAT_NONE;
+
+// Drawing target, and the copy of it the transmit fiber sends, so producers can keep
+// drawing while a frame is on the air. Both hold the build's storage format, and shrink
+// to a byte when there is no framebuffer.
+static uint8_t frame_buffer[HAVE_FRAMEBUFFER ? Format::bytes(DotMatrixPanel::pixels) : 1];
+static uint8_t tx_frame[sizeof(frame_buffer)];
+
+// Pixels expanded to RGB888, or computed by a shader, per write.
+constexpr uint32_t SPAN_PIXELS = DOTMATRIX_SHADER_SPAN;
+
+// The panel advances a marquee by one column every `text_speed` ms.
+constexpr uint32_t DEFAULT_TEXT_SPEED = 95;
+
+// One glyph row with bit n set when column n is inked (LSB is the leftmost column).
+// The generated font_data is word aligned, so the memcpy of a 16 pixel row compiles to one
+// halfword load.
+static inline uint32_t glyph_row_bits(const uint8_t *row, uint32_t bytes_per_row)
+{
+    if (bytes_per_row == 2)
+    {
+        uint16_t bits;
+        memcpy(&bits, row, sizeof(bits));
+        return bits;
+    }
+    return row[0];
+}
+
+static void fill_run(uint32_t first, uint32_t count, const DotMatrixColour &colour)
+{
+    for (uint32_t i = 0; i < count; i++)
+        Format::set(frame_buffer, first + i, colour.r, colour.g, colour.b);
+}
+
+// Moves each row of the area `n` columns left or right, one block move per row. Wrapped
+// pixels go through a small RGB888 buffer.
+static void scroll_rows(int x0, int y0, int x1, int y1, uint32_t n, bool left, bool wrap,
+                        const DotMatrixColour &fill)
+{
+    const uint32_t width = x1 - x0;
+    uint8_t saved[DotMatrixPanel::width * 3];
+
+    for (int y = y0; y < y1; y++)
+    {
+        const uint32_t row = y * PANEL_WIDTH + x0;
+        const uint32_t leaving = left ? row : row + width - n;
+        const uint32_t entering = left ? row + width - n : row;
+
+        if (wrap)
+            for (uint32_t i = 0; i < n; i++)
+                Format::get(frame_buffer, leaving + i, &saved[i * 3]);
+
+        if (left)
+            Format::move(frame_buffer, row, row + n, width - n);
+        else
+            Format::move(frame_buffer, row + n, row, width - n);
+
+        if (wrap)
+            Format::pack(frame_buffer, entering, saved, n);
+        else
+            fill_run(entering, n, fill);
+    }
+}
+
+// Moves the rows of the area `n` rows up or down. Full-width areas are contiguous, so
+// that is a single block move.
+static void scroll_columns(int x0, int y0, int x1, int y1, uint32_t n, bool up, bool wrap,
+                           const DotMatrixColour &fill)
+{
+    const uint32_t width = x1 - x0;
+    const uint32_t height = y1 - y0;
+
+    if (wrap)
+    {
+        // Rotate rows in cycles, each row moved once, with one row held aside per cycle.
+        uint8_t saved[DotMatrixPanel::width * 3];
+        const uint32_t step = up ? n : height - n;
+        uint32_t moved = 0;
+
+        for (uint32_t start = 0; moved < height; start++)
+        {
+            const uint32_t first = (y0 + start) * PANEL_WIDTH + x0;
+            for (uint32_t i = 0; i < width; i++)
+                Format::get(frame_buffer, first + i, &saved[i * 3]);
+
+            uint32_t to = start;
+            while (true)
+            {
+                const uint32_t from = (to + step) % height;
+                moved++;
+                if (from == start)
+                    break;
+
+                Format::move(frame_buffer, (y0 + to) * PANEL_WIDTH + x0,
+                             (y0 + from) * PANEL_WIDTH + x0, width);
+                to = from;
+            }
 
-constexpr uint32_t HEADER_SIZE = 9;
+            Format::pack(frame_buffer, (y0 + to) * PANEL_WIDTH + x0, saved, width);
+        }
+        return;
+    }
 
-extern "C" const uint8_t font_data[];
-extern "C" const uint32_t BITMAP_SIZE;
-extern "C" const uint32_t SEPARATOR_LEN;
-extern "C" const uint8_t separator[];
+    const uint32_t kept = height - n;
+    if (width == PANEL_WIDTH)
+    {
+        const uint32_t top = y0 * PANEL_WIDTH;
+        if (up)
+            Format::move(frame_buffer, top, top + n * PANEL_WIDTH, kept * PANEL_WIDTH);
+        else
+            Format::move(frame_buffer, top + n * PANEL_WIDTH, top, kept * PANEL_WIDTH);
+    }
+    else
+    {
+        // Row by row, in the order that reads each row before it is overwritten.
+        for (uint32_t i = 0; i < kept; i++)
+        {
+            const uint32_t to = up ? y0 + i : y1 - 1 - i;
+            const uint32_t from = up ? to + n : to - n;
+            Format::move(frame_buffer, to * PANEL_WIDTH + x0, from * PANEL_WIDTH + x0, width);
+        }
+    }
+
+    const int exposed = up ? y1 - n : y0;
+    for (uint32_t i = 0; i < n; i++)
+        fill_run((exposed + i) * PANEL_WIDTH + x0, width, fill);
+}
 
 } // namespace
 
@@ -230,7 +435,7 @@ void dotmatrix_gattc_event_handler(ble_evt_t const *p_ble_evt, void *p_context)
     (void)p_context;
 
     if (g_instance)
-        g_instance->handleGattcEvent(p_ble_evt);
+        g_instance->onBleEvent(p_ble_evt);
 }
 
 // Register the observer with priority 3
@@ -242,14 +447,37 @@ DotMatrixClient::DotMatrixClient(MicroBit &uBit)
     , uuidType_(0)
     , discoveryInProgress_(false)
     , writeInProgress_(false)
-    , chunkSize_(20)
+    , mtu_(BLE_GATT_ATT_MTU_DEFAULT)
+    , chunkSize_(BLE_GATT_ATT_MTU_DEFAULT - 3)
     , writeCharHandle_(BLE_GATT_HANDLE_INVALID)
+    , textStyle_{1, DEFAULT_TEXT_SPEED, 1, 255, 0, 0, 0, 0, 0, 0}
+    , dirty_{0, 0, 0, 0}
+    , dirtyPixelCount_(0)
+    , dirtyPixelOverflow_(false)
+    , fibersStarted_(false)
+    , txBusy_(false)
+    , imageQueued_(false)
+    , shaderQueued_(false)
+    , shader_{nullptr, nullptr, nullptr}
+    , observerTiming_{0, 0, 0, 0}
 {
     g_instance = this;
+    // Observer time and trace events are measured in CPU cycles.
+    dotmatrix_cycle_counter_enable();
 }
 
 void DotMatrixClient::onConnected()
 {
+    link_stats.connections++;
+
+    // The scheduler is not running yet when the client is constructed.
+    if (!fibersStarted_)
+    {
+        fibersStarted_ = true;
+        create_fiber(gattcFiberEntry, this);
+        create_fiber(txFiberEntry, this);
+    }
+
     discoverWriteCharacteristic();
 
     while (discoveryInProgress_)
@@ -283,7 +511,7 @@ void DotMatrixClient::discoverWriteCharacteristic()
     const uint16_t conn_handle = connectionHandle();
     if (conn_handle == BLE_CONN_HANDLE_INVALID)
     {
-        uBit_.serial.printf("No connection handle!\r\n");
+        DOTMATRIX_LOG_ERROR("No connection handle!");
         return;
     }
 
@@ -297,13 +525,13 @@ void DotMatrixClient::discoverWriteCharacteristic()
         uint32_t err = sd_ble_uuid_vs_add(&base_uuid, &uuidType_);
         if (err != NRF_SUCCESS)
         {
-            uBit_.serial.printf("UUID add failed: 0x%lx\r\n", err);
+            DOTMATRIX_LOG_ERROR("UUID add failed: 0x%lx", err);
             discoveryInProgress_ = false;
             return;
         }
 
         uuidRegistered_ = true;
-        uBit_.serial.printf("UUID registered, type: %d\r\n", uuidType_);
+        DOTMATRIX_LOG_INFO("UUID registered, type: %d", uuidType_);
     }
 
     ble_gattc_handle_range_t range;
@@ -313,12 +541,12 @@ void DotMatrixClient::discoverWriteCharacteristic()
     const uint32_t err = sd_ble_gattc_characteristics_discover(conn_handle, &range);
     if (err != NRF_SUCCESS)
     {
-        uBit_.serial.printf("Characteristic discovery failed: 0x%lx\r\n", err);
+        DOTMATRIX_LOG_ERROR("Characteristic discovery failed: 0x%lx", err);
         discoveryInProgress_ = false;
         return;
     }
 
-    uBit_.serial.printf("Started characteristic discovery\r\n");
+    DOTMATRIX_LOG_INFO("Started characteristic discovery");
 }
 
 void DotMatrixClient::requestMtuExchange()
@@ -330,56 +558,351 @@ void DotMatrixClient::requestMtuExchange()
     const uint32_t err = sd_ble_gattc_exchange_mtu_request(conn_handle, NRF_SDH_BLE_GATT_MAX_MTU_SIZE);
     if (err == NRF_SUCCESS)
     {
-        uBit_.serial.printf("MTU exchange requested\r\n");
+        DOTMATRIX_LOG_INFO("MTU exchange requested");
     }
     else
     {
-        uBit_.serial.printf("MTU exchange request failed: 0x%x\r\n", err);
+        DOTMATRIX_LOG_ERROR("MTU exchange request failed: 0x%lx", err);
     }
 }
 
-uint32_t DotMatrixClient::calculateCrc32(const uint8_t *data, size_t length)
+void DotMatrixClient::clearDisplay() {
+    Format::fill(frame_buffer, DotMatrixPanel::pixels, 0, 0, 0);
+    markDirty(0, 0, PANEL_WIDTH, PANEL_HEIGHT);
+}
+
+void DotMatrixClient::setPixel(uint8_t x, uint8_t y, uint8_t r, uint8_t g, uint8_t b) {
+    if (!DotMatrixPanel::contains(x, y))
+        return;
+
+    Format::set(frame_buffer, y * PANEL_WIDTH + x, r, g, b);
+    markDirty(x, y, 1, 1);
+}
+
+bool DotMatrixClient::updatePixel(uint8_t x, uint8_t y, uint8_t r, uint8_t g, uint8_t b)
 {
-    uint32_t crc = 0xFFFFFFFF;
-    for (size_t i = 0; i < length; i++)
-        crc = crc32_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
-    return ~crc;
+    if (!DotMatrixPanel::contains(x, y))
+        return false;
+
+    // Compared after storing, so colours that quantise to the same value count as equal.
+    const uint32_t index = y * PANEL_WIDTH + x;
+    uint8_t before[3], after[3];
+    Format::get(frame_buffer, index, before);
+    Format::set(frame_buffer, index, r, g, b);
+    Format::get(frame_buffer, index, after);
+    if (memcmp(before, after, sizeof(after)) == 0)
+        return false;
+
+    markDirty(x, y, 1, 1);
+    return true;
 }
 
-void DotMatrixClient::clearDisplay() {
-    memset(display_buffer.pixel_data, 0, sizeof(display_buffer.pixel_data));
+void DotMatrixClient::getPixel(uint8_t x, uint8_t y, uint8_t *rgb) const
+{
+    if (!DotMatrixPanel::contains(x, y))
+    {
+        memset(rgb, 0, 3);
+        return;
+    }
+
+    Format::get(frame_buffer, y * PANEL_WIDTH + x, rgb);
 }
 
-void DotMatrixClient::setPixel(uint8_t x, uint8_t y, uint8_t r, uint8_t g, uint8_t b) {
-    if (x >= 32 || y >= 32)
+void DotMatrixClient::setPixels(uint8_t x, uint8_t y, const uint8_t *rgb, uint32_t count)
+{
+    if (x >= PANEL_WIDTH || y >= PANEL_HEIGHT || count == 0)
         return;
 
-    uint8_t *px = &display_buffer.pixel_data[(y * 32 + x) * 3];
-    px[0] = r;
-    px[1] = g;
-    px[2] = b;
+    const uint32_t first = y * PANEL_WIDTH + x;
+    if (count > DotMatrixPanel::pixels - first)
+        count = DotMatrixPanel::pixels - first;
+
+    Format::pack(frame_buffer, first, rgb, count);
+
+    const uint32_t last = first + count - 1;
+    if (last / PANEL_WIDTH == y)
+        markDirty(x, y, count, 1);
+    else
+        markDirty(0, y, PANEL_WIDTH, last / PANEL_WIDTH - y + 1);
+}
+
+DotMatrixRect DotMatrixClient::scroll(DotMatrixScrollDirection direction, uint8_t amount,
+                                      bool wrap, const DotMatrixColour &fill)
+{
+    const DotMatrixRect panel = {0, 0, (int16_t)PANEL_WIDTH, (int16_t)PANEL_HEIGHT};
+    return scroll(panel, direction, amount, wrap, fill);
 }
 
-void DotMatrixClient::handleGattcEvent(ble_evt_t const *pBleEvt)
+DotMatrixRect DotMatrixClient::scroll(const DotMatrixRect &area,
+                                      DotMatrixScrollDirection direction, uint8_t amount,
+                                      bool wrap, const DotMatrixColour &fill)
 {
-    switch (pBleEvt->header.evt_id)
+    const int x0 = max_int(area.x0, 0);
+    const int y0 = max_int(area.y0, 0);
+    const int x1 = min_int(area.x1, PANEL_WIDTH);
+    const int y1 = min_int(area.y1, PANEL_HEIGHT);
+    if (x1 <= x0 || y1 <= y0)
+        return {0, 0, 0, 0};
+
+    const bool horizontal =
+        direction == DOTMATRIX_SCROLL_LEFT || direction == DOTMATRIX_SCROLL_RIGHT;
+    const uint32_t span = horizontal ? x1 - x0 : y1 - y0;
+    const uint32_t n = wrap ? amount % span : min_u32(amount, span);
+    if (n == 0)
+        return {0, 0, 0, 0};
+
+    // The panel has no scroll command, so everything that moved has to be sent again.
+    markDirty(x0, y0, x1 - x0, y1 - y0);
+
+    switch (direction)
     {
-        case BLE_GATTC_EVT_CHAR_DISC_RSP:
+        case DOTMATRIX_SCROLL_LEFT:
+            scroll_rows(x0, y0, x1, y1, n, true, wrap, fill);
+            return wrap ? DotMatrixRect{0, 0, 0, 0}
+                        : DotMatrixRect{(int16_t)(x1 - n), (int16_t)y0, (int16_t)x1, (int16_t)y1};
+
+        case DOTMATRIX_SCROLL_RIGHT:
+            scroll_rows(x0, y0, x1, y1, n, false, wrap, fill);
+            return wrap ? DotMatrixRect{0, 0, 0, 0}
+                        : DotMatrixRect{(int16_t)x0, (int16_t)y0, (int16_t)(x0 + n), (int16_t)y1};
+
+        case DOTMATRIX_SCROLL_UP:
+            scroll_columns(x0, y0, x1, y1, n, true, wrap, fill);
+            return wrap ? DotMatrixRect{0, 0, 0, 0}
+                        : DotMatrixRect{(int16_t)x0, (int16_t)(y1 - n), (int16_t)x1, (int16_t)y1};
+
+        default:
+            scroll_columns(x0, y0, x1, y1, n, false, wrap, fill);
+            return wrap ? DotMatrixRect{0, 0, 0, 0}
+                        : DotMatrixRect{(int16_t)x0, (int16_t)y0, (int16_t)x1, (int16_t)(y0 + n)};
+    }
+}
+
+void DotMatrixClient::markDirty(int x, int y, int w, int h)
+{
+    const int x0 = max_int(x, 0);
+    const int y0 = max_int(y, 0);
+    const int x1 = min_int(x + w, PANEL_WIDTH);
+    const int y1 = min_int(y + h, PANEL_HEIGHT);
+    if (x1 <= x0 || y1 <= y0)
+        return;
+
+    if (x1 - x0 == 1 && y1 - y0 == 1 && !dirtyPixelOverflow_)
+    {
+        bool listed = false;
+        for (uint32_t i = 0; i < dirtyPixelCount_ && !listed; i++)
+            listed = dirtyPixels_[i].x == x0 && dirtyPixels_[i].y == y0;
+
+        if (!listed && dirtyPixelCount_ < DOTMATRIX_DIRTY_PIXEL_LIMIT)
+            dirtyPixels_[dirtyPixelCount_++] = {(uint8_t)x0, (uint8_t)y0};
+        else if (!listed)
+            dirtyPixelOverflow_ = true;
+    }
+    else
+    {
+        dirtyPixelOverflow_ = true;
+    }
+
+    if (dirty_.isEmpty())
+    {
+        dirty_ = {(int16_t)x0, (int16_t)y0, (int16_t)x1, (int16_t)y1};
+        return;
+    }
+
+    dirty_.x0 = min_int(dirty_.x0, x0);
+    dirty_.y0 = min_int(dirty_.y0, y0);
+    dirty_.x1 = max_int(dirty_.x1, x1);
+    dirty_.y1 = max_int(dirty_.y1, y1);
+}
+
+bool DotMatrixClient::isDirty() const
+{
+    return !dirty_.isEmpty();
+}
+
+int DotMatrixClient::textWidth(ManagedString &text) const
+{
+    int width = 0;
+    for (int i = 0; i < text.length(); i++)
+        width += font_advance[glyph_index(text.charAt(i))];
+    return width;
+}
+
+int DotMatrixClient::drawText(int x, int y, ManagedString &text, uint8_t r, uint8_t g, uint8_t b)
+{
+    const uint32_t bytesPerRow = BITMAP_SIZE / GLYPH_HEIGHT;
+    const int rowStart = max_int(0, -y);
+    const int rowEnd = min_int(GLYPH_HEIGHT, PANEL_HEIGHT - y);
+
+    int pen = x;
+
+    for (int i = 0; i < text.length(); i++)
+    {
+        const uint32_t index = glyph_index(text.charAt(i));
+        const int left = font_left[index];
+        const int advance = font_advance[index];
+
+        // Panel column of glyph column 0, and the glyph columns that are both part of
+        // this glyph's advance and on the panel.
+        const int origin = pen - left;
+        const int lo = max_int(left, -origin);
+        const int hi = min_int(min_int(left + advance, GLYPH_WIDTH), PANEL_WIDTH - origin);
+
+        if (lo < hi && rowStart < rowEnd)
         {
-            uint16_t count = pBleEvt->evt.gattc_evt.params.char_disc_rsp.count;
-            uBit_.serial.printf("Found %d characteristics\r\n", count);
+            const uint32_t mask = ((1u << hi) - 1) & ~((1u << lo) - 1);
+            const uint8_t *glyphRow = &font_data[index * BITMAP_SIZE + rowStart * bytesPerRow];
 
-            for (int i = 0; i < count; i++)
+            for (int gy = rowStart; gy < rowEnd; gy++, glyphRow += bytesPerRow)
             {
-                const ble_gattc_char_t *p_char = &pBleEvt->evt.gattc_evt.params.char_disc_rsp.chars[i];
+                // Whole rows are tested at once; only inked columns are visited.
+                uint32_t bits = glyph_row_bits(glyphRow, bytesPerRow) & mask;
+                if (bits == 0)
+                    continue;
 
-                if (p_char->uuid.type == uuidType_ && p_char->uuid.uuid == 0xFA02)
+                const uint32_t line = (y + gy) * PANEL_WIDTH + origin;
+                while (bits)
                 {
-                    writeCharHandle_ = p_char->handle_value;
-                    uBit_.serial.printf("FOUND WRITE CHAR! Handle: 0x%04X\r\n", writeCharHandle_);
-                    uBit_.display.print('W');
+                    const int column = __builtin_ctz(bits);
+                    bits &= bits - 1;
+                    Format::set(frame_buffer, line + column, r, g, b);
                 }
             }
+        }
+
+        pen += advance;
+    }
+
+    markDirty(x, y + rowStart, pen - x, rowEnd - rowStart);
+    return pen;
+}
+
+void DotMatrixClient::setTextSpeed(uint8_t speed)
+{
+    textStyle_.speed = speed;
+}
+
+void DotMatrixClient::setBrightness(uint8_t level)
+{
+    colour_.setBrightness(level);
+}
+
+uint8_t DotMatrixClient::brightness() const
+{
+    return colour_.brightness();
+}
+
+void DotMatrixClient::setWhiteBalance(uint8_t r, uint8_t g, uint8_t b)
+{
+    colour_.setWhiteBalance(r, g, b);
+}
+
+uint32_t DotMatrixClient::textDuration(uint16_t characters) const
+{
+    // Text enters at the right edge and is done once the last column has left on the left.
+    const uint32_t columns = characters * GLYPH_WIDTH + PANEL_WIDTH;
+    return columns * textStyle_.speed;
+}
+
+void DotMatrixClient::onBleEvent(ble_evt_t const *pBleEvt)
+{
+    const uint32_t start = DWT->CYCCNT;
+
+    GattcEvent event;
+    if (!decodeGattcEvent(pBleEvt, event))
+        return;
+
+#if CONFIG_ENABLED(DOTMATRIX_DEFERRED_GATTC_EVENTS)
+    // Keep the observer short: anything slow, such as serial output, runs on a fiber.
+    if (gattcEvents_.push(event))
+        MicroBitEvent(DOTMATRIX_ID, DOTMATRIX_EVT_GATTC);
+    else
+        observerTiming_.dropped++;
+#else
+    handleGattcEvent(event);
+#endif
+
+    const uint32_t cycles = DWT->CYCCNT - start;
+    observerTiming_.events++;
+    observerTiming_.totalCycles += cycles;
+    if (cycles > observerTiming_.maxCycles)
+        observerTiming_.maxCycles = cycles;
+}
+
+bool DotMatrixClient::decodeGattcEvent(ble_evt_t const *pBleEvt, GattcEvent &event) const
+{
+    event.id = pBleEvt->header.evt_id;
+    event.value = 0;
+    event.handle = BLE_GATT_HANDLE_INVALID;
+
+    switch (event.id)
+    {
+        case BLE_GATTC_EVT_CHAR_DISC_RSP:
+        {
+            const ble_gattc_evt_char_disc_rsp_t &rsp = pBleEvt->evt.gattc_evt.params.char_disc_rsp;
+            event.value = rsp.count;
+
+            // The response only lives as long as the observer call, so search it here.
+            for (int i = 0; i < rsp.count; i++)
+            {
+                if (rsp.chars[i].uuid.type == uuidType_ && rsp.chars[i].uuid.uuid == 0xFA02)
+                    event.handle = rsp.chars[i].handle_value;
+            }
+            return true;
+        }
+
+        case BLE_GATTC_EVT_EXCHANGE_MTU_RSP:
+            event.value = pBleEvt->evt.gattc_evt.params.exchange_mtu_rsp.server_rx_mtu;
+            return true;
+
+        case BLE_GATTC_EVT_WRITE_RSP:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+void DotMatrixClient::gattcFiberEntry(void *param)
+{
+    static_cast<DotMatrixClient *>(param)->gattcLoop();
+}
+
+void DotMatrixClient::gattcLoop()
+{
+    while (true)
+    {
+        // The observer pushes from an interrupt. With interrupts off from the failed pop
+        // until this fiber is on the wait queue, its event cannot fall in between.
+        GattcEvent event;
+        const uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        const bool popped = gattcEvents_.pop(event);
+        if (!popped)
+            fiber_wake_on_event(DOTMATRIX_ID, DOTMATRIX_EVT_GATTC);
+        __set_PRIMASK(primask);
+
+        if (popped)
+            handleGattcEvent(event);
+        else
+            schedule();
+    }
+}
+
+void DotMatrixClient::handleGattcEvent(const GattcEvent &event)
+{
+    switch (event.id)
+    {
+        case BLE_GATTC_EVT_CHAR_DISC_RSP:
+        {
+            DOTMATRIX_LOG_INFO("Found %d characteristics", event.value);
+
+            if (event.handle != BLE_GATT_HANDLE_INVALID)
+            {
+                writeCharHandle_ = event.handle;
+                DOTMATRIX_LOG_INFO("FOUND WRITE CHAR! Handle: 0x%04X", writeCharHandle_);
+                uBit_.display.print('W');
+            }
 
             discoveryInProgress_ = false;
             break;
@@ -387,12 +910,13 @@ void DotMatrixClient::handleGattcEvent(ble_evt_t const *pBleEvt)
 
         case BLE_GATTC_EVT_EXCHANGE_MTU_RSP:
         {
-            uint16_t mtu = pBleEvt->evt.gattc_evt.params.exchange_mtu_rsp.server_rx_mtu;
-            uBit_.serial.printf("Negotiated MTU: %d bytes\r\n", mtu);
+            uint16_t mtu = event.value;
+            DOTMATRIX_LOG_INFO("Negotiated MTU: %d bytes", mtu);
 
             uint16_t max_data_length = mtu > 3 ? (mtu - 3) : 20;
-            uBit_.serial.printf("Max data per write: %d bytes\r\n", max_data_length);
+            DOTMATRIX_LOG_INFO("Max data per write: %d bytes", max_data_length);
 
+            mtu_ = mtu;
             chunkSize_ = max_data_length;
             break;
         }
@@ -400,7 +924,7 @@ void DotMatrixClient::handleGattcEvent(ble_evt_t const *pBleEvt)
         case BLE_GATTC_EVT_WRITE_RSP:
         {
             writeInProgress_ = false;
-            uBit_.serial.printf("Write confirmed!\r\n");
+            DOTMATRIX_LOG_DEBUG("Write confirmed!");
             break;
         }
 
@@ -409,264 +933,441 @@ void DotMatrixClient::handleGattcEvent(ble_evt_t const *pBleEvt)
     }
 }
 
+DotMatrixObserverTiming DotMatrixClient::observerTiming() const
+{
+    return observerTiming_;
+}
+
+DotMatrixStats DotMatrixClient::stats() const
+{
+    DotMatrixStats stats = link_stats;
+    stats.elapsedMs = now_ms() - stats_since_ms;
+    stats.averageBytesPerSecond =
+        stats.elapsedMs ? (uint64_t)stats.bytesSent * 1000 / stats.elapsedMs : 0;
+    stats.mtu = mtu_;
+    stats.chunkSize = chunkSize_;
+    return stats;
+}
+
+void DotMatrixClient::resetStats()
+{
+    stats_reset();
+}
+
 void DotMatrixClient::fillTestPattern()
 {
-    memset(display_buffer.pixel_data, 255, sizeof(display_buffer.pixel_data));
+    markDirty(0, 0, PANEL_WIDTH, PANEL_HEIGHT);
 
-    for (int i = 0; i < 32; i++)
+    // Red, green and blue rows.
+    for (uint32_t i = 0; i < PANEL_HEIGHT; i++)
     {
-        for (int j = 0; j < 32; j++)
-        {
-            uint8_t *px = &display_buffer.pixel_data[(i * 32 + j) * 3];
-            if (i % 3 == 0)
-            {
-                px[0] = 255;
-                px[1] = 0;
-                px[2] = 0;
-            }
-            else if (i % 3 == 1)
-            {
-                px[0] = 0;
-                px[1] = 255;
-                px[2] = 0;
-            }
-            else
-            {
-                px[0] = 0;
-                px[1] = 0;
-                px[2] = 255;
-            }
-        }
+        const uint8_t r = i % 3 == 0 ? 255 : 0;
+        const uint8_t g = i % 3 == 1 ? 255 : 0;
+        const uint8_t b = i % 3 == 2 ? 255 : 0;
+
+        for (uint32_t j = 0; j < PANEL_WIDTH; j++)
+            Format::set(frame_buffer, i * PANEL_WIDTH + j, r, g, b);
     }
 }
 
-int DotMatrixClient::writeText(ManagedString &s)
+int DotMatrixClient::enqueue(const TxRequest &request)
 {
     if (writeCharHandle_ == BLE_GATT_HANDLE_INVALID)
     {
-        uBit_.serial.printf("Characteristic not discovered yet!\r\n");
+        DOTMATRIX_LOG_WARN("Characteristic not discovered yet!");
         return DEVICE_INVALID_STATE;
     }
 
-    const uint16_t conn_handle = connectionHandle();
-    if (conn_handle == BLE_CONN_HANDLE_INVALID)
+    if (connectionHandle() == BLE_CONN_HANDLE_INVALID)
     {
-        uBit_.serial.printf("Not connected!\r\n");
+        DOTMATRIX_LOG_WARN("Not connected!");
         return DEVICE_INVALID_STATE;
     }
 
-    TextHeader *hdr = (TextHeader *)(display_buffer.pixel_data);
-    hdr->total_len = 0;
-    hdr->static_3 = 3;
-    hdr->static_0 = 0;
-    hdr->static_0_1 = 0;
-    hdr->packet_length = 0;
-    hdr->crc = 0;
-    hdr->static_0_2 = 0;
-    hdr->static_0_3 = 0;
-    hdr->static_12 = 12;
-
-    TextMetadata *pkt = (TextMetadata *)(display_buffer.pixel_data + sizeof(TextHeader));
-    pkt->number_of_characters = s.length();
-    pkt->static_0 = 0;
-    pkt->static_1 = 1;
-    pkt->text_mode = 1;
-    pkt->text_speed = 95;
-    pkt->text_color_mode = 1;
-    pkt->text_color_r = 255;
-    pkt->text_color_g = 0;
-    pkt->text_color_b = 0;
-    pkt->text_color_bg_mode = 0;
-    pkt->bg_color_r = 0;
-    pkt->bg_color_g = 0;
-    pkt->bg_color_b = 0;
-
-    const uint32_t max_bitmap_bytes = sizeof(display_buffer.pixel_data) - sizeof(TextHeader) - sizeof(TextMetadata);
-
-    uint8_t *write_ptr = pkt->character_bitmaps;
-    uint32_t character_bitmap_size = 0;
-
-    for (int i = 0; i < s.length(); i++)
-    {
-        char c = s.charAt(i);
-        uBit_.serial.printf("Processing character: %c\r\n", c);
-
-        uint32_t char_index = (uint8_t)c;
-
-        if (c >= 32 && c <= 126)
-            char_index -= 32;
-        else
-            char_index = 0;
+    // Back-pressure: wait for the transmit fiber rather than dropping writes.
+    while (!txQueue_.push(request))
+        fiber_sleep(1);
+
+    MicroBitEvent(DOTMATRIX_ID, DOTMATRIX_EVT_TX_QUEUED);
+    return DEVICE_OK;
+}
 
-        if (character_bitmap_size + SEPARATOR_LEN + BITMAP_SIZE > max_bitmap_bytes)
+void DotMatrixClient::txFiberEntry(void *param)
+{
+    static_cast<DotMatrixClient *>(param)->txLoop();
+}
+
+void DotMatrixClient::txLoop()
+{
+    while (true)
+    {
+        TxRequest request;
+        if (!txQueue_.pop(request))
         {
-            uBit_.serial.printf("Text too long for packet buffer; truncating.\r\n");
-            break;
+            // Nothing can be queued between the check and the wait, as fibers only
+            // switch when one yields.
+            fiber_wait_for_event(DOTMATRIX_ID, DOTMATRIX_EVT_TX_QUEUED);
+            continue;
         }
 
-        memcpy(write_ptr, separator, SEPARATOR_LEN);
-        write_ptr += SEPARATOR_LEN;
-        character_bitmap_size += SEPARATOR_LEN;
+        if (request.op == TxRequest::IMAGE)
+            imageQueued_ = false;
+        else if (request.op == TxRequest::SHADER)
+            shaderQueued_ = false;
 
-        memcpy(write_ptr, &font_data[char_index * BITMAP_SIZE], BITMAP_SIZE);
-        write_ptr += BITMAP_SIZE;
-        character_bitmap_size += BITMAP_SIZE;
-    }
+        txBusy_ = true;
 
-    size_t payload_size = sizeof(TextMetadata) + character_bitmap_size;
-    hdr->total_len = payload_size + sizeof(TextHeader);
-    hdr->packet_length = payload_size;
-    hdr->crc = calculateCrc32((uint8_t *)pkt, sizeof(TextMetadata) + character_bitmap_size);
+        // Work queued before a disconnect is dropped rather than sent to the next peer.
+        const int rc = isReady() ? transmit(request) : DEVICE_INVALID_STATE;
+        if (rc == DEVICE_OK)
+            link_stats.packetsSent++;
+        else
+            link_stats.packetsFailed++;
 
-    uint32_t dataSize = payload_size + sizeof(TextHeader);
-    uint8_t *dataPtr = (uint8_t *)display_buffer.pixel_data;
+        // Waiters for a text that never went out must not hang.
+        if (request.op == TxRequest::TEXT && rc != DEVICE_OK)
+            MicroBitEvent(DOTMATRIX_ID, DOTMATRIX_EVT_TEXT_COMPLETE);
 
-    uBit_.serial.printf("Starting image write of %d bytes\r\n", dataSize);
+        txBusy_ = false;
+    }
+}
 
-    const int rc = gattc_write_cmd_chunks(conn_handle,
-                                         writeCharHandle_,
-                                         chunkSize_,
-                                         dataPtr,
-                                         dataSize,
-                                         uBit_,
-                                         "Text");
-    if (rc != DEVICE_OK)
-        return rc;
+bool DotMatrixClient::isIdle() const
+{
+    return txQueue_.empty() && !txBusy_;
+}
 
-    uBit_.serial.printf("Image write complete\r\n");
-    return DEVICE_OK;
+void DotMatrixClient::waitForIdle()
+{
+    while (!isIdle())
+        fiber_sleep(1);
 }
 
-int DotMatrixClient::setImageModeDiy()
+int DotMatrixClient::transmit(const TxRequest &request)
 {
-    if (writeCharHandle_ == BLE_GATT_HANDLE_INVALID)
+    switch (request.op)
     {
-        uBit_.serial.printf("Characteristic not discovered yet!\r\n");
-        return DEVICE_INVALID_STATE;
-    }
+        case TxRequest::TEXT:
+            return sendText(request.text.characters, request.text.length);
 
-    const uint16_t conn_handle = connectionHandle();
-    if (conn_handle == BLE_CONN_HANDLE_INVALID)
-    {
-        uBit_.serial.printf("Not connected!\r\n");
-        return DEVICE_INVALID_STATE;
+        case TxRequest::IMAGE_MODE_DIY:
+        {
+            uint8_t mode_packet[DOTMATRIX_IMAGE_MODE_PACKET_SIZE];
+            const size_t mode_len = dotmatrix_encode_image_mode(mode_packet, true);
+            return sendRequest(mode_packet, mode_len, "Mode");
+        }
+
+        case TxRequest::PIXEL:
+        {
+            uint8_t rgb[3] = {request.pixel.r, request.pixel.g, request.pixel.b};
+            DotMatrixColourCorrection::apply(colour_.tables(), rgb, 1);
+
+            uint8_t set_pixel_buffer[DOTMATRIX_PIXEL_PACKET_SIZE];
+            dotmatrix_encode_pixel(set_pixel_buffer,
+                                   request.pixel.x,
+                                   request.pixel.y,
+                                   rgb[0],
+                                   rgb[1],
+                                   rgb[2]);
+            return sendRequest(set_pixel_buffer, sizeof(set_pixel_buffer), "Pixel");
+        }
+
+        case TxRequest::IMAGE:
+            return sendImage();
+
+        case TxRequest::SHADER:
+            return sendShader();
+
+        case TxRequest::SCORE:
+        {
+            uint8_t scoreboard[DOTMATRIX_SCORE_PACKET_SIZE];
+            dotmatrix_encode_score(scoreboard, request.score.score0, request.score.score1);
+            return sendRequest(scoreboard, sizeof(scoreboard), "Score");
+        }
+
+        default:
+            return DEVICE_INVALID_PARAMETER;
     }
+}
 
-    uBit_.serial.printf("Mode write queued\r\n");
-    return gattc_write_req_wait(conn_handle,
+int DotMatrixClient::sendRequest(const uint8_t *data, uint16_t length, const char *label)
+{
+    // Only one write request may be outstanding, so each waits for its response.
+    return gattc_write_req_wait(connectionHandle(),
                                 writeCharHandle_,
-                                (const uint8_t *)&IMAGE_MODE_DDIY_ENABLE,
-                                sizeof(IMAGE_MODE_DDIY_ENABLE),
-                                uBit_,
+                                data,
+                                length,
                                 writeInProgress_,
-                                "Mode");
+                                label);
 }
 
-int DotMatrixClient::writePixel(uint8_t x, uint8_t y, uint8_t r, uint8_t g, uint8_t b)
+int DotMatrixClient::sendText(const char *text, uint16_t characters)
 {
-    if (writeCharHandle_ == BLE_GATT_HANDLE_INVALID)
+    DOTMATRIX_TRACE_SCOPE(DOTMATRIX_TRACE_TEXT, characters);
+
+    uint8_t preamble[DOTMATRIX_TEXT_PREAMBLE_SIZE];
     {
-        uBit_.serial.printf("Characteristic not discovered yet!\r\n");
-        return DEVICE_INVALID_STATE;
+        DOTMATRIX_TRACE_SCOPE(DOTMATRIX_TRACE_TEXT_PREAMBLE, characters);
+        // r, g, b and bgR, bgG, bgB are each three consecutive bytes.
+        DotMatrixTextStyle style = textStyle_;
+        DotMatrixColourCorrection::apply(colour_.tables(), &style.r, 1);
+        DotMatrixColourCorrection::apply(colour_.tables(), &style.bgR, 1);
+        dotmatrix_encode_text_preamble(preamble, text, characters, style);
     }
 
-    const uint16_t conn_handle = connectionHandle();
-    if (conn_handle == BLE_CONN_HANDLE_INVALID)
+    DOTMATRIX_LOG_DEBUG("Starting text write of %d bytes",
+                        sizeof(preamble) + characters * (SEPARATOR_LEN + BITMAP_SIZE));
+
+    // Glyphs go out straight from the font in flash.
+    ChunkWriter writer(connectionHandle(), writeCharHandle_, chunkSize_, "Text");
+    int rc = writer.write(preamble, sizeof(preamble));
+    for (uint16_t i = 0; i < characters && rc == DEVICE_OK; i++)
     {
-        uBit_.serial.printf("Not connected!\r\n");
-        return DEVICE_INVALID_STATE;
+        rc = writer.write(separator, SEPARATOR_LEN);
+        if (rc == DEVICE_OK)
+            rc = writer.write(&font_data[glyph_index(text[i]) * BITMAP_SIZE], BITMAP_SIZE);
     }
+    if (rc == DEVICE_OK)
+        rc = writer.flush();
+    if (rc != DEVICE_OK)
+        return rc;
 
-    uint8_t set_pixel_buffer[] = {
-        10,
-        0,
-        5,
-        1,
-        0,
-        r,
-        g,
-        b,
-        x,
-        y,
-    };
-
-    return gattc_write_req_wait(conn_handle,
-                                writeCharHandle_,
-                                set_pixel_buffer,
-                                sizeof(set_pixel_buffer),
-                                uBit_,
-                                writeInProgress_,
-                                "Pixel");
+    // Replace any pending completion from a previous message, which the panel has now dropped.
+    system_timer_cancel_event(DOTMATRIX_ID, DOTMATRIX_EVT_TEXT_COMPLETE);
+    system_timer_event_after(textDuration(characters), DOTMATRIX_ID, DOTMATRIX_EVT_TEXT_COMPLETE);
+
+    DOTMATRIX_LOG_DEBUG("Text write complete");
+    return DEVICE_OK;
 }
 
-int DotMatrixClient::writeImage()
+int DotMatrixClient::sendImage()
 {
-    if (writeCharHandle_ == BLE_GATT_HANDLE_INVALID)
+    DOTMATRIX_TRACE_SCOPE(DOTMATRIX_TRACE_IMAGE, DotMatrixPanel::frameBytes);
+
     {
-        uBit_.serial.printf("Characteristic not discovered yet!\r\n");
-        return DEVICE_INVALID_STATE;
+        DOTMATRIX_TRACE_SCOPE(DOTMATRIX_TRACE_FRAME_COPY, sizeof(tx_frame));
+
+        // Fibers only switch when one yields, so the copy is a consistent frame.
+        memcpy(tx_frame, frame_buffer, sizeof(tx_frame));
     }
 
-    const uint16_t conn_handle = connectionHandle();
-    if (conn_handle == BLE_CONN_HANDLE_INVALID)
+    DOTMATRIX_LOG_DEBUG("Starting image write of %d bytes", DotMatrixPanel::frameBytes);
+
+    // Frames up to 32x32 fit one packet; larger panels take several.
+    ChunkWriter writer(connectionHandle(), writeCharHandle_, chunkSize_, "Image");
+    ImageWriter image(writer, DotMatrixPanel::frameBytes);
+
+    const uint8_t *tables = colour_.acquire();
+    const bool corrected = !colour_.isIdentity();
+
+    int rc = DEVICE_OK;
+    if (Format::wire && !corrected)
     {
-        uBit_.serial.printf("Not connected!\r\n");
-        return DEVICE_INVALID_STATE;
+        rc = image.write(tx_frame, sizeof(tx_frame));
+    }
+    else
+    {
+        // Narrower formats are widened, and colours corrected, a span at a time on the
+        // way out.
+        uint8_t rgb[SPAN_PIXELS * 3];
+        for (uint32_t first = 0; first < DotMatrixPanel::pixels && rc == DEVICE_OK;
+             first += SPAN_PIXELS)
+        {
+            const uint32_t count = min_u32(DotMatrixPanel::pixels - first, SPAN_PIXELS);
+            Format::expand(tx_frame, first, count, rgb);
+            if (corrected)
+                DotMatrixColourCorrection::apply(tables, rgb, count);
+            rc = image.write(rgb, count * 3);
+        }
+    }
+
+    if (rc == DEVICE_OK)
+        rc = writer.flush();
+    colour_.release();
+    if (rc != DEVICE_OK)
+        return rc;
+
+    DOTMATRIX_LOG_DEBUG("Image write complete");
+    return DEVICE_OK;
+}
+
+int DotMatrixClient::sendShader()
+{
+    DOTMATRIX_TRACE_SCOPE(DOTMATRIX_TRACE_IMAGE, DotMatrixPanel::frameBytes);
+
+    // Taken now, so a frame that waited in the queue still shows the present.
+    const DotMatrixShader shader = shader_;
+    const uint32_t t = (uint32_t)system_timer_current_time();
+    const uint8_t *tables = colour_.acquire();
+    const bool corrected = !colour_.isIdentity();
+
+    ChunkWriter writer(connectionHandle(), writeCharHandle_, chunkSize_, "Shader");
+    ImageWriter image(writer, DotMatrixPanel::frameBytes);
+
+    uint8_t rgb[SPAN_PIXELS * 3];
+    int rc = DEVICE_OK;
+    for (uint32_t y = 0; y < PANEL_HEIGHT && rc == DEVICE_OK; y++)
+    {
+        for (uint32_t x = 0; x < PANEL_WIDTH && rc == DEVICE_OK; x += SPAN_PIXELS)
+        {
+            const uint32_t count = min_u32(PANEL_WIDTH - x, SPAN_PIXELS);
+            if (shader.span)
+            {
+                shader.span(x, y, count, t, rgb, shader.context);
+            }
+            else
+            {
+                for (uint32_t i = 0; i < count; i++)
+                    shader.pixel(x + i, y, t, &rgb[i * 3], shader.context);
+            }
+            if (corrected)
+                DotMatrixColourCorrection::apply(tables, rgb, count);
+            rc = image.write(rgb, count * 3);
+        }
     }
 
-    const uint32_t pngSize = 32 * 32 * 3;
+    if (rc == DEVICE_OK)
+        rc = writer.flush();
+    colour_.release();
+    return rc;
+}
+
+int DotMatrixClient::writeText(ManagedString &s)
+{
+    TxRequest request;
+    request.op = TxRequest::TEXT;
+    request.text.length = min_int(s.length(), DOTMATRIX_TEXT_MAX_CHARACTERS);
+    memcpy(request.text.characters, s.toCharArray(), request.text.length);
+
+    if (request.text.length < s.length())
+        DOTMATRIX_LOG_WARN("Text too long for one message; truncating.");
 
-    display_buffer.packet_length = pngSize + HEADER_SIZE;
-    display_buffer.command = 0;
-    display_buffer.subcommand = 0;
-    display_buffer.first_or_continuation = 0;
-    display_buffer.image_data_length = pngSize;
+    return enqueue(request);
+}
 
-    uint32_t dataSize = display_buffer.packet_length;
-    uint8_t *pngPtr = (uint8_t *)&display_buffer;
+int DotMatrixClient::setImageModeDiy()
+{
+    TxRequest request;
+    request.op = TxRequest::IMAGE_MODE_DIY;
+    return enqueue(request);
+}
 
-    uBit_.serial.printf("Starting image write of %d bytes\r\n", pngSize + HEADER_SIZE);
+int DotMatrixClient::writePixel(uint8_t x, uint8_t y, uint8_t r, uint8_t g, uint8_t b)
+{
+    TxRequest request;
+    request.op = TxRequest::PIXEL;
+    request.pixel = {x, y, r, g, b};
+    return enqueue(request);
+}
+
+int DotMatrixClient::writeImage()
+{
+    if (!HAVE_FRAMEBUFFER)
+        return DEVICE_NOT_SUPPORTED;
+
+    // The queued frame is copied when it is sent, so it already carries these changes.
+    if (imageQueued_ && isReady())
+    {
+        clearDirty();
+        return DEVICE_OK;
+    }
 
-    const int rc = gattc_write_cmd_chunks(conn_handle,
-                                         writeCharHandle_,
-                                         chunkSize_,
-                                         pngPtr,
-                                         dataSize,
-                                         uBit_,
-                                         "Image");
+    TxRequest request;
+    request.op = TxRequest::IMAGE;
+    const int rc = enqueue(request);
     if (rc != DEVICE_OK)
         return rc;
 
-    uBit_.serial.printf("Image write complete\r\n");
+    imageQueued_ = true;
+    clearDirty();
     return DEVICE_OK;
 }
 
-int DotMatrixClient::writeScore(uint32_t score0, uint32_t score1)
+int DotMatrixClient::writeDirty()
 {
-    if (writeCharHandle_ == BLE_GATT_HANDLE_INVALID)
+    if (!HAVE_FRAMEBUFFER)
+        return DEVICE_NOT_SUPPORTED;
+
+    if (dirty_.isEmpty())
+        return DEVICE_OK;
+
+    // Scattered single pixels go out as they are, without the rest of their rectangle.
+    if (!dirtyPixelOverflow_)
     {
-        uBit_.serial.printf("Characteristic not discovered yet!\r\n");
-        return DEVICE_INVALID_STATE;
+        for (uint32_t i = 0; i < dirtyPixelCount_; i++)
+        {
+            uint8_t px[3];
+            getPixel(dirtyPixels_[i].x, dirtyPixels_[i].y, px);
+            const int rc = writePixel(dirtyPixels_[i].x, dirtyPixels_[i].y, px[0], px[1], px[2]);
+            if (rc != DEVICE_OK)
+                return rc;
+        }
+
+        clearDirty();
+        return DEVICE_OK;
     }
 
-    const uint16_t conn_handle = connectionHandle();
-    if (conn_handle == BLE_CONN_HANDLE_INVALID)
+    const DotMatrixRect region = dirty_;
+    const uint32_t pixels = (region.x1 - region.x0) * (region.y1 - region.y0);
+    if (pixels > DOTMATRIX_DIRTY_PIXEL_LIMIT)
+        return writeImage();
+
+    for (int y = region.y0; y < region.y1; y++)
     {
-        uBit_.serial.printf("Not connected!\r\n");
-        return DEVICE_INVALID_STATE;
+        for (int x = region.x0; x < region.x1; x++)
+        {
+            uint8_t px[3];
+            Format::get(frame_buffer, y * PANEL_WIDTH + x, px);
+            const int rc = writePixel(x, y, px[0], px[1], px[2]);
+            if (rc != DEVICE_OK)
+                return rc;
+        }
     }
 
-    ScoreboardPacket scoreboard = {
-        8,
-        0,
-        10,
-        128,
-        score0 & 0xFFFF,
-        score1 & 0xFFFF,
-    };
+    clearDirty();
+    return DEVICE_OK;
+}
 
-    int rc = gattc_write_req(conn_handle, writeCharHandle_, (const uint8_t *)&scoreboard, sizeof(scoreboard), uBit_, "Score");
-    if (rc == DEVICE_OK)
-        uBit_.serial.printf("Write queued\r\n");
-    return rc;
+void DotMatrixClient::clearDirty()
+{
+    dirty_ = {0, 0, 0, 0};
+    dirtyPixelCount_ = 0;
+    dirtyPixelOverflow_ = false;
+}
+
+int DotMatrixClient::writeImage(DotMatrixSpanShader shader, void *context)
+{
+    return queueShader({shader, nullptr, context});
+}
+
+int DotMatrixClient::writeImage(DotMatrixPixelShader shader, void *context)
+{
+    return queueShader({nullptr, shader, context});
+}
+
+int DotMatrixClient::queueShader(const DotMatrixShader &shader)
+{
+    if (!shader.span && !shader.pixel)
+        return DEVICE_INVALID_PARAMETER;
+
+    shader_ = shader;
+    if (shaderQueued_ && isReady())
+        return DEVICE_OK;
+
+    TxRequest request;
+    request.op = TxRequest::SHADER;
+    const int rc = enqueue(request);
+    if (rc != DEVICE_OK)
+        return rc;
+
+    shaderQueued_ = true;
+    return DEVICE_OK;
+}
+
+int DotMatrixClient::writeScore(uint32_t score0, uint32_t score1)
+{
+    TxRequest request;
+    request.op = TxRequest::SCORE;
+    request.score = {(uint16_t)(score0 & 0xFFFF), (uint16_t)(score1 & 0xFFFF)};
+    return enqueue(request);
 }
@@ -4,6 +4,101 @@
 
 #include "nrf.h"
 
+#include "DotMatrixColour.h"
+#include "DotMatrixConfig.h"
+#include "DotMatrixProtocol.h"
+#include "DotMatrixShader.h"
+#include "SpscRing.h"
+
+// Message bus ID used for events raised by DotMatrixClient.
+#ifndef DOTMATRIX_ID
+#define DOTMATRIX_ID 9500
+#endif
+
+// Raised when a text message sent by writeText() has finished scrolling.
+#define DOTMATRIX_EVT_TEXT_COMPLETE 1
+
+// Wakes the transmit fiber when work is queued.
+#define DOTMATRIX_EVT_TX_QUEUED 2
+
+// Wakes the GATT client event fiber when the SoftDevice observer has queued events.
+#define DOTMATRIX_EVT_GATTC 3
+
+// Raised by DotMatrixFrameScheduler at the start of each frame slot. Each scheduler adds
+// its own number, so values from here up belong to schedulers (see frameEvent()).
+#define DOTMATRIX_EVT_FRAME 4
+
+// Set to 0 to handle GATT client events inside the SoftDevice observer, as before
+// they were handed off to a fiber; observerTiming() then shows the difference.
+#ifndef DOTMATRIX_DEFERRED_GATTC_EVENTS
+#define DOTMATRIX_DEFERRED_GATTC_EVENTS 1
+#endif
+
+// Longest text a single writeText() sends; the rest is dropped.
+#define DOTMATRIX_TEXT_MAX_CHARACTERS 44
+
+// Writes that can wait for the transmit fiber before producers block.
+#define DOTMATRIX_TX_QUEUE_SIZE 16
+
+// Each pixel write costs a full write round trip, while a whole frame is only a dozen
+// MTU-sized write commands, so writeDirty() sends at most this many pixels one by one.
+#define DOTMATRIX_DIRTY_PIXEL_LIMIT 8
+
+// Pixel rectangle on the panel; x1 and y1 are exclusive.
+struct DotMatrixRect
+{
+    int16_t x0;
+    int16_t y0;
+    int16_t x1;
+    int16_t y1;
+
+    bool isEmpty() const { return x1 <= x0 || y1 <= y0; }
+};
+
+// Time spent in the SoftDevice observer for the events DotMatrixClient handles.
+struct DotMatrixObserverTiming
+{
+    uint32_t events;
+    uint32_t totalCycles;
+    uint32_t maxCycles;
+    // Events lost because the handoff queue was full.
+    uint32_t dropped;
+};
+
+// Write-response round trips are counted in power-of-two millisecond buckets:
+// < 1, < 2, < 4 ... ms, with the last bucket holding everything slower.
+#define DOTMATRIX_WRITE_RSP_BUCKETS 8
+
+// Link health since the last resetStats().
+struct DotMatrixStats
+{
+    uint32_t elapsedMs;
+    // ATT payload bytes and write operations accepted by the SoftDevice.
+    uint32_t bytesSent;
+    uint32_t writesSent;
+    // Protocol packets (text, image, pixel, ...) sent completely, and those that failed.
+    uint32_t packetsSent;
+    uint32_t packetsFailed;
+    uint32_t averageBytesPerSecond;
+    // Best rate over any one second window.
+    uint32_t peakBytesPerSecond;
+    // Waits for the SoftDevice to free TX buffers (NRF_ERROR_RESOURCES).
+    uint32_t stalls;
+    uint32_t stallTimeUs;
+    uint32_t connections;
+    uint16_t mtu;
+    uint16_t chunkSize;
+    uint32_t writeRspHistogram[DOTMATRIX_WRITE_RSP_BUCKETS];
+};
+
+enum DotMatrixScrollDirection : uint8_t
+{
+    DOTMATRIX_SCROLL_LEFT,
+    DOTMATRIX_SCROLL_RIGHT,
+    DOTMATRIX_SCROLL_UP,
+    DOTMATRIX_SCROLL_DOWN,
+};
+
 class DotMatrixClient
 {
 public:
@@ -24,13 +119,82 @@ public:
 
     void setPixel(uint8_t x, uint8_t y, uint8_t r, uint8_t g, uint8_t b);
 
-    // Protocol helpers.
+    // Like setPixel(), but a pixel that already holds the colour, as stored, is left out
+    // of the dirty region. Returns true when the pixel changed.
+    bool updatePixel(uint8_t x, uint8_t y, uint8_t r, uint8_t g, uint8_t b);
+
+    // The stored colour at (x, y), as it will be sent; black off the panel.
+    void getPixel(uint8_t x, uint8_t y, uint8_t *rgb) const;
+
+    // Copies `count` RGB888 pixels in row-major order starting at (x, y), wrapping onto
+    // the following rows. Pixels past the end of the panel are dropped.
+    void setPixels(uint8_t x, uint8_t y, const uint8_t *rgb, uint32_t count);
+
+    // Draws `text` into the framebuffer with proportional spacing, top-left at (x, y).
+    // Glyphs are clipped to the panel. Returns the pen position after the last glyph.
+    int drawText(int x, int y, ManagedString &text, uint8_t r, uint8_t g, uint8_t b);
+
+    // Width in pixels that drawText() advances for `text`.
+    int textWidth(ManagedString &text) const;
+
+    // Moves the framebuffer, or the part of it inside `area`, `amount` pixels towards
+    // `direction` with a block move per row. With `wrap`, pixels leaving one edge come
+    // back in at the other; otherwise the strip uncovered is filled with `fill` and
+    // returned, for the caller to draw new content into. The panel has no scroll command,
+    // so the whole area is marked dirty.
+    DotMatrixRect scroll(DotMatrixScrollDirection direction, uint8_t amount, bool wrap = false,
+                         const DotMatrixColour &fill = DotMatrixColour());
+    DotMatrixRect scroll(const DotMatrixRect &area, DotMatrixScrollDirection direction,
+                         uint8_t amount, bool wrap = false,
+                         const DotMatrixColour &fill = DotMatrixColour());
+
+    // Grows the region that writeDirty() will send. Drawing calls do this themselves.
+    void markDirty(int x, int y, int w, int h);
+
+    bool isDirty() const;
+
+    // Scroll speed sent with the next writeText().
+    void setTextSpeed(uint8_t speed);
+
+    // Expected on-screen time in ms of a marquee of `characters` glyphs.
+    uint32_t textDuration(uint16_t characters) const;
+
+    // Output correction, applied to colours as they are sent while the framebuffer keeps
+    // what was drawn. Changes apply from the next write, so follow with writeImage().
+    void setBrightness(uint8_t level);
+    uint8_t brightness() const;
+    void setWhiteBalance(uint8_t r, uint8_t g, uint8_t b);
+
+    // Protocol helpers. These queue the write for the transmit fiber, which owns the
+    // BLE link, and return once it is queued. A full queue blocks the caller until
+    // there is room.
     int writeText(ManagedString &text);
     int setImageModeDiy();
     int writePixel(uint8_t x, uint8_t y, uint8_t r, uint8_t g, uint8_t b);
+    // Sends the framebuffer as it is when the transmit fiber gets to it, so a frame
+    // still waiting in the queue is not queued twice.
     int writeImage();
+    // Sends a frame computed by `shader` as it is emitted, without the framebuffer. A
+    // shader frame still waiting in the queue is switched to the new shader.
+    int writeImage(DotMatrixSpanShader shader, void *context = nullptr);
+    int writeImage(DotMatrixPixelShader shader, void *context = nullptr);
+    // Sends only what changed since the last write: single pixels for small regions,
+    // otherwise a full image.
+    int writeDirty();
     int writeScore(uint32_t score0, uint32_t score1);
 
+    // True when nothing is queued or being sent.
+    bool isIdle() const;
+
+    // Blocks until everything queued so far has been handed to the SoftDevice.
+    void waitForIdle();
+
+    // CPU cycles spent in the SoftDevice observer since boot.
+    DotMatrixObserverTiming observerTiming() const;
+
+    DotMatrixStats stats() const;
+    void resetStats();
+
 private:
     MicroBit &uBit_;
 
@@ -40,18 +204,99 @@ private:
     bool discoveryInProgress_;
     volatile bool writeInProgress_;
 
+    uint16_t mtu_;
     uint32_t chunkSize_;
     uint16_t writeCharHandle_;
 
+    DotMatrixTextStyle textStyle_;
+
+    DotMatrixRect dirty_;
+    // Single pixels marked since the last write, while there are few enough to send one
+    // by one; a larger mark overflows the list and leaves only the rectangle.
+    struct
+    {
+        uint8_t x, y;
+    } dirtyPixels_[DOTMATRIX_DIRTY_PIXEL_LIMIT];
+    uint8_t dirtyPixelCount_;
+    bool dirtyPixelOverflow_;
+    DotMatrixColourCorrection colour_;
+
+    struct TxRequest
+    {
+        enum Op : uint8_t
+        {
+            TEXT,
+            IMAGE_MODE_DIY,
+            PIXEL,
+            IMAGE,
+            SCORE,
+            SHADER,
+        };
+
+        uint8_t op;
+        union
+        {
+            struct
+            {
+                uint8_t x, y, r, g, b;
+            } pixel;
+            struct
+            {
+                uint16_t score0, score1;
+            } score;
+            struct
+            {
+                uint8_t length;
+                char characters[DOTMATRIX_TEXT_MAX_CHARACTERS];
+            } text;
+        };
+    };
+
+    SpscRing<TxRequest, DOTMATRIX_TX_QUEUE_SIZE> txQueue_;
+    bool fibersStarted_;
+    volatile bool txBusy_;
+    volatile bool imageQueued_;
+    volatile bool shaderQueued_;
+    // Read when the shader frame is sent, so it is always the latest one.
+    DotMatrixShader shader_;
+
+    // What the observer keeps of a GATT client event.
+    struct GattcEvent
+    {
+        uint16_t id;
+        // Characteristics found, or the peer's MTU.
+        uint16_t value;
+        // The write characteristic, when a discovery response contains it.
+        uint16_t handle;
+    };
+
+    SpscRing<GattcEvent, 8> gattcEvents_;
+    DotMatrixObserverTiming observerTiming_;
+
     void discoverWriteCharacteristic();
     void requestMtuExchange();
 
     uint16_t connectionHandle() const;
 
-    static uint32_t calculateCrc32(const uint8_t *data, size_t length);
+    int enqueue(const TxRequest &request);
+    void clearDirty();
+
+    static void txFiberEntry(void *param);
+    void txLoop();
+    int transmit(const TxRequest &request);
+    int sendText(const char *text, uint16_t characters);
+    int sendImage();
+    int queueShader(const DotMatrixShader &shader);
+    int sendShader();
+    int sendRequest(const uint8_t *data, uint16_t length, const char *label);
+
+    // Hooked by a global NRF observer in DotMatrix.cpp. Runs in interrupt context.
+    void onBleEvent(ble_evt_t const *pBleEvt);
+    bool decodeGattcEvent(ble_evt_t const *pBleEvt, GattcEvent &event) const;
 
-    // Hooked by a global NRF observer in DotMatrix.cpp.
-    void handleGattcEvent(ble_evt_t const *pBleEvt);
+    static void gattcFiberEntry(void *param);
+    void gattcLoop();
+    void handleGattcEvent(const GattcEvent &event);
 
     friend void dotmatrix_gattc_event_handler(ble_evt_t const *p_ble_evt, void *p_context);
 };
@@ -0,0 +1,486 @@
+#include "DotMatrixAssets.h"
+#include "DotMatrixLog.h"
+#include "DotMatrixProtocol.h"
+
+#include <string.h>
+
+// From the linker script: the end of code, and the initialised data copied after it.
+extern "C" uint32_t __etext;
+extern "C" uint32_t __data_start__;
+extern "C" uint32_t __data_end__;
+
+namespace
+{
+constexpr uint32_t ERASED = 0xFFFFFFFF;
+constexpr uint32_t REGION_HEADER_SIZE = 8;
+
+// Words staged in RAM per flash write.
+constexpr uint32_t PROGRAM_WORDS = 16;
+
+static inline uint32_t align4(uint32_t n)
+{
+    return (n + 3) & ~3u;
+}
+
+static inline uint32_t load32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t record_size(const DotMatrixAssetRecord &header)
+{
+    return sizeof(DotMatrixAssetRecord) + align4(header.nameLength) + align4(header.length);
+}
+
+static uint32_t program_end()
+{
+    const uintptr_t data = (uintptr_t)&__data_end__ - (uintptr_t)&__data_start__;
+    return (uintptr_t)&__etext + data;
+}
+} // namespace
+
+uint32_t dotmatrix_asset_hash(const char *name, uint32_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < length; i++)
+    {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+DotMatrixAssetStore::DotMatrixAssetStore(uint32_t start, uint32_t size)
+    : flash_(start, size / DOTMATRIX_ASSET_PAGE_SIZE, DOTMATRIX_ASSET_PAGE_SIZE)
+    , start_(start)
+    , size_(size)
+    , mounted_(false)
+    , end_(REGION_HEADER_SIZE)
+    , count_(0)
+    , skipped_(0)
+{
+}
+
+const DotMatrixAssetRecord *DotMatrixAssetStore::record(uint32_t offset) const
+{
+    return reinterpret_cast<const DotMatrixAssetRecord *>(start_ + offset);
+}
+
+int DotMatrixAssetStore::mount()
+{
+    mounted_ = false;
+    count_ = 0;
+    skipped_ = 0;
+
+    if (start_ < program_end() || start_ % DOTMATRIX_ASSET_PAGE_SIZE != 0)
+    {
+        DOTMATRIX_LOG_ERROR("Asset region overlaps the program or is not page aligned");
+        return DEVICE_INVALID_STATE;
+    }
+
+    const uint32_t *region = reinterpret_cast<const uint32_t *>(start_);
+    if (region[0] != DOTMATRIX_ASSET_REGION_MAGIC && region[0] != ERASED)
+    {
+        DOTMATRIX_LOG_ERROR("Asset region holds something else; erase it first");
+        return DEVICE_INVALID_STATE;
+    }
+
+    // Records are walked in order. Anything that is not a whole record with a good CRC,
+    // such as one cut short by a reset, is stepped over a word at a time.
+    uint32_t offset = REGION_HEADER_SIZE;
+    uint32_t walked = REGION_HEADER_SIZE;
+    while (offset + sizeof(DotMatrixAssetRecord) <= size_)
+    {
+        const DotMatrixAssetRecord &header = *record(offset);
+        if (header.tag != DOTMATRIX_ASSET_TAG || header.length > size_ ||
+            offset + record_size(header) > size_)
+        {
+            offset += 4;
+            continue;
+        }
+
+        const uint8_t *name = reinterpret_cast<const uint8_t *>(&header + 1);
+        uint32_t crc = dotmatrix_crc32_update(DOTMATRIX_CRC32_INIT, name, header.nameLength);
+        crc = ~dotmatrix_crc32_update(crc, name + align4(header.nameLength), header.length);
+        if (crc != header.crc)
+        {
+            skipped_++;
+            offset += 4;
+            continue;
+        }
+
+        indexRecord(offset);
+        offset += record_size(header);
+        walked = offset;
+    }
+
+    // New records go after the last programmed word, past any half-written one. A record
+    // can end in words of 0xFF, such as white pixels and padding, which look erased, so
+    // never before the end of the last whole record either.
+    end_ = size_;
+    while (end_ > REGION_HEADER_SIZE && region[end_ / 4 - 1] == ERASED)
+        end_ -= 4;
+    if (end_ < walked)
+        end_ = walked;
+
+    mounted_ = true;
+    DOTMATRIX_LOG_INFO("Assets: %d, %d bytes free", (int)count_, (int)freeBytes());
+    return DEVICE_OK;
+}
+
+void DotMatrixAssetStore::indexRecord(uint32_t offset)
+{
+    const DotMatrixAssetRecord &header = *record(offset);
+    const char *name = reinterpret_cast<const char *>(&header + 1);
+    const int existing = lookup(name, header.nameLength);
+
+    if (header.flags & DOTMATRIX_ASSET_FLAG_DELETED)
+    {
+        if (existing < 0)
+            return;
+
+        count_--;
+        memmove(&index_[existing], &index_[existing + 1],
+                (count_ - existing) * sizeof(index_[0]));
+        return;
+    }
+
+    if (existing >= 0)
+        index_[existing] = offset;
+    else if (count_ < DOTMATRIX_ASSET_MAX)
+        index_[count_++] = offset;
+    else
+        skipped_++;
+}
+
+int DotMatrixAssetStore::lookup(const char *name, uint32_t length) const
+{
+    const uint32_t hash = dotmatrix_asset_hash(name, length);
+    for (uint32_t i = 0; i < count_; i++)
+    {
+        const DotMatrixAssetRecord &header = *record(index_[i]);
+        if (header.hash == hash && header.nameLength == length &&
+            memcmp(&header + 1, name, length) == 0)
+            return i;
+    }
+    return -1;
+}
+
+void DotMatrixAssetStore::describe(uint32_t offset, DotMatrixAsset &asset) const
+{
+    const DotMatrixAssetRecord &header = *record(offset);
+    const uint8_t *name = reinterpret_cast<const uint8_t *>(&header + 1);
+
+    asset.name = reinterpret_cast<const char *>(name);
+    asset.nameLength = header.nameLength;
+    asset.format = (DotMatrixAssetFormat)header.format;
+    asset.compressed = header.flags & DOTMATRIX_ASSET_FLAG_COMPRESSED;
+    asset.data = name + align4(header.nameLength);
+    asset.length = header.length;
+    asset.rawLength = header.rawLength;
+    asset.frameMs = header.frameMs;
+    asset.frames = header.frames;
+}
+
+int DotMatrixAssetStore::find(const char *name, DotMatrixAsset &asset) const
+{
+    const int i = mounted_ ? lookup(name, strlen(name)) : -1;
+    if (i < 0)
+        return DEVICE_NO_DATA;
+
+    describe(index_[i], asset);
+    return DEVICE_OK;
+}
+
+uint32_t DotMatrixAssetStore::count() const
+{
+    return count_;
+}
+
+int DotMatrixAssetStore::get(uint32_t index, DotMatrixAsset &asset) const
+{
+    if (index >= count_)
+        return DEVICE_INVALID_PARAMETER;
+
+    describe(index_[index], asset);
+    return DEVICE_OK;
+}
+
+int DotMatrixAssetStore::program(uint32_t offset, const void *data, uint32_t length)
+{
+    // Staged through an aligned buffer. A partial last word is padded with 0xFF, which
+    // leaves those bytes erased.
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    uint32_t words[PROGRAM_WORDS];
+
+    while (length > 0)
+    {
+        const uint32_t n = length < sizeof(words) ? length : sizeof(words);
+        memset(words, 0xFF, sizeof(words));
+        memcpy(words, bytes, n);
+
+        const int rc = flash_.write(start_ + offset, words, align4(n) / 4);
+        if (rc != DEVICE_OK)
+            return rc;
+
+        offset += align4(n);
+        bytes += n;
+        length -= n;
+    }
+
+    return DEVICE_OK;
+}
+
+int DotMatrixAssetStore::writeRecord(const DotMatrixAssetRecord &header, const char *name,
+                                     const uint8_t *data)
+{
+    if (end_ + record_size(header) > size_)
+        return DEVICE_NO_RESOURCES;
+
+    if (*reinterpret_cast<const uint32_t *>(start_) == ERASED)
+    {
+        const uint32_t region[2] = {DOTMATRIX_ASSET_REGION_MAGIC, size_};
+        const int rc = program(0, region, sizeof(region));
+        if (rc != DEVICE_OK)
+            return rc;
+    }
+
+    // The tag goes last, so a record cut short by a reset is never taken for a whole one.
+    const uint32_t offset = end_;
+    const uint32_t nameOffset = offset + sizeof(header);
+    int rc = program(offset + 4, reinterpret_cast<const uint8_t *>(&header) + 4,
+                     sizeof(header) - 4);
+    if (rc == DEVICE_OK)
+        rc = program(nameOffset, name, header.nameLength);
+    if (rc == DEVICE_OK && header.length)
+        rc = program(nameOffset + align4(header.nameLength), data, header.length);
+    if (rc == DEVICE_OK)
+        rc = program(offset, &header.tag, 4);
+
+    // Even a failed record has used the space.
+    end_ += record_size(header);
+    if (rc != DEVICE_OK)
+        return rc;
+
+    indexRecord(offset);
+    return DEVICE_OK;
+}
+
+int DotMatrixAssetStore::append(const char *name, DotMatrixAssetFormat format,
+                                const uint8_t *data, uint32_t length, uint16_t frameMs,
+                                uint16_t frames)
+{
+    const uint32_t nameLength = strlen(name);
+    if (!mounted_)
+        return DEVICE_INVALID_STATE;
+    if (nameLength == 0 || nameLength > DOTMATRIX_ASSET_NAME_MAX)
+        return DEVICE_INVALID_PARAMETER;
+    if (count_ == DOTMATRIX_ASSET_MAX && lookup(name, nameLength) < 0)
+        return DEVICE_NO_RESOURCES;
+
+    DotMatrixAssetRecord header;
+    header.tag = DOTMATRIX_ASSET_TAG;
+    header.hash = dotmatrix_asset_hash(name, nameLength);
+    header.length = length;
+    header.rawLength = length;
+    header.format = format;
+    header.flags = 0;
+    header.nameLength = nameLength;
+    header.reserved = 0xFF;
+    header.frameMs = frameMs;
+    header.frames = frames;
+
+    uint32_t crc = dotmatrix_crc32_update(DOTMATRIX_CRC32_INIT, (const uint8_t *)name, nameLength);
+    header.crc = ~dotmatrix_crc32_update(crc, data, length);
+
+    return writeRecord(header, name, data);
+}
+
+int DotMatrixAssetStore::remove(const char *name)
+{
+    const uint32_t nameLength = strlen(name);
+    if (!mounted_)
+        return DEVICE_INVALID_STATE;
+    if (lookup(name, nameLength) < 0)
+        return DEVICE_NO_DATA;
+
+    DotMatrixAssetRecord header;
+    memset(&header, 0, sizeof(header));
+    header.tag = DOTMATRIX_ASSET_TAG;
+    header.hash = dotmatrix_asset_hash(name, nameLength);
+    header.flags = DOTMATRIX_ASSET_FLAG_DELETED;
+    header.nameLength = nameLength;
+    header.reserved = 0xFF;
+    header.crc = ~dotmatrix_crc32_update(DOTMATRIX_CRC32_INIT, (const uint8_t *)name, nameLength);
+
+    return writeRecord(header, name, nullptr);
+}
+
+int DotMatrixAssetStore::erase()
+{
+    if (start_ < program_end())
+        return DEVICE_INVALID_STATE;
+
+    for (uint32_t page = 0; page < size_; page += DOTMATRIX_ASSET_PAGE_SIZE)
+    {
+        const int rc = flash_.erase(start_ + page);
+        if (rc != DEVICE_OK)
+            return rc;
+    }
+
+    count_ = 0;
+    skipped_ = 0;
+    end_ = REGION_HEADER_SIZE;
+    mounted_ = true;
+    return DEVICE_OK;
+}
+
+uint32_t DotMatrixAssetStore::usedBytes() const
+{
+    return end_;
+}
+
+uint32_t DotMatrixAssetStore::freeBytes() const
+{
+    return size_ - end_;
+}
+
+uint32_t DotMatrixAssetStore::skipped() const
+{
+    return skipped_;
+}
+
+DotMatrixAssetStream::DotMatrixAssetStream()
+    : data_(nullptr)
+    , length_(0)
+    , position_(0)
+    , compressed_(false)
+    , produced_(0)
+    , literals_(0)
+    , matchRemaining_(0)
+    , distance_(0)
+{
+}
+
+int DotMatrixAssetStream::open(const DotMatrixAsset &asset, uint16_t frame)
+{
+    if (asset.format != DOTMATRIX_ASSET_IMAGE && asset.format != DOTMATRIX_ASSET_ANIMATION)
+        return DEVICE_INVALID_PARAMETER;
+
+    // Built for another panel size.
+    const uint32_t frames = asset.frames ? asset.frames : 1;
+    if (frame >= frames || asset.rawLength != frames * DotMatrixPanel::frameBytes)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (!asset.compressed)
+    {
+        data_ = asset.data + frame * DotMatrixPanel::frameBytes;
+        length_ = DotMatrixPanel::frameBytes;
+    }
+    else
+    {
+        // Each frame is compressed on its own, after a table of where each one starts.
+        const uint32_t table = frames * 4;
+        if (asset.length < table)
+            return DEVICE_INVALID_PARAMETER;
+
+        const uint32_t begin = load32(asset.data + frame * 4);
+        const uint32_t end =
+            frame + 1u < frames ? load32(asset.data + (frame + 1) * 4) : asset.length - table;
+        if (begin > end || end > asset.length - table)
+            return DEVICE_INVALID_PARAMETER;
+
+        data_ = asset.data + table + begin;
+        length_ = end - begin;
+    }
+
+    compressed_ = asset.compressed;
+    rewind();
+    return DEVICE_OK;
+}
+
+void DotMatrixAssetStream::rewind()
+{
+    position_ = 0;
+    produced_ = 0;
+    literals_ = 0;
+    matchRemaining_ = 0;
+}
+
+uint32_t DotMatrixAssetStream::read(uint8_t *out, uint32_t length)
+{
+    if (!compressed_)
+    {
+        const uint32_t n = length < length_ - position_ ? length : length_ - position_;
+        memcpy(out, data_ + position_, n);
+        position_ += n;
+        return n;
+    }
+
+    // Tokens: 0x00-0x7F is a run of token + 1 literal bytes; 0x80-0xFF copies
+    // (token & 0x7F) + 3 bytes from `next byte + 1` back in the output.
+    uint32_t n = 0;
+    while (n < length)
+    {
+        uint8_t byte;
+        if (literals_)
+        {
+            if (position_ >= length_)
+                break;
+            byte = data_[position_++];
+            literals_--;
+        }
+        else if (matchRemaining_)
+        {
+            byte = window_[(produced_ - distance_) & 0xFF];
+            matchRemaining_--;
+        }
+        else
+        {
+            if (position_ >= length_)
+                break;
+
+            const uint8_t token = data_[position_++];
+            if (token < 0x80)
+            {
+                literals_ = token + 1;
+            }
+            else
+            {
+                if (position_ >= length_)
+                    break;
+                matchRemaining_ = (token & 0x7F) + 3;
+                distance_ = data_[position_++] + 1;
+            }
+            continue;
+        }
+
+        window_[produced_ & 0xFF] = byte;
+        produced_++;
+        out[n++] = byte;
+    }
+
+    return n;
+}
+
+void DotMatrixAssetStream::span(uint32_t x, uint32_t y, uint32_t count, uint32_t,
+                                uint8_t *rgb, void *context)
+{
+    DotMatrixAssetStream &stream = *static_cast<DotMatrixAssetStream *>(context);
+    if (x == 0 && y == 0)
+        stream.rewind();
+
+    // A short frame ends in black rather than stale bytes.
+    const uint32_t n = stream.read(rgb, count * 3);
+    memset(rgb + n, 0, count * 3 - n);
+}
+
+int DotMatrixAssetStream::show(DotMatrixClient &panel)
+{
+    if (data_ == nullptr)
+        return DEVICE_INVALID_STATE;
+
+    return panel.writeImage(span, this);
+}
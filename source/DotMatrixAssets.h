@@ -0,0 +1,176 @@
+#pragma once
+
+#include "DotMatrix.h"
+#include "NRF52FlashManager.h"
+
+// Images, animations and text kept in a region of internal flash, built on the host with
+// asset_pack.py or appended on the device. The region is a log of records, each
+//
+//   [DotMatrixAssetRecord][name, padded to 4][payload, padded to 4]
+//
+// after an 8-byte region header. Erased flash ends the log. A later record with the
+// same name replaces an earlier one, and a record flagged DELETED removes it; space is
+// only reclaimed by erase(). Flash is memory mapped, so assets are read where they are.
+
+// Override both in the `config` section of codal.json. The region must be erased pages
+// above the program: mount() refuses one that overlaps it.
+#ifndef DOTMATRIX_ASSET_FLASH_START
+#define DOTMATRIX_ASSET_FLASH_START 0x6C000
+#endif
+
+#ifndef DOTMATRIX_ASSET_FLASH_SIZE
+#define DOTMATRIX_ASSET_FLASH_SIZE 0x8000
+#endif
+
+#define DOTMATRIX_ASSET_PAGE_SIZE 4096
+
+// Assets the index can hold.
+#define DOTMATRIX_ASSET_MAX 32
+#define DOTMATRIX_ASSET_NAME_MAX 31
+
+// "DMA1" at the start of the region, and "ASET" at the start of each record.
+#define DOTMATRIX_ASSET_REGION_MAGIC 0x31414D44
+#define DOTMATRIX_ASSET_TAG 0x54455341
+
+#define DOTMATRIX_ASSET_FLAG_COMPRESSED 0x01
+#define DOTMATRIX_ASSET_FLAG_DELETED 0x02
+
+enum DotMatrixAssetFormat : uint8_t
+{
+    // Opaque bytes.
+    DOTMATRIX_ASSET_RAW,
+    // One RGB888 frame at the panel size.
+    DOTMATRIX_ASSET_IMAGE,
+    // `frames` RGB888 frames at the panel size, shown `frameMs` apart and looped.
+    DOTMATRIX_ASSET_ANIMATION,
+    // Characters for DotMatrixClient::writeText().
+    DOTMATRIX_ASSET_TEXT,
+};
+
+struct DotMatrixAssetRecord
+{
+    uint32_t tag;
+    // dotmatrix_asset_hash() of the name.
+    uint32_t hash;
+    // Payload bytes as stored, and once decompressed.
+    uint32_t length;
+    uint32_t rawLength;
+    // dotmatrix_crc32() of the name followed by the payload.
+    uint32_t crc;
+    uint8_t format;
+    uint8_t flags;
+    uint8_t nameLength;
+    uint8_t reserved;
+    uint16_t frameMs;
+    uint16_t frames;
+};
+
+// An asset as it sits in flash.
+struct DotMatrixAsset
+{
+    // Not NUL-terminated.
+    const char *name;
+    uint8_t nameLength;
+    DotMatrixAssetFormat format;
+    bool compressed;
+    const uint8_t *data;
+    uint32_t length;
+    uint32_t rawLength;
+    uint16_t frameMs;
+    uint16_t frames;
+};
+
+// FNV-1a of `length` bytes of `name`.
+uint32_t dotmatrix_asset_hash(const char *name, uint32_t length);
+
+class DotMatrixAssetStore
+{
+public:
+    DotMatrixAssetStore(uint32_t start = DOTMATRIX_ASSET_FLASH_START,
+                        uint32_t size = DOTMATRIX_ASSET_FLASH_SIZE);
+
+    // Reads the log and builds the index. A blank region mounts as an empty store.
+    // Returns DEVICE_INVALID_STATE for a region holding something else, or overlapping
+    // the program.
+    int mount();
+
+    // DEVICE_NO_DATA if there is no such asset.
+    int find(const char *name, DotMatrixAsset &asset) const;
+
+    uint32_t count() const;
+    // The `index`th asset, in the order they were first added.
+    int get(uint32_t index, DotMatrixAsset &asset) const;
+
+    // Appends an uncompressed asset. Blocks while flash is written. DEVICE_NO_RESOURCES
+    // when the region or the index is full.
+    int append(const char *name, DotMatrixAssetFormat format, const uint8_t *data,
+               uint32_t length, uint16_t frameMs = 0, uint16_t frames = 1);
+    int remove(const char *name);
+
+    // Erases the whole region.
+    int erase();
+
+    uint32_t usedBytes() const;
+    uint32_t freeBytes() const;
+
+    // Records skipped at mount for a bad CRC or a full index.
+    uint32_t skipped() const;
+
+private:
+    NRF52FlashManager flash_;
+    const uint32_t start_;
+    const uint32_t size_;
+    bool mounted_;
+
+    // Offset from start_ where the next record goes.
+    uint32_t end_;
+    // Offsets of the live records, in the order they were first added.
+    uint32_t index_[DOTMATRIX_ASSET_MAX];
+    uint32_t count_;
+    uint32_t skipped_;
+
+    const DotMatrixAssetRecord *record(uint32_t offset) const;
+    void describe(uint32_t offset, DotMatrixAsset &asset) const;
+    int lookup(const char *name, uint32_t length) const;
+    void indexRecord(uint32_t offset);
+    int writeRecord(const DotMatrixAssetRecord &header, const char *name, const uint8_t *data);
+    int program(uint32_t offset, const void *data, uint32_t length);
+};
+
+// Decodes one frame of an image or animation asset, for streaming it to the panel. The
+// transmit fiber pulls the frame span by span while it is sent, so nothing larger than
+// a span is held in RAM. Compressed frames go through a 256-byte window.
+class DotMatrixAssetStream
+{
+public:
+    DotMatrixAssetStream();
+
+    // Selects frame `frame` of `asset`. The stream must outlive the frame it queues.
+    int open(const DotMatrixAsset &asset, uint16_t frame = 0);
+
+    // Queues the frame with DotMatrixClient::writeImage(). Like a shader frame, it is
+    // decoded as it goes out, and replaces one still waiting in the queue.
+    int show(DotMatrixClient &panel);
+
+    // Back to the start of the frame.
+    void rewind();
+
+    // Decodes up to `length` bytes of the frame. Returns the bytes produced.
+    uint32_t read(uint8_t *out, uint32_t length);
+
+private:
+    const uint8_t *data_;
+    uint32_t length_;
+    uint32_t position_;
+    bool compressed_;
+
+    // LZ state: literals or match bytes still to copy, and the match distance.
+    uint8_t window_[256];
+    uint32_t produced_;
+    uint32_t literals_;
+    uint32_t matchRemaining_;
+    uint32_t distance_;
+
+    static void span(uint32_t x, uint32_t y, uint32_t count, uint32_t t, uint8_t *rgb,
+                     void *context);
+};
@@ -0,0 +1,121 @@
+#include "DotMatrixColour.h"
+
+namespace
+{
+// A gamma entry times brightness times gain is at most 65535 * 255 * 255; dividing by this
+// brings it back to 0..255.
+constexpr uint64_t FULL_SCALE = 65535ull * 255;
+} // namespace
+
+DotMatrixColourCorrection::DotMatrixColourCorrection()
+    : active_(0)
+    , held_(-1)
+    , pending_(false)
+    , brightness_(255)
+    , gain_{255, 255, 255}
+    , identity_(false)
+{
+    rebuild();
+}
+
+void DotMatrixColourCorrection::setBrightness(uint8_t level)
+{
+    brightness_ = level;
+    rebuild();
+}
+
+uint8_t DotMatrixColourCorrection::brightness() const
+{
+    return brightness_;
+}
+
+void DotMatrixColourCorrection::setWhiteBalance(uint8_t r, uint8_t g, uint8_t b)
+{
+    gain_[0] = r;
+    gain_[1] = g;
+    gain_[2] = b;
+    rebuild();
+}
+
+const uint8_t *DotMatrixColourCorrection::tables() const
+{
+    return banks_[active_];
+}
+
+const uint8_t *DotMatrixColourCorrection::acquire()
+{
+    held_ = active_;
+    return banks_[active_];
+}
+
+void DotMatrixColourCorrection::release()
+{
+    held_ = -1;
+    if (pending_)
+        rebuild();
+}
+
+bool DotMatrixColourCorrection::isIdentity() const
+{
+    return identity_;
+}
+
+void DotMatrixColourCorrection::rebuild()
+{
+    // The spare bank is still being sent from; the frame's release() builds it.
+    if (held_ == (active_ ^ 1))
+    {
+        pending_ = true;
+        return;
+    }
+    pending_ = false;
+
+    uint8_t *bank = banks_[active_ ^ 1];
+    bool identity = true;
+
+    for (uint32_t c = 0; c < 3; c++)
+    {
+        // Brightness and gain both scale linear output, after the gamma curve.
+        const uint64_t scale = brightness_ * gain_[c];
+        uint8_t *table = &bank[c * 256];
+
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            table[i] = (DotMatrixGamma::table[i] * scale + FULL_SCALE / 2) / FULL_SCALE;
+            identity = identity && table[i] == i;
+        }
+    }
+
+    active_ ^= 1;
+    identity_ = identity;
+}
+
+void DotMatrixColourCorrection::apply(const uint8_t *tables, uint8_t *rgb, uint32_t pixels)
+{
+    const uint8_t *red = tables;
+    const uint8_t *green = tables + 256;
+    const uint8_t *blue = tables + 512;
+
+    for (; pixels >= 4; pixels -= 4, rgb += 12)
+    {
+        rgb[0] = red[rgb[0]];
+        rgb[1] = green[rgb[1]];
+        rgb[2] = blue[rgb[2]];
+        rgb[3] = red[rgb[3]];
+        rgb[4] = green[rgb[4]];
+        rgb[5] = blue[rgb[5]];
+        rgb[6] = red[rgb[6]];
+        rgb[7] = green[rgb[7]];
+        rgb[8] = blue[rgb[8]];
+        rgb[9] = red[rgb[9]];
+        rgb[10] = green[rgb[10]];
+        rgb[11] = blue[rgb[11]];
+    }
+
+    for (; pixels > 0; pixels--, rgb += 3)
+    {
+        rgb[0] = red[rgb[0]];
+        rgb[1] = green[rgb[1]];
+        rgb[2] = blue[rgb[2]];
+    }
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <stdint.h>
+
+// Gamma, brightness and white balance, applied to pixels as they are sent so the
+// framebuffer keeps the colours that were drawn.
+
+struct DotMatrixColour
+{
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+};
+
+// Panel gamma times 100. "DOTMATRIX_GAMMA_X100": 100 in codal.json sends colours as drawn.
+#ifndef DOTMATRIX_GAMMA_X100
+#define DOTMATRIX_GAMMA_X100 220
+#endif
+
+// Compile-time pow() for table generation; C++11 constexpr functions are one expression.
+namespace dotmatrix_constexpr
+{
+constexpr double LN2 = 0.69314718055994530942;
+
+constexpr double square(double x)
+{
+    return x * x;
+}
+
+constexpr double exp_series(double x, int n, double term, double sum)
+{
+    return n > 24 ? sum : exp_series(x, n + 1, term * x / n, sum + term * x / n);
+}
+
+// Halved until |x| <= 1, where the series converges quickly, then squared back.
+constexpr double exp(double x)
+{
+    return x < -1 || x > 1 ? square(exp(x / 2)) : exp_series(x, 1, 1.0, 1.0);
+}
+
+// Sum of y^n / n over odd n.
+constexpr double ln_series(double y, double y2, int n, double sum)
+{
+    return n > 41 ? sum : ln_series(y * y2, y2, n + 2, sum + y / n);
+}
+
+// ln(m) = 2 atanh((m - 1) / (m + 1)), for m in [1, 2).
+constexpr double ln_mantissa(double m)
+{
+    return 2 * ln_series((m - 1) / (m + 1), square((m - 1) / (m + 1)), 1, 0.0);
+}
+
+constexpr double ln(double x)
+{
+    return x < 1 ? ln(x * 2) - LN2 : x >= 2 ? ln(x / 2) + LN2 : ln_mantissa(x);
+}
+
+constexpr double pow(double x, double p)
+{
+    return x <= 0 ? 0 : exp(p * ln(x));
+}
+
+template <uint32_t... I>
+struct Indices
+{
+};
+
+template <uint32_t N, uint32_t... I>
+struct MakeIndices : MakeIndices<N - 1, N - 1, I...>
+{
+};
+
+template <uint32_t... I>
+struct MakeIndices<0, I...>
+{
+    typedef Indices<I...> type;
+};
+} // namespace dotmatrix_constexpr
+
+// 8-bit level to 16-bit linear output for a gamma of GammaX100 / 100, built by the
+// compiler into flash. The extra precision keeps dim levels distinct once brightness
+// scales them down.
+template <uint32_t GammaX100,
+          typename Indices = typename dotmatrix_constexpr::MakeIndices<256>::type>
+struct DotMatrixGammaTable;
+
+template <uint32_t GammaX100, uint32_t... I>
+struct DotMatrixGammaTable<GammaX100, dotmatrix_constexpr::Indices<I...>>
+{
+    static constexpr uint16_t table[256] = {
+        (uint16_t)(65535 * dotmatrix_constexpr::pow(I / 255.0, GammaX100 / 100.0) + 0.5)...};
+};
+
+template <uint32_t GammaX100, uint32_t... I>
+constexpr uint16_t
+    DotMatrixGammaTable<GammaX100, dotmatrix_constexpr::Indices<I...>>::table[256];
+
+using DotMatrixGamma = DotMatrixGammaTable<DOTMATRIX_GAMMA_X100>;
+
+// One 256-entry table per channel, folding the gamma curve, brightness and white
+// balance together. Changes are built into a spare bank and swapped in, so a frame
+// being sent keeps the tables it started with. A second change during the same frame
+// would rebuild the bank that frame holds, so it waits until the frame is released.
+class DotMatrixColourCorrection
+{
+public:
+    DotMatrixColourCorrection();
+
+    // 0 is off, 255 full.
+    void setBrightness(uint8_t level);
+    uint8_t brightness() const;
+
+    // Per-channel gain, 255 for none, e.g. to take the blue cast off a white.
+    void setWhiteBalance(uint8_t r, uint8_t g, uint8_t b);
+
+    // The red, green and blue tables in use, 256 bytes each, for pixels mapped without
+    // yielding.
+    const uint8_t *tables() const;
+
+    // The same tables, kept unchanged until release(), for a frame that yields while it
+    // is sent. One frame at a time.
+    const uint8_t *acquire();
+    void release();
+
+    // True when the tables map every level to itself and can be skipped.
+    bool isIdentity() const;
+
+    // Maps `pixels` RGB888 pixels in place.
+    static void apply(const uint8_t *tables, uint8_t *rgb, uint32_t pixels);
+
+private:
+    uint8_t banks_[2][3 * 256];
+    uint8_t active_;
+    // Bank held by a frame being sent, or -1.
+    int8_t held_;
+    // A change is waiting for the held bank to be released.
+    bool pending_;
+    uint8_t brightness_;
+    uint8_t gain_[3];
+    bool identity_;
+
+    void rebuild();
+};
@@ -0,0 +1,361 @@
+#include "DotMatrixCompositor.h"
+
+#include "nrf.h"
+
+#include <string.h>
+
+namespace
+{
+constexpr int PANEL_WIDTH = DotMatrixPanel::width;
+constexpr int PANEL_HEIGHT = DotMatrixPanel::height;
+
+constexpr DotMatrixRect WHOLE_PANEL = {0, 0, PANEL_WIDTH, PANEL_HEIGHT};
+constexpr DotMatrixRect EMPTY = {0, 0, 0, 0};
+
+static inline int min_int(int a, int b)
+{
+    return a < b ? a : b;
+}
+
+static inline int max_int(int a, int b)
+{
+    return a > b ? a : b;
+}
+
+static DotMatrixRect clip(const DotMatrixRect &area)
+{
+    const DotMatrixRect clipped = {(int16_t)max_int(area.x0, 0), (int16_t)max_int(area.y0, 0),
+                                   (int16_t)min_int(area.x1, PANEL_WIDTH),
+                                   (int16_t)min_int(area.y1, PANEL_HEIGHT)};
+    return clipped.isEmpty() ? EMPTY : clipped;
+}
+
+static DotMatrixRect merge(const DotMatrixRect &a, const DotMatrixRect &b)
+{
+    if (a.isEmpty())
+        return b;
+    if (b.isEmpty())
+        return a;
+
+    return {(int16_t)min_int(a.x0, b.x0), (int16_t)min_int(a.y0, b.y0),
+            (int16_t)max_int(a.x1, b.x1), (int16_t)max_int(a.y1, b.y1)};
+}
+
+static bool intersects(const DotMatrixRect &a, const DotMatrixRect &b)
+{
+    return !a.isEmpty() && !b.isEmpty() && a.x0 < b.x1 && b.x0 < a.x1 && a.y0 < b.y1 &&
+           b.y0 < a.y1;
+}
+
+// v / 255, rounded, for v up to 255 * 255.
+static inline uint32_t div255(uint32_t v)
+{
+    v += 128;
+    return (v + (v >> 8)) >> 8;
+}
+
+static inline uint8_t mix(uint8_t below, uint8_t above, uint32_t coverage)
+{
+    return div255(above * coverage + below * (255 - coverage));
+}
+
+// Every pixel at the same coverage.
+static void blend_uniform(uint8_t *out, const uint8_t *rgb, uint32_t count, uint32_t coverage)
+{
+    if (coverage == 255)
+    {
+        memcpy(out, rgb, count * 3);
+        return;
+    }
+
+    for (uint32_t i = 0; i < count * 3; i++)
+        out[i] = mix(out[i], rgb[i], coverage);
+}
+
+static void blend_key(uint8_t *out, const uint8_t *rgb, uint32_t count,
+                      const DotMatrixColour &key, uint32_t coverage)
+{
+    for (uint32_t i = 0; i < count; i++, out += 3, rgb += 3)
+    {
+        if (rgb[0] == key.r && rgb[1] == key.g && rgb[2] == key.b)
+            continue;
+
+        if (coverage == 255)
+        {
+            out[0] = rgb[0];
+            out[1] = rgb[1];
+            out[2] = rgb[2];
+        }
+        else
+        {
+            out[0] = mix(out[0], rgb[0], coverage);
+            out[1] = mix(out[1], rgb[1], coverage);
+            out[2] = mix(out[2], rgb[2], coverage);
+        }
+    }
+}
+
+static void blend_alpha(uint8_t *out, const uint8_t *rgb, const uint8_t *alpha, uint32_t count,
+                        uint32_t opacity)
+{
+    for (uint32_t i = 0; i < count; i++, out += 3, rgb += 3)
+    {
+        const uint32_t coverage = opacity == 255 ? alpha[i] : div255(alpha[i] * opacity);
+        if (coverage == 0)
+            continue;
+
+        if (coverage == 255)
+        {
+            out[0] = rgb[0];
+            out[1] = rgb[1];
+            out[2] = rgb[2];
+        }
+        else
+        {
+            out[0] = mix(out[0], rgb[0], coverage);
+            out[1] = mix(out[1], rgb[1], coverage);
+            out[2] = mix(out[2], rgb[2], coverage);
+        }
+    }
+}
+} // namespace
+
+DotMatrixLayer::DotMatrixLayer()
+    : dirty_(WHOLE_PANEL)
+    , key_{0, 0, 0}
+    , blend_(DOTMATRIX_BLEND_OPAQUE)
+    , opacity_(255)
+    , visible_(true)
+{
+    memset(rgb_, 0, sizeof(rgb_));
+    memset(alpha_, 0, sizeof(alpha_));
+}
+
+void DotMatrixLayer::setPixel(int x, int y, const DotMatrixColour &colour, uint8_t alpha)
+{
+    if (!DotMatrixPanel::contains(x, y))
+        return;
+
+    const uint32_t i = y * PANEL_WIDTH + x;
+    rgb_[i * 3] = colour.r;
+    rgb_[i * 3 + 1] = colour.g;
+    rgb_[i * 3 + 2] = colour.b;
+    alpha_[i] = alpha;
+    markDirty({(int16_t)x, (int16_t)y, (int16_t)(x + 1), (int16_t)(y + 1)});
+}
+
+void DotMatrixLayer::fillRect(const DotMatrixRect &area, const DotMatrixColour &colour,
+                              uint8_t alpha)
+{
+    const DotMatrixRect clipped = clip(area);
+    if (clipped.isEmpty())
+        return;
+
+    for (int y = clipped.y0; y < clipped.y1; y++)
+    {
+        const uint32_t first = y * PANEL_WIDTH + clipped.x0;
+        const uint32_t count = clipped.x1 - clipped.x0;
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            rgb_[i * 3] = colour.r;
+            rgb_[i * 3 + 1] = colour.g;
+            rgb_[i * 3 + 2] = colour.b;
+        }
+        memset(&alpha_[first], alpha, count);
+    }
+    markDirty(clipped);
+}
+
+void DotMatrixLayer::blit(int x, int y, int w, int h, const uint8_t *rgb)
+{
+    const DotMatrixRect area = {(int16_t)x, (int16_t)y, (int16_t)(x + w), (int16_t)(y + h)};
+    const DotMatrixRect clipped = clip(area);
+    if (clipped.isEmpty())
+        return;
+
+    for (int row = clipped.y0; row < clipped.y1; row++)
+    {
+        const uint32_t first = row * PANEL_WIDTH + clipped.x0;
+        const uint32_t count = clipped.x1 - clipped.x0;
+        const uint8_t *source = rgb + ((row - y) * w + (clipped.x0 - x)) * 3;
+        memcpy(&rgb_[first * 3], source, count * 3);
+        memset(&alpha_[first], 255, count);
+    }
+    markDirty(clipped);
+}
+
+void DotMatrixLayer::clear()
+{
+    // Transparent under either blend: the key colour with alpha 0.
+    for (uint32_t i = 0; i < DotMatrixPanel::pixels; i++)
+    {
+        rgb_[i * 3] = key_.r;
+        rgb_[i * 3 + 1] = key_.g;
+        rgb_[i * 3 + 2] = key_.b;
+    }
+    memset(alpha_, 0, sizeof(alpha_));
+    markDirty(WHOLE_PANEL);
+}
+
+void DotMatrixLayer::setBlend(DotMatrixBlend blend, const DotMatrixColour &key)
+{
+    blend_ = blend;
+    key_ = key;
+    markDirty(WHOLE_PANEL);
+}
+
+void DotMatrixLayer::setOpacity(uint8_t opacity)
+{
+    if (opacity == opacity_)
+        return;
+
+    opacity_ = opacity;
+    markDirty(WHOLE_PANEL);
+}
+
+void DotMatrixLayer::setVisible(bool visible)
+{
+    if (visible == visible_)
+        return;
+
+    visible_ = visible;
+    markDirty(WHOLE_PANEL);
+}
+
+void DotMatrixLayer::markDirty(const DotMatrixRect &area)
+{
+    dirty_ = merge(dirty_, clip(area));
+}
+
+const DotMatrixRect &DotMatrixLayer::dirty() const
+{
+    return dirty_;
+}
+
+DotMatrixCompositor::DotMatrixCompositor(DotMatrixClient &panel)
+    : panel_(panel)
+{
+    // Content and overlay start out see-through.
+    layers_[DOTMATRIX_LAYER_CONTENT].setBlend(DOTMATRIX_BLEND_KEY);
+    layers_[DOTMATRIX_LAYER_OVERLAY].setBlend(DOTMATRIX_BLEND_KEY);
+    resetStats();
+}
+
+DotMatrixLayer &DotMatrixCompositor::layer(DotMatrixLayerId id)
+{
+    return layers_[id < DOTMATRIX_LAYER_COUNT ? id : DOTMATRIX_LAYER_OVERLAY];
+}
+
+uint32_t DotMatrixCompositor::composeArea(const DotMatrixRect &area)
+{
+    // Blending starts from the topmost layer that hides everything below it.
+    uint32_t bottom = 0;
+    for (uint32_t i = 0; i < DOTMATRIX_LAYER_COUNT; i++)
+    {
+        const DotMatrixLayer &layer = layers_[i];
+        if (layer.visible_ && layer.blend_ == DOTMATRIX_BLEND_OPAQUE && layer.opacity_ == 255)
+            bottom = i;
+    }
+
+    uint8_t span[PANEL_WIDTH * 3];
+    const uint32_t count = area.x1 - area.x0;
+
+    for (int y = area.y0; y < area.y1; y++)
+    {
+        const uint32_t first = y * PANEL_WIDTH + area.x0;
+        memset(span, 0, count * 3);
+
+        for (uint32_t i = bottom; i < DOTMATRIX_LAYER_COUNT; i++)
+        {
+            const DotMatrixLayer &layer = layers_[i];
+            if (!layer.visible_ || layer.opacity_ == 0)
+                continue;
+
+            const uint8_t *rgb = &layer.rgb_[first * 3];
+            switch (layer.blend_)
+            {
+                case DOTMATRIX_BLEND_OPAQUE:
+                    blend_uniform(span, rgb, count, layer.opacity_);
+                    break;
+                case DOTMATRIX_BLEND_KEY:
+                    blend_key(span, rgb, count, layer.key_, layer.opacity_);
+                    break;
+                case DOTMATRIX_BLEND_ALPHA:
+                    blend_alpha(span, rgb, &layer.alpha_[first], count, layer.opacity_);
+                    break;
+            }
+        }
+
+        panel_.setPixels(area.x0, y, span, count);
+    }
+
+    return count * (area.y1 - area.y0);
+}
+
+uint32_t DotMatrixCompositor::compose()
+{
+    const uint32_t start = DWT->CYCCNT;
+
+    // Composed separately unless they overlap, so damage in opposite corners does not
+    // turn into the whole panel.
+    DotMatrixRect areas[DOTMATRIX_LAYER_COUNT];
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < DOTMATRIX_LAYER_COUNT; i++)
+    {
+        DotMatrixRect area = layers_[i].dirty_;
+        layers_[i].dirty_ = EMPTY;
+        if (area.isEmpty())
+            continue;
+
+        // Merging can make an area overlap one already kept, so start over after each.
+        for (uint32_t j = 0; j < count;)
+        {
+            if (intersects(area, areas[j]))
+            {
+                area = merge(area, areas[j]);
+                areas[j] = areas[--count];
+                j = 0;
+            }
+            else
+            {
+                j++;
+            }
+        }
+        areas[count++] = area;
+    }
+
+    uint32_t pixels = 0;
+    for (uint32_t i = 0; i < count; i++)
+        pixels += composeArea(areas[i]);
+
+    const uint32_t cycles = DWT->CYCCNT - start;
+    if (pixels)
+    {
+        stats_.frames++;
+        stats_.pixelsComposed += pixels;
+        stats_.lastCycles = cycles;
+        stats_.totalCycles += cycles;
+        if (cycles > stats_.maxCycles)
+            stats_.maxCycles = cycles;
+    }
+
+    return pixels;
+}
+
+int DotMatrixCompositor::update()
+{
+    if (compose() == 0)
+        return DEVICE_OK;
+
+    return panel_.writeDirty();
+}
+
+DotMatrixCompositorStats DotMatrixCompositor::stats() const
+{
+    return stats_;
+}
+
+void DotMatrixCompositor::resetStats()
+{
+    memset(&stats_, 0, sizeof(stats_));
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "DotMatrix.h"
+
+// Three full-panel layers stacked into the DotMatrixClient framebuffer. Each layer keeps
+// its own dirty rectangle, and compose() blends only the damaged areas, a row span at a
+// time, so an icon blinking over an animation costs its own few pixels rather than a
+// redraw of everything under it.
+
+enum DotMatrixLayerId : uint8_t
+{
+    DOTMATRIX_LAYER_BACKGROUND,
+    DOTMATRIX_LAYER_CONTENT,
+    DOTMATRIX_LAYER_OVERLAY,
+    DOTMATRIX_LAYER_COUNT,
+};
+
+enum DotMatrixBlend : uint8_t
+{
+    // Every pixel covers what is below it.
+    DOTMATRIX_BLEND_OPAQUE,
+    // Pixels matching the key colour are transparent, the rest opaque.
+    DOTMATRIX_BLEND_KEY,
+    // Each pixel carries its own 8-bit alpha.
+    DOTMATRIX_BLEND_ALPHA,
+};
+
+class DotMatrixLayer
+{
+public:
+    DotMatrixLayer();
+
+    // Drawing marks the pixels dirty. `alpha` is kept only for DOTMATRIX_BLEND_ALPHA.
+    void setPixel(int x, int y, const DotMatrixColour &colour, uint8_t alpha = 255);
+    void fillRect(const DotMatrixRect &area, const DotMatrixColour &colour, uint8_t alpha = 255);
+    // Copies a w x h block of RGB888 pixels, fully opaque, with its top-left at (x, y).
+    void blit(int x, int y, int w, int h, const uint8_t *rgb);
+    // Makes the whole layer transparent: the key colour, or alpha 0.
+    void clear();
+
+    // Any of these mark the whole layer dirty.
+    void setBlend(DotMatrixBlend blend, const DotMatrixColour &key = DotMatrixColour());
+    // Scales the layer's coverage: 0 hides it, 255 leaves it as drawn.
+    void setOpacity(uint8_t opacity);
+    void setVisible(bool visible);
+
+    void markDirty(const DotMatrixRect &area);
+    const DotMatrixRect &dirty() const;
+
+private:
+    uint8_t rgb_[DotMatrixPanel::pixels * 3];
+    uint8_t alpha_[DotMatrixPanel::pixels];
+    DotMatrixRect dirty_;
+    DotMatrixColour key_;
+    DotMatrixBlend blend_;
+    uint8_t opacity_;
+    bool visible_;
+
+    friend class DotMatrixCompositor;
+};
+
+struct DotMatrixCompositorStats
+{
+    uint32_t frames;
+    uint32_t pixelsComposed;
+    uint32_t lastCycles;
+    uint32_t maxCycles;
+    uint32_t totalCycles;
+};
+
+class DotMatrixCompositor
+{
+public:
+    explicit DotMatrixCompositor(DotMatrixClient &panel);
+
+    DotMatrixLayer &layer(DotMatrixLayerId id);
+
+    // Blends the layers' dirty areas into the panel framebuffer, which marks them dirty
+    // there, and clears the layers' dirty rectangles. Returns the pixels composed.
+    uint32_t compose();
+
+    // compose(), then writeDirty() if anything changed. Apps pacing frames with
+    // DotMatrixFrameScheduler call compose() and submit() instead.
+    int update();
+
+    DotMatrixCompositorStats stats() const;
+    void resetStats();
+
+private:
+    DotMatrixClient &panel_;
+    DotMatrixLayer layers_[DOTMATRIX_LAYER_COUNT];
+    DotMatrixCompositorStats stats_;
+
+    uint32_t composeArea(const DotMatrixRect &area);
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+// Panel size for this build. Set both in the "config" section of codal.json, e.g.
+// "DOTMATRIX_PANEL_WIDTH": 64, to drive a 64x64 panel; buffers and loops are sized from
+// these at compile time.
+#ifndef DOTMATRIX_PANEL_WIDTH
+#define DOTMATRIX_PANEL_WIDTH 32
+#endif
+
+#ifndef DOTMATRIX_PANEL_HEIGHT
+#define DOTMATRIX_PANEL_HEIGHT 32
+#endif
+
+template <uint32_t W, uint32_t H>
+struct DotMatrixGeometry
+{
+    // iDotMatrix panels come in these sizes, and coordinates are single bytes on the wire.
+    static_assert(W == H && (W == 16 || W == 32 || W == 64), "unsupported panel size");
+
+    static constexpr uint32_t width = W;
+    static constexpr uint32_t height = H;
+    static constexpr uint32_t pixels = W * H;
+    static constexpr uint32_t frameBytes = pixels * 3;
+
+    static constexpr bool contains(int x, int y)
+    {
+        return x >= 0 && y >= 0 && (uint32_t)x < W && (uint32_t)y < H;
+    }
+
+    // Byte offset of (x, y) in an RGB888 framebuffer.
+    static constexpr uint32_t offset(uint32_t x, uint32_t y) { return (y * W + x) * 3; }
+};
+
+using DotMatrixPanel = DotMatrixGeometry<DOTMATRIX_PANEL_WIDTH, DOTMATRIX_PANEL_HEIGHT>;
@@ -0,0 +1,69 @@
+#include "DotMatrixConsole.h"
+
+#include <string.h>
+
+namespace
+{
+constexpr uint32_t CONSOLE_LINE_MAX = 64;
+
+static MicroBit *console_uBit = nullptr;
+static const DotMatrixCommand *console_commands = nullptr;
+static uint32_t console_command_count = 0;
+
+static void console_run(char *line)
+{
+    char *args = strchr(line, ' ');
+    if (args)
+    {
+        *args++ = '\0';
+        while (*args == ' ')
+            args++;
+    }
+    else
+    {
+        args = line + strlen(line);
+    }
+
+    for (uint32_t i = 0; i < console_command_count; i++)
+    {
+        if (strcmp(line, console_commands[i].name) == 0)
+        {
+            console_commands[i].handler(*console_uBit, args);
+            return;
+        }
+    }
+
+    console_uBit->serial.printf("unknown command: %s\r\n", line);
+}
+
+static void console_loop(void *)
+{
+    while (true)
+    {
+        // Either of \r and \n ends a line, so CRLF yields an empty line in between.
+        ManagedString received = console_uBit->serial.readUntil(ManagedString("\r\n"), SYNC_SLEEP);
+        if (received.length() == 0)
+            continue;
+
+        char line[CONSOLE_LINE_MAX];
+        uint32_t length = received.length();
+        if (length > CONSOLE_LINE_MAX - 1)
+            length = CONSOLE_LINE_MAX - 1;
+        memcpy(line, received.toCharArray(), length);
+        line[length] = '\0';
+
+        console_run(line);
+    }
+}
+} // namespace
+
+void dotmatrix_console_start(MicroBit &uBit, const DotMatrixCommand *commands, uint32_t count)
+{
+    if (console_uBit)
+        return;
+
+    console_uBit = &uBit;
+    console_commands = commands;
+    console_command_count = count;
+    create_fiber(console_loop, nullptr);
+}
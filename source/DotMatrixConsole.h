@@ -0,0 +1,15 @@
+#pragma once
+
+#include "MicroBit.h"
+
+// Line-based serial commands, e.g. "trace". `args` is the rest of the line after the
+// command word, without leading spaces.
+struct DotMatrixCommand
+{
+    const char *name;
+    void (*handler)(MicroBit &uBit, const char *args);
+};
+
+// Starts a fiber that reads commands from uBit.serial and runs the matching handler.
+// `commands` must outlive the console.
+void dotmatrix_console_start(MicroBit &uBit, const DotMatrixCommand *commands, uint32_t count);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+// Font tables generated from fonts/<name>.bdf by font-gen.py at build time.
+extern "C" const uint32_t GLYPH_WIDTH;
+extern "C" const uint32_t GLYPH_HEIGHT;
+extern "C" const uint32_t BITMAP_SIZE;
+extern "C" const uint32_t SEPARATOR_LEN;
+extern "C" const uint8_t separator[];
+extern "C" const uint8_t font_data[];
+extern "C" const uint8_t font_left[];
+extern "C" const uint8_t font_advance[];
+
+// Glyphs cover printable ASCII; anything else renders as a space.
+inline uint32_t glyph_index(char c)
+{
+    if (c >= 32 && c <= 126)
+        return (uint32_t)(c - 32);
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include "DotMatrixFrameScheduler.h"
+
+#include <string.h>
+
+namespace
+{
+static uint32_t now_ms()
+{
+    return (uint32_t)system_timer_current_time();
+}
+
+// Schedulers made so far, which numbers their frame events.
+static uint16_t scheduler_count = 0;
+
+static uint32_t period_for(uint32_t fps)
+{
+    return fps ? 1000 / fps : 1000;
+}
+} // namespace
+
+DotMatrixFrameScheduler::DotMatrixFrameScheduler(DotMatrixClient &panel, uint32_t fps)
+    : panel_(panel)
+    , frameEvent_(DOTMATRIX_EVT_FRAME + scheduler_count++)
+    , periodMs_(period_for(fps))
+    , nextDeadlineMs_(0)
+    , frameTimeMs_(0)
+    , started_(false)
+    , framePending_(false)
+    , pendingSinceMs_(0)
+    , statsSinceMs_(0)
+    , totalLatencyMs_(0)
+{
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+void DotMatrixFrameScheduler::start()
+{
+    if (started_)
+        return;
+
+    started_ = true;
+    resetStats();
+    frameTimeMs_ = now_ms();
+    nextDeadlineMs_ = frameTimeMs_ + periodMs_;
+    create_fiber(fiberEntry, this);
+}
+
+void DotMatrixFrameScheduler::setTargetFps(uint32_t fps)
+{
+    periodMs_ = period_for(fps);
+}
+
+void DotMatrixFrameScheduler::submit()
+{
+    stats_.submitted++;
+
+    // Latest wins: the framebuffer already holds the newer frame, so the older one is
+    // simply never sent. Latency is measured from the frame actually shown.
+    if (framePending_)
+        stats_.dropped++;
+
+    pendingSinceMs_ = now_ms();
+    framePending_ = true;
+}
+
+void DotMatrixFrameScheduler::waitForNextFrame()
+{
+    fiber_wait_for_event(DOTMATRIX_ID, frameEvent_);
+}
+
+uint16_t DotMatrixFrameScheduler::frameEvent() const
+{
+    return frameEvent_;
+}
+
+uint32_t DotMatrixFrameScheduler::frameTimeMs() const
+{
+    return started_ ? frameTimeMs_ : now_ms();
+}
+
+void DotMatrixFrameScheduler::fiberEntry(void *param)
+{
+    static_cast<DotMatrixFrameScheduler *>(param)->run();
+}
+
+void DotMatrixFrameScheduler::run()
+{
+    while (true)
+    {
+        const uint32_t now = now_ms();
+        if ((int32_t)(nextDeadlineMs_ - now) > 0)
+            fiber_sleep(nextDeadlineMs_ - now);
+
+        frameTimeMs_ = nextDeadlineMs_;
+        nextDeadlineMs_ += periodMs_;
+        MicroBitEvent(DOTMATRIX_ID, frameEvent_);
+
+        const bool presenting = framePending_ && panel_.isReady();
+        if (presenting)
+            present();
+
+        // Slots that passed while a frame was on the air are skipped, not caught up on.
+        const uint32_t after = now_ms();
+        if ((int32_t)(after - nextDeadlineMs_) >= 0)
+        {
+            if (presenting)
+                stats_.late++;
+            nextDeadlineMs_ = after + periodMs_;
+        }
+    }
+}
+
+void DotMatrixFrameScheduler::present()
+{
+    framePending_ = false;
+    const uint32_t submittedAt = pendingSinceMs_;
+
+    if (panel_.writeDirty() != DEVICE_OK)
+        return;
+    panel_.waitForIdle();
+
+    const uint32_t latency = now_ms() - submittedAt;
+    stats_.presented++;
+    totalLatencyMs_ += latency;
+    if (latency > stats_.maxLatencyMs)
+        stats_.maxLatencyMs = latency;
+}
+
+DotMatrixFrameStats DotMatrixFrameScheduler::stats() const
+{
+    DotMatrixFrameStats stats = stats_;
+    stats.elapsedMs = now_ms() - statsSinceMs_;
+    stats.fpsX100 = stats.elapsedMs ? (uint64_t)stats.presented * 100000 / stats.elapsedMs : 0;
+    stats.averageLatencyMs = stats.presented ? totalLatencyMs_ / stats.presented : 0;
+    return stats;
+}
+
+void DotMatrixFrameScheduler::resetStats()
+{
+    memset(&stats_, 0, sizeof(stats_));
+    totalLatencyMs_ = 0;
+    statsSinceMs_ = now_ms();
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "DotMatrix.h"
+
+struct DotMatrixFrameStats
+{
+    uint32_t elapsedMs;
+    uint32_t submitted;
+    uint32_t presented;
+    // Frames replaced by a newer one before they could be sent.
+    uint32_t dropped;
+    // Frames still being sent when their slot ended.
+    uint32_t late;
+    // Achieved rate in hundredths of a frame per second.
+    uint32_t fpsX100;
+    // From submit() until the frame was handed to the SoftDevice.
+    uint32_t averageLatencyMs;
+    uint32_t maxLatencyMs;
+};
+
+// Paces frames drawn into a DotMatrixClient framebuffer at a target rate. Frames are
+// sent from the scheduler's fiber at most once per slot, through writeDirty(). When the
+// link falls behind, frames submitted in the meantime are merged into the next one
+// rather than queued, so latency stays bounded.
+class DotMatrixFrameScheduler
+{
+public:
+    DotMatrixFrameScheduler(DotMatrixClient &panel, uint32_t fps);
+
+    // Starts the scheduler fiber; call once the scheduler is running.
+    void start();
+
+    void setTargetFps(uint32_t fps);
+
+    // Marks the framebuffer as holding a finished frame. Never blocks.
+    void submit();
+
+    // Blocks until the start of this scheduler's next frame slot, for drawing loops that
+    // want to run in step with the panel.
+    void waitForNextFrame();
+
+    // The DOTMATRIX_ID event value raised at the start of each of this scheduler's slots.
+    uint16_t frameEvent() const;
+
+    // When the current frame slot was due. Animations sample time here rather than when
+    // they happen to run, so motion stays even however late the drawing fiber is.
+    uint32_t frameTimeMs() const;
+
+    DotMatrixFrameStats stats() const;
+    void resetStats();
+
+private:
+    DotMatrixClient &panel_;
+    const uint16_t frameEvent_;
+
+    uint32_t periodMs_;
+    uint32_t nextDeadlineMs_;
+    uint32_t frameTimeMs_;
+    bool started_;
+
+    volatile bool framePending_;
+    uint32_t pendingSinceMs_;
+
+    DotMatrixFrameStats stats_;
+    uint32_t statsSinceMs_;
+    uint32_t totalLatencyMs_;
+
+    static void fiberEntry(void *param);
+    void run();
+    void present();
+};
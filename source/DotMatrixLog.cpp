@@ -0,0 +1,92 @@
+#include "DotMatrixLog.h"
+#include "SpscRing.h"
+
+#include "nrf.h"
+
+namespace
+{
+struct LogRecord
+{
+    uint16_t magic;
+    uint8_t level;
+    uint8_t count;
+    uint32_t timestamp_us;
+    uint32_t format;
+    uint32_t args[DOTMATRIX_LOG_MAX_ARGS];
+} __attribute__((packed));
+
+constexpr uint32_t LOG_RECORD_HEADER_SIZE = sizeof(LogRecord) - sizeof(LogRecord::args);
+
+// Sending is paced rather than immediate so log output never competes with the link.
+constexpr uint32_t LOG_DRAIN_INTERVAL_MS = 20;
+
+static SpscRing<LogRecord, DOTMATRIX_LOG_BUFFER_RECORDS> log_ring;
+static volatile uint32_t log_dropped = 0;
+static MicroBit *log_uBit = nullptr;
+
+const char LOG_DROPPED_FORMAT[] = "%u log records dropped";
+
+static void log_send(const LogRecord &record)
+{
+    log_uBit->serial.send((uint8_t *)&record,
+                          LOG_RECORD_HEADER_SIZE + record.count * sizeof(uint32_t),
+                          SYNC_SLEEP);
+}
+
+static void log_drain(void *)
+{
+    while (true)
+    {
+        LogRecord record;
+        while (log_ring.pop(record))
+            log_send(record);
+
+        const uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        const uint32_t dropped = log_dropped;
+        log_dropped = 0;
+        __set_PRIMASK(primask);
+
+        if (dropped)
+        {
+            record = {DOTMATRIX_LOG_MAGIC,
+                      DOTMATRIX_LOG_LEVEL_WARN,
+                      1,
+                      (uint32_t)system_timer_current_time_us(),
+                      (uint32_t)(uintptr_t)LOG_DROPPED_FORMAT,
+                      {dropped}};
+            log_send(record);
+        }
+
+        fiber_sleep(LOG_DRAIN_INTERVAL_MS);
+    }
+}
+} // namespace
+
+void dotmatrix_log_write(uint8_t level, const char *format, const uint32_t *args, uint32_t count)
+{
+    LogRecord record;
+    record.magic = DOTMATRIX_LOG_MAGIC;
+    record.level = level;
+    record.count = count;
+    record.timestamp_us = (uint32_t)system_timer_current_time_us();
+    record.format = (uint32_t)(uintptr_t)format;
+    for (uint32_t i = 0; i < count; i++)
+        record.args[i] = args[i];
+
+    // Fibers and interrupt handlers both log, so producers are serialised here.
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (!log_ring.push(record))
+        log_dropped++;
+    __set_PRIMASK(primask);
+}
+
+void dotmatrix_log_start(MicroBit &uBit)
+{
+    if (log_uBit)
+        return;
+
+    log_uBit = &uBit;
+    create_fiber(log_drain, nullptr);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "MicroBit.h"
+
+// Log levels. Calls above DOTMATRIX_LOG_LEVEL compile to nothing.
+#define DOTMATRIX_LOG_LEVEL_NONE 0
+#define DOTMATRIX_LOG_LEVEL_ERROR 1
+#define DOTMATRIX_LOG_LEVEL_WARN 2
+#define DOTMATRIX_LOG_LEVEL_INFO 3
+#define DOTMATRIX_LOG_LEVEL_DEBUG 4
+
+#ifndef DOTMATRIX_LOG_LEVEL
+#define DOTMATRIX_LOG_LEVEL DOTMATRIX_LOG_LEVEL_INFO
+#endif
+
+// Records held in RAM until the drain fiber sends them; when full, new records are
+// counted and dropped.
+#ifndef DOTMATRIX_LOG_BUFFER_RECORDS
+#define DOTMATRIX_LOG_BUFFER_RECORDS 32
+#endif
+
+#define DOTMATRIX_LOG_MAX_ARGS 4
+
+// First two bytes of every record on the wire, "DL".
+#define DOTMATRIX_LOG_MAGIC 0x4C44
+
+// Records are not formatted on the device. Each carries the address of its format
+// string, which log_decode.py looks up in the firmware ELF. Arguments are stored as
+// 32 bit words, so %s only works for strings that live in flash.
+void dotmatrix_log_write(uint8_t level, const char *format, const uint32_t *args, uint32_t count);
+
+// Starts the fiber that sends buffered records over uBit.serial.
+void dotmatrix_log_start(MicroBit &uBit);
+
+template <typename T> inline uint32_t dotmatrix_log_arg(T value)
+{
+    return (uint32_t)value;
+}
+
+template <typename T> inline uint32_t dotmatrix_log_arg(T *value)
+{
+    return (uint32_t)(uintptr_t)value;
+}
+
+template <typename... Args> inline void dotmatrix_log(uint8_t level, const char *format, Args... args)
+{
+    static_assert(sizeof...(Args) <= DOTMATRIX_LOG_MAX_ARGS, "too many log arguments");
+
+    const uint32_t values[] = {0, dotmatrix_log_arg(args)...};
+    dotmatrix_log_write(level, format, values + 1, sizeof...(Args));
+}
+
+#if DOTMATRIX_LOG_LEVEL >= DOTMATRIX_LOG_LEVEL_ERROR
+#define DOTMATRIX_LOG_ERROR(...) dotmatrix_log(DOTMATRIX_LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define DOTMATRIX_LOG_ERROR(...) ((void)0)
+#endif
+
+#if DOTMATRIX_LOG_LEVEL >= DOTMATRIX_LOG_LEVEL_WARN
+#define DOTMATRIX_LOG_WARN(...) dotmatrix_log(DOTMATRIX_LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define DOTMATRIX_LOG_WARN(...) ((void)0)
+#endif
+
+#if DOTMATRIX_LOG_LEVEL >= DOTMATRIX_LOG_LEVEL_INFO
+#define DOTMATRIX_LOG_INFO(...) dotmatrix_log(DOTMATRIX_LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define DOTMATRIX_LOG_INFO(...) ((void)0)
+#endif
+
+#if DOTMATRIX_LOG_LEVEL >= DOTMATRIX_LOG_LEVEL_DEBUG
+#define DOTMATRIX_LOG_DEBUG(...) dotmatrix_log(DOTMATRIX_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define DOTMATRIX_LOG_DEBUG(...) ((void)0)
+#endif
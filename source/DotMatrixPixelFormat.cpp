@@ -0,0 +1,25 @@
+#include "DotMatrixPixelFormat.h"
+
+uint8_t DotMatrixIndexed8::palette[256 * 3];
+
+uint8_t DotMatrixMono::foreground[3] = {255, 255, 255};
+uint8_t DotMatrixMono::background[3] = {0, 0, 0};
+
+void DotMatrixIndexed8::resetPalette()
+{
+    // Index bits are RRRGGGBB; each field is stretched back to 0..255.
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        palette[i * 3] = ((i >> 5) & 7) * 255 / 7;
+        palette[i * 3 + 1] = ((i >> 2) & 7) * 255 / 7;
+        palette[i * 3 + 2] = (i & 3) * 255 / 3;
+    }
+}
+
+#if DOTMATRIX_PIXEL_FORMAT == DOTMATRIX_PIXEL_FORMAT_INDEXED8
+namespace
+{
+// The palette lives in RAM so it can be changed; fill it before main() runs.
+static const bool palette_ready = (DotMatrixIndexed8::resetPalette(), true);
+} // namespace
+#endif
@@ -0,0 +1,355 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Framebuffer storage formats. The panel always receives RGB888; other formats trade
+// colour depth for RAM and are expanded while image chunks are emitted. Pick one per
+// build with "DOTMATRIX_PIXEL_FORMAT" in the config section of codal.json.
+#define DOTMATRIX_PIXEL_FORMAT_RGB888 0
+#define DOTMATRIX_PIXEL_FORMAT_RGB565 1
+#define DOTMATRIX_PIXEL_FORMAT_INDEXED8 2
+#define DOTMATRIX_PIXEL_FORMAT_MONO 3
+// No framebuffer: drawing calls do nothing and only shaders reach the panel.
+#define DOTMATRIX_PIXEL_FORMAT_NONE 4
+
+#ifndef DOTMATRIX_PIXEL_FORMAT
+#define DOTMATRIX_PIXEL_FORMAT DOTMATRIX_PIXEL_FORMAT_RGB888
+#endif
+
+// Each format provides, for a framebuffer `fb` of pixels in row-major order:
+//   bytes(pixels)                 storage for that many pixels
+//   set(fb, i, r, g, b)           store one pixel
+//   get(fb, i, rgb)               read one pixel back as RGB888
+//   fill(fb, pixels, r, g, b)     set every pixel
+//   pack(fb, first, rgb, count)   store a run of RGB888 pixels
+//   move(fb, to, from, count)     copy a run of pixels; the runs may overlap
+//   expand(fb, first, count, rgb) convert a run to RGB888; `first` is a multiple of 8
+//
+// `wire` is true when the storage already is the wire format, so no expansion is needed.
+
+struct DotMatrixRgb888
+{
+    static constexpr bool wire = true;
+    static constexpr const char *name = "rgb888";
+
+    static constexpr uint32_t bytes(uint32_t pixels) { return pixels * 3; }
+
+    static inline void set(uint8_t *fb, uint32_t i, uint8_t r, uint8_t g, uint8_t b)
+    {
+        uint8_t *px = &fb[i * 3];
+        px[0] = r;
+        px[1] = g;
+        px[2] = b;
+    }
+
+    static inline void get(const uint8_t *fb, uint32_t i, uint8_t *rgb)
+    {
+        memcpy(rgb, &fb[i * 3], 3);
+    }
+
+    static void fill(uint8_t *fb, uint32_t pixels, uint8_t r, uint8_t g, uint8_t b)
+    {
+        if (r == g && g == b)
+        {
+            memset(fb, r, pixels * 3);
+            return;
+        }
+        for (uint32_t i = 0; i < pixels; i++)
+            set(fb, i, r, g, b);
+    }
+
+    static inline void pack(uint8_t *fb, uint32_t first, const uint8_t *rgb, uint32_t count)
+    {
+        memcpy(&fb[first * 3], rgb, count * 3);
+    }
+
+    static inline void move(uint8_t *fb, uint32_t to, uint32_t from, uint32_t count)
+    {
+        memmove(&fb[to * 3], &fb[from * 3], count * 3);
+    }
+
+    static inline void expand(const uint8_t *fb, uint32_t first, uint32_t count, uint8_t *rgb)
+    {
+        memcpy(rgb, &fb[first * 3], count * 3);
+    }
+};
+
+// 5-6-5 bits in a little-endian halfword: two thirds of the RAM of RGB888.
+struct DotMatrixRgb565
+{
+    static constexpr bool wire = false;
+    static constexpr const char *name = "rgb565";
+
+    static constexpr uint32_t bytes(uint32_t pixels) { return pixels * 2; }
+
+    static inline uint16_t encode(uint8_t r, uint8_t g, uint8_t b)
+    {
+        return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+    }
+
+    // Low bits repeat the high ones, so full scale stays 255.
+    static inline uint32_t red(uint32_t p) { return ((p >> 8) & 0xF8) | ((p >> 13) & 0x07); }
+    static inline uint32_t green(uint32_t p) { return ((p >> 3) & 0xFC) | ((p >> 9) & 0x03); }
+    static inline uint32_t blue(uint32_t p) { return ((p << 3) & 0xF8) | ((p >> 2) & 0x07); }
+
+    static inline void set(uint8_t *fb, uint32_t i, uint8_t r, uint8_t g, uint8_t b)
+    {
+        const uint16_t p = encode(r, g, b);
+        memcpy(&fb[i * 2], &p, 2);
+    }
+
+    static inline void get(const uint8_t *fb, uint32_t i, uint8_t *rgb)
+    {
+        uint16_t p;
+        memcpy(&p, &fb[i * 2], 2);
+        rgb[0] = red(p);
+        rgb[1] = green(p);
+        rgb[2] = blue(p);
+    }
+
+    static void fill(uint8_t *fb, uint32_t pixels, uint8_t r, uint8_t g, uint8_t b)
+    {
+        const uint16_t p = encode(r, g, b);
+        for (uint32_t i = 0; i < pixels; i++)
+            memcpy(&fb[i * 2], &p, 2);
+    }
+
+    static void pack(uint8_t *fb, uint32_t first, const uint8_t *rgb, uint32_t count)
+    {
+        for (uint32_t i = 0; i < count; i++, rgb += 3)
+            set(fb, first + i, rgb[0], rgb[1], rgb[2]);
+    }
+
+    static inline void move(uint8_t *fb, uint32_t to, uint32_t from, uint32_t count)
+    {
+        memmove(&fb[to * 2], &fb[from * 2], count * 2);
+    }
+
+    // Four pixels per pass: two halfword pairs in, three words out.
+    static void expand(const uint8_t *fb, uint32_t first, uint32_t count, uint8_t *rgb)
+    {
+        const uint8_t *in = &fb[first * 2];
+
+        for (; count >= 4; count -= 4, in += 8, rgb += 12)
+        {
+            uint32_t p01, p23;
+            memcpy(&p01, in, 4);
+            memcpy(&p23, in + 4, 4);
+            const uint32_t p0 = p01 & 0xFFFF, p1 = p01 >> 16;
+            const uint32_t p2 = p23 & 0xFFFF, p3 = p23 >> 16;
+
+            const uint32_t w0 = red(p0) | (green(p0) << 8) | (blue(p0) << 16) | (red(p1) << 24);
+            const uint32_t w1 = green(p1) | (blue(p1) << 8) | (red(p2) << 16) | (green(p2) << 24);
+            const uint32_t w2 = blue(p2) | (red(p3) << 8) | (green(p3) << 16) | (blue(p3) << 24);
+            memcpy(rgb, &w0, 4);
+            memcpy(rgb + 4, &w1, 4);
+            memcpy(rgb + 8, &w2, 4);
+        }
+
+        for (uint32_t i = 0; i < count; i++)
+            get(in, i, &rgb[i * 3]);
+    }
+};
+
+// One byte per pixel into a 256-entry palette, a third of the RAM of RGB888. The palette
+// starts as the 3-3-2 colour cube that set() quantises to; changing entries recolours
+// the frame without touching the framebuffer.
+struct DotMatrixIndexed8
+{
+    static constexpr bool wire = false;
+    static constexpr const char *name = "indexed8";
+
+    static uint8_t palette[256 * 3];
+
+    static constexpr uint32_t bytes(uint32_t pixels) { return pixels; }
+
+    static inline uint8_t encode(uint8_t r, uint8_t g, uint8_t b)
+    {
+        return (r & 0xE0) | ((g >> 3) & 0x1C) | (b >> 6);
+    }
+
+    static inline void set(uint8_t *fb, uint32_t i, uint8_t r, uint8_t g, uint8_t b)
+    {
+        fb[i] = encode(r, g, b);
+    }
+
+    static inline void get(const uint8_t *fb, uint32_t i, uint8_t *rgb)
+    {
+        memcpy(rgb, &palette[fb[i] * 3], 3);
+    }
+
+    static void fill(uint8_t *fb, uint32_t pixels, uint8_t r, uint8_t g, uint8_t b)
+    {
+        memset(fb, encode(r, g, b), pixels);
+    }
+
+    static void pack(uint8_t *fb, uint32_t first, const uint8_t *rgb, uint32_t count)
+    {
+        for (uint32_t i = 0; i < count; i++, rgb += 3)
+            fb[first + i] = encode(rgb[0], rgb[1], rgb[2]);
+    }
+
+    static inline void move(uint8_t *fb, uint32_t to, uint32_t from, uint32_t count)
+    {
+        memmove(&fb[to], &fb[from], count);
+    }
+
+    // Four indices per word load.
+    static void expand(const uint8_t *fb, uint32_t first, uint32_t count, uint8_t *rgb)
+    {
+        const uint8_t *in = &fb[first];
+
+        for (; count >= 4; count -= 4, in += 4, rgb += 12)
+        {
+            uint32_t indices;
+            memcpy(&indices, in, 4);
+            memcpy(rgb, &palette[(indices & 0xFF) * 3], 3);
+            memcpy(rgb + 3, &palette[((indices >> 8) & 0xFF) * 3], 3);
+            memcpy(rgb + 6, &palette[((indices >> 16) & 0xFF) * 3], 3);
+            memcpy(rgb + 9, &palette[(indices >> 24) * 3], 3);
+        }
+
+        for (uint32_t i = 0; i < count; i++)
+            get(in, i, &rgb[i * 3]);
+    }
+
+    // Restores the 3-3-2 cube.
+    static void resetPalette();
+};
+
+// One bit per pixel, LSB first, shown in `foreground` or `background`: a twenty-fourth
+// of the RAM of RGB888. set() lights a pixel when its luma is at least half scale.
+struct DotMatrixMono
+{
+    static constexpr bool wire = false;
+    static constexpr const char *name = "mono";
+
+    static uint8_t foreground[3];
+    static uint8_t background[3];
+
+    static constexpr uint32_t bytes(uint32_t pixels) { return (pixels + 7) / 8; }
+
+    static inline bool lit(uint8_t r, uint8_t g, uint8_t b)
+    {
+        return (r * 2 + g * 5 + b) >= 128 * 8;
+    }
+
+    static inline void set(uint8_t *fb, uint32_t i, uint8_t r, uint8_t g, uint8_t b)
+    {
+        const uint8_t bit = 1 << (i & 7);
+        if (lit(r, g, b))
+            fb[i >> 3] |= bit;
+        else
+            fb[i >> 3] &= ~bit;
+    }
+
+    static inline void get(const uint8_t *fb, uint32_t i, uint8_t *rgb)
+    {
+        memcpy(rgb, (fb[i >> 3] >> (i & 7)) & 1 ? foreground : background, 3);
+    }
+
+    static void fill(uint8_t *fb, uint32_t pixels, uint8_t r, uint8_t g, uint8_t b)
+    {
+        memset(fb, lit(r, g, b) ? 0xFF : 0x00, bytes(pixels));
+    }
+
+    static void pack(uint8_t *fb, uint32_t first, const uint8_t *rgb, uint32_t count)
+    {
+        for (uint32_t i = 0; i < count; i++, rgb += 3)
+            set(fb, first + i, rgb[0], rgb[1], rgb[2]);
+    }
+
+    // Whole bytes when the runs are byte aligned, as whole rows are; otherwise bit by bit,
+    // in the direction that does not overwrite pixels still to be read.
+    static void move(uint8_t *fb, uint32_t to, uint32_t from, uint32_t count)
+    {
+        if (((to | from | count) & 7) == 0)
+        {
+            memmove(&fb[to >> 3], &fb[from >> 3], count >> 3);
+            return;
+        }
+
+        for (uint32_t n = 0; n < count; n++)
+        {
+            const uint32_t i = to < from ? n : count - 1 - n;
+            const uint8_t bit = 1 << ((to + i) & 7);
+            if ((fb[(from + i) >> 3] >> ((from + i) & 7)) & 1)
+                fb[(to + i) >> 3] |= bit;
+            else
+                fb[(to + i) >> 3] &= ~bit;
+        }
+    }
+
+    // Eight pixels per byte, unrolled; runs of a single colour are the common case, so
+    // whole bytes of 0x00 or 0xFF take a shortcut.
+    static void expand(const uint8_t *fb, uint32_t first, uint32_t count, uint8_t *rgb)
+    {
+        const uint8_t *in = &fb[first >> 3];
+
+        for (; count >= 8; count -= 8, in++, rgb += 24)
+        {
+            const uint8_t bits = *in;
+            if (bits == 0x00 || bits == 0xFF)
+            {
+                const uint8_t *c = bits ? foreground : background;
+                for (uint32_t i = 0; i < 24; i += 3)
+                    memcpy(rgb + i, c, 3);
+                continue;
+            }
+
+            memcpy(rgb, bits & 0x01 ? foreground : background, 3);
+            memcpy(rgb + 3, bits & 0x02 ? foreground : background, 3);
+            memcpy(rgb + 6, bits & 0x04 ? foreground : background, 3);
+            memcpy(rgb + 9, bits & 0x08 ? foreground : background, 3);
+            memcpy(rgb + 12, bits & 0x10 ? foreground : background, 3);
+            memcpy(rgb + 15, bits & 0x20 ? foreground : background, 3);
+            memcpy(rgb + 18, bits & 0x40 ? foreground : background, 3);
+            memcpy(rgb + 21, bits & 0x80 ? foreground : background, 3);
+        }
+
+        for (uint32_t i = 0; i < count; i++)
+            get(in, i, &rgb[i * 3]);
+    }
+};
+
+// Stores nothing and reads back black.
+struct DotMatrixNoFramebuffer
+{
+    static constexpr bool wire = false;
+    static constexpr const char *name = "none";
+
+    static constexpr uint32_t bytes(uint32_t) { return 0; }
+
+    static inline void set(uint8_t *, uint32_t, uint8_t, uint8_t, uint8_t) {}
+
+    static inline void get(const uint8_t *, uint32_t, uint8_t *rgb)
+    {
+        memset(rgb, 0, 3);
+    }
+
+    static inline void fill(uint8_t *, uint32_t, uint8_t, uint8_t, uint8_t) {}
+
+    static inline void pack(uint8_t *, uint32_t, const uint8_t *, uint32_t) {}
+
+    static inline void move(uint8_t *, uint32_t, uint32_t, uint32_t) {}
+
+    static inline void expand(const uint8_t *, uint32_t, uint32_t count, uint8_t *rgb)
+    {
+        memset(rgb, 0, count * 3);
+    }
+};
+
+#if DOTMATRIX_PIXEL_FORMAT == DOTMATRIX_PIXEL_FORMAT_RGB888
+using DotMatrixFramebufferFormat = DotMatrixRgb888;
+#elif DOTMATRIX_PIXEL_FORMAT == DOTMATRIX_PIXEL_FORMAT_RGB565
+using DotMatrixFramebufferFormat = DotMatrixRgb565;
+#elif DOTMATRIX_PIXEL_FORMAT == DOTMATRIX_PIXEL_FORMAT_INDEXED8
+using DotMatrixFramebufferFormat = DotMatrixIndexed8;
+#elif DOTMATRIX_PIXEL_FORMAT == DOTMATRIX_PIXEL_FORMAT_MONO
+using DotMatrixFramebufferFormat = DotMatrixMono;
+#elif DOTMATRIX_PIXEL_FORMAT == DOTMATRIX_PIXEL_FORMAT_NONE
+using DotMatrixFramebufferFormat = DotMatrixNoFramebuffer;
+#else
+#error "unknown DOTMATRIX_PIXEL_FORMAT"
+#endif
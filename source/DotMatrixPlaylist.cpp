@@ -0,0 +1,359 @@
+#include "DotMatrixPlaylist.h"
+#include "DotMatrixLog.h"
+
+#include <string.h>
+
+namespace
+{
+static uint32_t now_ms()
+{
+    return (uint32_t)system_timer_current_time();
+}
+
+// Wrap-safe: true once `ms` has come.
+static bool reached(uint32_t ms)
+{
+    return (int32_t)(now_ms() - ms) >= 0;
+}
+
+static uint32_t update_lead(uint32_t lead, uint32_t sendMs)
+{
+    // Follows the link as it speeds up or slows down, without chasing one slow write.
+    return lead ? (lead * 3 + sendMs) / 4 : sendMs;
+}
+
+static uint32_t frame_ms(const DotMatrixAsset &asset)
+{
+    return asset.frameMs ? asset.frameMs : DOTMATRIX_PLAYLIST_FRAME_MS;
+}
+
+// Stored as 0 for a single frame, as DotMatrixAssetStream::open() reads it.
+static uint32_t frame_count(const DotMatrixAsset &asset)
+{
+    return asset.frames ? asset.frames : 1;
+}
+} // namespace
+
+DotMatrixPlaylist::DotMatrixPlaylist(DotMatrixClient &panel)
+    : panel_(panel)
+    , count_(0)
+    , next_(0)
+    , paused_(false)
+    , started_(false)
+    , textLeadMs_(0)
+    , imageLeadMs_(0)
+    , frameLeadMs_(0)
+{
+    resetStats();
+}
+
+int DotMatrixPlaylist::add(const Item &item)
+{
+    if (count_ == DOTMATRIX_PLAYLIST_MAX_ITEMS)
+        return DEVICE_NO_RESOURCES;
+
+    items_[count_++] = item;
+    return DEVICE_OK;
+}
+
+int DotMatrixPlaylist::addText(const char *text, uint32_t durationMs)
+{
+    if (text == nullptr || *text == 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    Item item;
+    memset(&item, 0, sizeof(item));
+    item.kind = TEXT;
+    item.durationMs = durationMs;
+    item.text = text;
+    return add(item);
+}
+
+int DotMatrixPlaylist::addAsset(const DotMatrixAsset &asset, uint32_t durationMs)
+{
+    if (asset.format == DOTMATRIX_ASSET_RAW)
+        return DEVICE_INVALID_PARAMETER;
+
+    Item item;
+    memset(&item, 0, sizeof(item));
+    item.kind = ASSET;
+    item.durationMs = durationMs;
+    item.asset = asset;
+    return add(item);
+}
+
+int DotMatrixPlaylist::addDrawing(DotMatrixPlaylistDraw draw, void *context,
+                                  uint32_t durationMs)
+{
+    if (draw == nullptr)
+        return DEVICE_INVALID_PARAMETER;
+
+    Item item;
+    memset(&item, 0, sizeof(item));
+    item.kind = DRAWING;
+    item.durationMs = durationMs;
+    item.draw = draw;
+    item.context = context;
+    return add(item);
+}
+
+void DotMatrixPlaylist::clear()
+{
+    count_ = 0;
+    next_ = 0;
+}
+
+uint32_t DotMatrixPlaylist::count() const
+{
+    return count_;
+}
+
+void DotMatrixPlaylist::start()
+{
+    if (started_)
+        return;
+
+    started_ = true;
+    create_fiber(fiberEntry, this);
+}
+
+void DotMatrixPlaylist::setPaused(bool paused)
+{
+    paused_ = paused;
+}
+
+void DotMatrixPlaylist::fiberEntry(void *param)
+{
+    static_cast<DotMatrixPlaylist *>(param)->run();
+}
+
+bool DotMatrixPlaylist::playable() const
+{
+    return !paused_ && count_ > 0 && panel_.isReady();
+}
+
+bool DotMatrixPlaylist::waitUntil(uint32_t ms)
+{
+    // In short sleeps, so a pause or a lost link is noticed.
+    while (playable() && !reached(ms))
+    {
+        const uint32_t left = ms - now_ms();
+        fiber_sleep(left < 100 ? left : 100);
+    }
+    return playable();
+}
+
+int DotMatrixPlaylist::prepare(Slot &slot)
+{
+    const Item &item = slot.item;
+    slot.durationMs = item.durationMs;
+
+    switch (item.kind)
+    {
+        case TEXT:
+        {
+            slot.text = ManagedString(item.text);
+            break;
+        }
+
+        case ASSET:
+        {
+            const DotMatrixAsset &asset = item.asset;
+            if (asset.format == DOTMATRIX_ASSET_TEXT)
+            {
+                slot.text = ManagedString((const char *)asset.data, (int16_t)asset.length);
+                break;
+            }
+
+            const int rc = slot.stream.open(asset, 0);
+            if (rc != DEVICE_OK)
+                return rc;
+            if (slot.durationMs == 0 && asset.format == DOTMATRIX_ASSET_ANIMATION)
+                slot.durationMs = frame_count(asset) * frame_ms(asset);
+            break;
+        }
+
+        case DRAWING:
+            item.draw(panel_, item.context);
+            break;
+    }
+
+    slot.showsText = item.kind == TEXT ||
+                     (item.kind == ASSET && item.asset.format == DOTMATRIX_ASSET_TEXT);
+    if (slot.durationMs == 0 && slot.showsText)
+    {
+        // The panel drops characters past one message, so only those scroll.
+        const int characters = slot.text.length();
+        slot.durationMs = panel_.textDuration(
+            characters < DOTMATRIX_TEXT_MAX_CHARACTERS ? characters : DOTMATRIX_TEXT_MAX_CHARACTERS);
+    }
+    else if (slot.durationMs == 0)
+    {
+        slot.durationMs = DOTMATRIX_PLAYLIST_IMAGE_MS;
+    }
+
+    return DEVICE_OK;
+}
+
+bool DotMatrixPlaylist::prepareNext(Slot &slot)
+{
+    // Give up after one pass, in case nothing in the list can be shown.
+    for (uint32_t tries = 0; tries < count_; tries++)
+    {
+        const uint32_t index = next_ < count_ ? next_ : 0;
+        next_ = index + 1 < count_ ? index + 1 : 0;
+
+        slot.item = items_[index];
+        slot.index = index;
+        const int rc = prepare(slot);
+        if (rc == DEVICE_OK)
+            return true;
+
+        DOTMATRIX_LOG_WARN("Playlist item %d skipped: %d", (int)index, rc);
+        stats_.skipped++;
+    }
+    return false;
+}
+
+uint32_t DotMatrixPlaylist::leadMs(const Slot &slot) const
+{
+    return slot.showsText ? textLeadMs_ : imageLeadMs_;
+}
+
+void DotMatrixPlaylist::begin(Slot &slot)
+{
+    if (slot.item.kind == DRAWING)
+    {
+        panel_.setImageModeDiy();
+        panel_.writeImage();
+    }
+    else if (slot.showsText)
+    {
+        panel_.writeText(slot.text);
+    }
+    else
+    {
+        panel_.setImageModeDiy();
+        slot.stream.show(panel_);
+        if (slot.item.asset.format == DOTMATRIX_ASSET_ANIMATION)
+            stats_.frames++;
+    }
+}
+
+void DotMatrixPlaylist::record(const Slot &slot, uint32_t issuedMs, uint32_t dueMs)
+{
+    const uint32_t doneMs = now_ms();
+    const int32_t error = doneMs - dueMs;
+    const uint32_t size = error < 0 ? -error : error;
+
+    stats_.items++;
+    stats_.lastErrorMs = error;
+    if (size > stats_.maxErrorMs)
+        stats_.maxErrorMs = size;
+    totalErrorMs_ += size;
+
+    if (slot.showsText)
+        textLeadMs_ = update_lead(textLeadMs_, doneMs - issuedMs);
+    else
+        imageLeadMs_ = update_lead(imageLeadMs_, doneMs - issuedMs);
+}
+
+bool DotMatrixPlaylist::animate(Slot &slot, uint32_t startMs, uint32_t endMs)
+{
+    const DotMatrixAsset &asset = slot.item.asset;
+    const uint32_t period = frame_ms(asset);
+
+    for (uint32_t frame = 1;; frame++)
+    {
+        const uint32_t dueMs = startMs + frame * period;
+        if ((int32_t)(dueMs - endMs) >= 0)
+            return true;
+        if (!waitUntil(dueMs - frameLeadMs_))
+            return false;
+        if (reached(dueMs))
+            stats_.lateFrames++;
+
+        const uint32_t issuedMs = now_ms();
+        const int rc = slot.stream.open(asset, frame % frame_count(asset));
+        if (rc != DEVICE_OK)
+        {
+            // The last frame sent stays up for the rest of the item's time.
+            DOTMATRIX_LOG_WARN("Playlist item %d cut at frame %d: %d", (int)slot.index,
+                               (int)frame, rc);
+            stats_.skipped++;
+            return true;
+        }
+        slot.stream.show(panel_);
+        stats_.frames++;
+
+        // The stream is read as the frame goes out, so it must be sent before it is
+        // reopened. Frames go without a mode switch, so they are timed apart from the
+        // first.
+        panel_.waitForIdle();
+        frameLeadMs_ = update_lead(frameLeadMs_, now_ms() - issuedMs);
+    }
+}
+
+void DotMatrixPlaylist::run()
+{
+    while (true)
+    {
+        Slot *current = &slots_[0];
+        Slot *next = &slots_[1];
+        if (!playable() || !prepareNext(*current))
+        {
+            fiber_sleep(100);
+            continue;
+        }
+
+        uint32_t dueMs = now_ms() + leadMs(*current);
+        while (true)
+        {
+            if (!waitUntil(dueMs - leadMs(*current)))
+            {
+                // Start again from the item that did not get its turn.
+                next_ = current->index;
+                break;
+            }
+
+            const uint32_t issuedMs = now_ms();
+            begin(*current);
+            panel_.waitForIdle();
+            record(*current, issuedMs, dueMs);
+
+            // The next item is prepared while this one shows.
+            const uint32_t endMs = dueMs + current->durationMs;
+            if (!prepareNext(*next))
+                break;
+
+            const bool animated = current->item.kind == ASSET &&
+                                  current->item.asset.format == DOTMATRIX_ASSET_ANIMATION;
+            if (animated && !animate(*current, dueMs, endMs))
+            {
+                next_ = next->index;
+                break;
+            }
+
+            dueMs = endMs;
+            Slot *shown = current;
+            current = next;
+            next = shown;
+        }
+    }
+}
+
+DotMatrixPlaylistStats DotMatrixPlaylist::stats() const
+{
+    DotMatrixPlaylistStats s = stats_;
+    s.averageErrorMs = s.items ? totalErrorMs_ / s.items : 0;
+    s.textLeadMs = textLeadMs_;
+    s.imageLeadMs = imageLeadMs_;
+    s.frameLeadMs = frameLeadMs_;
+    return s;
+}
+
+void DotMatrixPlaylist::resetStats()
+{
+    memset(&stats_, 0, sizeof(stats_));
+    totalErrorMs_ = 0;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "DotMatrixAssets.h"
+
+// Rotates the panel through text, images, animations and app drawings, each for its own
+// time. The panel cannot hold a frame off screen, so a switch cannot be uploaded early
+// and flipped. Instead the next item is prepared while the current one shows: text
+// built, the asset frame located and checked, a drawing rendered into the framebuffer.
+// Its writes are then started ahead of its due time by how long that kind of item
+// took to send before, so it lands on the panel on time rather than a send late.
+
+#define DOTMATRIX_PLAYLIST_MAX_ITEMS 40
+
+// Time on screen for images and drawings added without one.
+#ifndef DOTMATRIX_PLAYLIST_IMAGE_MS
+#define DOTMATRIX_PLAYLIST_IMAGE_MS 5000
+#endif
+
+// Frame time for animations stored without one.
+#define DOTMATRIX_PLAYLIST_FRAME_MS 100
+
+// Draws an item into the framebuffer. Called while the previous item is still showing,
+// so it must not send anything.
+typedef void (*DotMatrixPlaylistDraw)(DotMatrixClient &panel, void *context);
+
+struct DotMatrixPlaylistStats
+{
+    // Items shown, and items skipped, or animations cut short, because an asset could not
+    // be read.
+    uint32_t items;
+    uint32_t skipped;
+    // When each item had finished reaching the panel, against when it was due; late is
+    // positive. The average and max are of the size of the error.
+    int32_t lastErrorMs;
+    uint32_t averageErrorMs;
+    uint32_t maxErrorMs;
+    // Animation frames sent, and those that could not start on time because the one
+    // before was still being sent.
+    uint32_t frames;
+    uint32_t lateFrames;
+    // How far ahead of its due time a text or image switch, or an animation frame, is
+    // started.
+    uint32_t textLeadMs;
+    uint32_t imageLeadMs;
+    uint32_t frameLeadMs;
+};
+
+class DotMatrixPlaylist
+{
+public:
+    explicit DotMatrixPlaylist(DotMatrixClient &panel);
+
+    // Add items to the end of the playlist, which loops. A duration of 0 is the item's
+    // natural length: one pass of scrolling text, one loop of an animation, or
+    // DOTMATRIX_PLAYLIST_IMAGE_MS. DEVICE_NO_RESOURCES when the playlist is full.
+    //
+    // The text is not copied. The asset is read in place in flash, which is fine until
+    // the store is erased.
+    int addText(const char *text, uint32_t durationMs = 0);
+    int addAsset(const DotMatrixAsset &asset, uint32_t durationMs = 0);
+    int addDrawing(DotMatrixPlaylistDraw draw, void *context, uint32_t durationMs = 0);
+    void clear();
+    uint32_t count() const;
+
+    // Starts the fiber that plays the list. It waits while the panel is not connected or
+    // the playlist is paused, and starts again from the next item.
+    void start();
+    void setPaused(bool paused);
+
+    DotMatrixPlaylistStats stats() const;
+    void resetStats();
+
+private:
+    enum Kind : uint8_t
+    {
+        TEXT,
+        ASSET,
+        DRAWING,
+    };
+
+    struct Item
+    {
+        Kind kind;
+        uint32_t durationMs;
+        const char *text;
+        DotMatrixAsset asset;
+        DotMatrixPlaylistDraw draw;
+        void *context;
+    };
+
+    // An item prepared ahead of its turn. There are two, for the one showing and the one
+    // next, so an animation's stream is never reopened while it is being sent.
+    struct Slot
+    {
+        Item item;
+        uint32_t index;
+        uint32_t durationMs;
+        bool showsText;
+        ManagedString text;
+        DotMatrixAssetStream stream;
+    };
+
+    DotMatrixClient &panel_;
+
+    Item items_[DOTMATRIX_PLAYLIST_MAX_ITEMS];
+    uint32_t count_;
+    uint32_t next_;
+    volatile bool paused_;
+    bool started_;
+
+    Slot slots_[2];
+    uint32_t textLeadMs_;
+    uint32_t imageLeadMs_;
+    uint32_t frameLeadMs_;
+
+    DotMatrixPlaylistStats stats_;
+    uint32_t totalErrorMs_;
+
+    int add(const Item &item);
+    bool playable() const;
+    // Sleeps until `ms`; false if the panel went away or the playlist was paused.
+    bool waitUntil(uint32_t ms);
+
+    // Prepares the next item that can be shown into `slot`.
+    bool prepareNext(Slot &slot);
+    int prepare(Slot &slot);
+    uint32_t leadMs(const Slot &slot) const;
+    void begin(Slot &slot);
+    void record(const Slot &slot, uint32_t issuedMs, uint32_t dueMs);
+    // Sends an animation's frames after the first, up to `endMs`.
+    bool animate(Slot &slot, uint32_t startMs, uint32_t endMs);
+
+    static void fiberEntry(void *param);
+    void run();
+};
@@ -0,0 +1,431 @@
+#include "DotMatrixProtocol.h"
+#include "DotMatrixFont.h"
+
+#include <string.h>
+
+namespace
+{
+// CRC32 lookup table (IEEE 802.3 polynomial: 0xEDB88320)
+static const uint32_t crc32_table[256] = {
+    0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f, 0xe963a535, 0x9e6495a3,
+    0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988, 0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91,
+    0x1db71064, 0x6ab020f2, 0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+    0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9, 0xfa0f3d63, 0x8d080df5,
+    0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172, 0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b,
+    0x35b5a8fa, 0x42b2986c, 0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+    0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423, 0xcfba9599, 0xb8bda50f,
+    0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924, 0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d,
+    0x76dc4190, 0x01db7106, 0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+    0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d, 0x91646c97, 0xe6635c01,
+    0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e, 0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457,
+    0x65b0d9c6, 0x12b7e950, 0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+    0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7, 0xa4d1c46d, 0xd3d6f4fb,
+    0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0, 0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9,
+    0x5005713c, 0x270241aa, 0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+    0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81, 0xb7bd5c3b, 0xc0ba6cad,
+    0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a, 0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683,
+    0xe3630b12, 0x94643b84, 0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+    0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb, 0x196c3671, 0x6e6b06e7,
+    0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc, 0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5,
+    0xd6d6a3e8, 0xa1d1937e, 0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+    0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55, 0x316e8eef, 0x4669be79,
+    0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236, 0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f,
+    0xc5ba3bbe, 0xb2bd0b28, 0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+    0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f, 0x72076785, 0x05005713,
+    0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38, 0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21,
+    0x86d3d2d4, 0xf1d4e242, 0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+    0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69, 0x616bffd3, 0x166ccf45,
+    0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2, 0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db,
+    0xaed16a4a, 0xd9d65adc, 0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+    0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693, 0x54de5729, 0x23d967bf,
+    0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94, 0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
+};
+
+struct ImageHeader
+{
+    uint16_t packet_length;
+    uint8_t command;
+    uint8_t subcommand;
+    uint8_t first_or_continuation;
+    uint32_t image_data_length;
+} __attribute__((packed));
+
+struct TextHeader
+{
+    uint16_t total_len;
+    uint8_t static_3;
+    uint8_t static_0;
+    uint8_t static_0_1;
+    uint32_t packet_length;
+    uint32_t crc;
+    uint8_t static_0_2;
+    uint8_t static_0_3;
+    uint8_t static_12;
+} __attribute__((packed));
+
+struct TextMetadata
+{
+    uint16_t number_of_characters;
+    uint8_t static_0;
+    uint8_t static_1;
+    uint8_t text_mode;
+    uint8_t text_speed;
+    uint8_t text_color_mode;
+    uint8_t text_color_r;
+    uint8_t text_color_g;
+    uint8_t text_color_b;
+    uint8_t text_color_bg_mode;
+    uint8_t bg_color_r;
+    uint8_t bg_color_g;
+    uint8_t bg_color_b;
+} __attribute__((packed));
+
+struct ScoreboardPacket
+{
+    uint8_t command_start;
+    uint8_t placeholder;
+    uint8_t command_id;
+    uint8_t command_specifier;
+    uint16_t score0;
+    uint16_t score1;
+} __attribute__((packed));
+
+struct ImageModePacket
+{
+    uint8_t packet_length;
+    uint8_t placeholder;
+    uint8_t command_id;
+    uint8_t mode;
+    uint8_t enable_diy;
+} __attribute__((packed));
+
+struct PixelPacket
+{
+    uint8_t packet_length;
+    uint8_t placeholder;
+    uint8_t command_id;
+    uint8_t command_specifier;
+    uint8_t static_0;
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+    uint8_t x;
+    uint8_t y;
+} __attribute__((packed));
+
+static_assert(sizeof(ImageHeader) == DOTMATRIX_IMAGE_HEADER_SIZE, "image header layout");
+static_assert(sizeof(TextHeader) + sizeof(TextMetadata) == DOTMATRIX_TEXT_PREAMBLE_SIZE,
+              "text preamble layout");
+static_assert(sizeof(ScoreboardPacket) == DOTMATRIX_SCORE_PACKET_SIZE, "score packet layout");
+static_assert(sizeof(ImageModePacket) == DOTMATRIX_IMAGE_MODE_PACKET_SIZE, "mode packet layout");
+static_assert(sizeof(PixelPacket) == DOTMATRIX_PIXEL_PACKET_SIZE, "pixel packet layout");
+
+} // namespace
+
+uint32_t dotmatrix_crc32_update(uint32_t crc, const uint8_t *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+        crc = crc32_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+uint32_t dotmatrix_crc32(const uint8_t *data, size_t length)
+{
+    return ~dotmatrix_crc32_update(DOTMATRIX_CRC32_INIT, data, length);
+}
+
+size_t dotmatrix_encode_image_mode(uint8_t *dst, bool diy)
+{
+    const ImageModePacket pkt = {
+        DOTMATRIX_IMAGE_MODE_PACKET_SIZE,
+        0,
+        4,
+        1,
+        (uint8_t)(diy ? 1 : 0), // 1 = enable DIY
+    };
+    memcpy(dst, &pkt, sizeof(pkt));
+    return sizeof(pkt);
+}
+
+size_t dotmatrix_encode_pixel(uint8_t *dst, uint8_t x, uint8_t y, uint8_t r, uint8_t g, uint8_t b)
+{
+    const PixelPacket pkt = {
+        DOTMATRIX_PIXEL_PACKET_SIZE,
+        0,
+        5,
+        1,
+        0,
+        r,
+        g,
+        b,
+        x,
+        y,
+    };
+    memcpy(dst, &pkt, sizeof(pkt));
+    return sizeof(pkt);
+}
+
+size_t dotmatrix_encode_score(uint8_t *dst, uint16_t score0, uint16_t score1)
+{
+    const ScoreboardPacket pkt = {
+        DOTMATRIX_SCORE_PACKET_SIZE,
+        0,
+        10,
+        128,
+        score0,
+        score1,
+    };
+    memcpy(dst, &pkt, sizeof(pkt));
+    return sizeof(pkt);
+}
+
+size_t dotmatrix_encode_image_header(uint8_t *dst, uint32_t image_bytes)
+{
+    return dotmatrix_encode_image_chunk_header(dst, image_bytes, image_bytes, false);
+}
+
+size_t dotmatrix_encode_image_chunk_header(uint8_t *dst,
+                                           uint32_t chunk_bytes,
+                                           uint32_t image_bytes,
+                                           bool continuation)
+{
+    if (chunk_bytes > DOTMATRIX_IMAGE_MAX_DATA_SIZE || chunk_bytes > image_bytes)
+        return 0;
+
+    const ImageHeader hdr = {
+        (uint16_t)(chunk_bytes + DOTMATRIX_IMAGE_HEADER_SIZE),
+        0,
+        0,
+        (uint8_t)(continuation ? 2 : 0),
+        image_bytes,
+    };
+    memcpy(dst, &hdr, sizeof(hdr));
+    return sizeof(hdr);
+}
+
+size_t dotmatrix_encode_text_preamble(uint8_t *dst,
+                                      const char *text,
+                                      uint16_t characters,
+                                      const DotMatrixTextStyle &style)
+{
+    const TextMetadata meta = {
+        characters,
+        0,
+        1,
+        style.mode,
+        style.speed,
+        style.colorMode,
+        style.r,
+        style.g,
+        style.b,
+        style.bgMode,
+        style.bgR,
+        style.bgG,
+        style.bgB,
+    };
+
+    // The CRC covers the metadata and every glyph, which are not in dst yet.
+    uint32_t crc = dotmatrix_crc32_update(DOTMATRIX_CRC32_INIT, (const uint8_t *)&meta, sizeof(meta));
+    for (uint16_t i = 0; i < characters; i++)
+    {
+        crc = dotmatrix_crc32_update(crc, separator, SEPARATOR_LEN);
+        crc = dotmatrix_crc32_update(crc, &font_data[glyph_index(text[i]) * BITMAP_SIZE], BITMAP_SIZE);
+    }
+
+    const uint32_t payload_size = sizeof(TextMetadata) + characters * (SEPARATOR_LEN + BITMAP_SIZE);
+    const TextHeader hdr = {
+        (uint16_t)(payload_size + sizeof(TextHeader)),
+        3,
+        0,
+        0,
+        payload_size,
+        ~crc,
+        0,
+        0,
+        12,
+    };
+    memcpy(dst, &hdr, sizeof(hdr));
+    memcpy(dst + sizeof(hdr), &meta, sizeof(meta));
+
+    return DOTMATRIX_TEXT_PREAMBLE_SIZE;
+}
+
+size_t dotmatrix_encode_text(uint8_t *dst,
+                             size_t capacity,
+                             const char *text,
+                             size_t length,
+                             const DotMatrixTextStyle &style,
+                             uint16_t &characters)
+{
+    characters = 0;
+
+    // The packet's total length is a 16 bit field.
+    if (capacity > DOTMATRIX_TEXT_MAX_PACKET_SIZE)
+        capacity = DOTMATRIX_TEXT_MAX_PACKET_SIZE;
+    if (capacity < DOTMATRIX_TEXT_PREAMBLE_SIZE)
+        return 0;
+
+    // Space is counted down from what is left rather than by summing sizes, so
+    // no input length can wrap the check.
+    const size_t glyph_bytes = SEPARATOR_LEN + BITMAP_SIZE;
+    size_t remaining = capacity - DOTMATRIX_TEXT_PREAMBLE_SIZE;
+    uint8_t *write_ptr = dst + DOTMATRIX_TEXT_PREAMBLE_SIZE;
+
+    for (size_t i = 0; i < length && remaining >= glyph_bytes; i++)
+    {
+        memcpy(write_ptr, separator, SEPARATOR_LEN);
+        write_ptr += SEPARATOR_LEN;
+
+        memcpy(write_ptr, &font_data[glyph_index(text[i]) * BITMAP_SIZE], BITMAP_SIZE);
+        write_ptr += BITMAP_SIZE;
+
+        remaining -= glyph_bytes;
+        characters++;
+    }
+
+    dotmatrix_encode_text_preamble(dst, text, characters, style);
+    return write_ptr - dst;
+}
+
+namespace
+{
+static size_t decode_image_mode(const uint8_t *src, size_t length, DotMatrixPacket &packet)
+{
+    ImageModePacket pkt;
+    if (length < sizeof(pkt))
+        return 0;
+    memcpy(&pkt, src, sizeof(pkt));
+    if (pkt.packet_length != sizeof(pkt) || pkt.placeholder != 0 || pkt.enable_diy > 1)
+        return 0;
+
+    packet.type = DOTMATRIX_PACKET_IMAGE_MODE;
+    packet.imageMode.diy = pkt.enable_diy == 1;
+    return sizeof(pkt);
+}
+
+static size_t decode_pixel(const uint8_t *src, size_t length, DotMatrixPacket &packet)
+{
+    PixelPacket pkt;
+    if (length < sizeof(pkt))
+        return 0;
+    memcpy(&pkt, src, sizeof(pkt));
+    if (pkt.packet_length != sizeof(pkt) || pkt.placeholder != 0 || pkt.static_0 != 0)
+        return 0;
+
+    packet.type = DOTMATRIX_PACKET_PIXEL;
+    packet.pixel.x = pkt.x;
+    packet.pixel.y = pkt.y;
+    packet.pixel.r = pkt.r;
+    packet.pixel.g = pkt.g;
+    packet.pixel.b = pkt.b;
+    return sizeof(pkt);
+}
+
+static size_t decode_score(const uint8_t *src, size_t length, DotMatrixPacket &packet)
+{
+    ScoreboardPacket pkt;
+    if (length < sizeof(pkt))
+        return 0;
+    memcpy(&pkt, src, sizeof(pkt));
+    if (pkt.command_start != sizeof(pkt) || pkt.placeholder != 0)
+        return 0;
+
+    packet.type = DOTMATRIX_PACKET_SCORE;
+    packet.score.score0 = pkt.score0;
+    packet.score.score1 = pkt.score1;
+    return sizeof(pkt);
+}
+
+static size_t decode_image(const uint8_t *src, size_t length, DotMatrixPacket &packet)
+{
+    ImageHeader hdr;
+    if (length < sizeof(hdr))
+        return 0;
+    memcpy(&hdr, src, sizeof(hdr));
+    if (hdr.packet_length < sizeof(hdr) || hdr.packet_length > length)
+        return 0;
+
+    const uint32_t chunk_bytes = hdr.packet_length - sizeof(hdr);
+    if ((hdr.first_or_continuation != 0 && hdr.first_or_continuation != 2) ||
+        chunk_bytes > hdr.image_data_length)
+        return 0;
+
+    packet.type = DOTMATRIX_PACKET_IMAGE;
+    packet.image.chunkBytes = chunk_bytes;
+    packet.image.imageBytes = hdr.image_data_length;
+    packet.image.continuation = hdr.first_or_continuation == 2;
+    packet.image.data = src + sizeof(hdr);
+    return hdr.packet_length;
+}
+
+static size_t decode_text(const uint8_t *src, size_t length, DotMatrixPacket &packet)
+{
+    TextHeader hdr;
+    TextMetadata meta;
+    if (length < DOTMATRIX_TEXT_PREAMBLE_SIZE)
+        return 0;
+    memcpy(&hdr, src, sizeof(hdr));
+    memcpy(&meta, src + sizeof(hdr), sizeof(meta));
+
+    if (hdr.static_0_1 != 0 || hdr.static_0_2 != 0 || hdr.static_0_3 != 0 ||
+        hdr.static_12 != 12 || meta.static_0 != 0 || meta.static_1 != 1)
+        return 0;
+
+    // Every length field must agree with the character count.
+    const size_t glyph_bytes = SEPARATOR_LEN + BITMAP_SIZE;
+    const uint32_t payload_size = sizeof(TextMetadata) + meta.number_of_characters * glyph_bytes;
+    if (hdr.packet_length != payload_size || hdr.total_len != payload_size + sizeof(TextHeader) ||
+        hdr.total_len > length)
+        return 0;
+
+    const uint8_t *glyphs = src + DOTMATRIX_TEXT_PREAMBLE_SIZE;
+    uint32_t crc = dotmatrix_crc32_update(DOTMATRIX_CRC32_INIT, (const uint8_t *)&meta, sizeof(meta));
+    for (uint16_t i = 0; i < meta.number_of_characters; i++)
+    {
+        if (memcmp(glyphs + i * glyph_bytes, separator, SEPARATOR_LEN) != 0)
+            return 0;
+    }
+    crc = dotmatrix_crc32_update(crc, glyphs, meta.number_of_characters * glyph_bytes);
+    if (~crc != hdr.crc)
+        return 0;
+
+    packet.type = DOTMATRIX_PACKET_TEXT;
+    packet.text.characters = meta.number_of_characters;
+    packet.text.style.mode = meta.text_mode;
+    packet.text.style.speed = meta.text_speed;
+    packet.text.style.colorMode = meta.text_color_mode;
+    packet.text.style.r = meta.text_color_r;
+    packet.text.style.g = meta.text_color_g;
+    packet.text.style.b = meta.text_color_b;
+    packet.text.style.bgMode = meta.text_color_bg_mode;
+    packet.text.style.bgR = meta.bg_color_r;
+    packet.text.style.bgG = meta.bg_color_g;
+    packet.text.style.bgB = meta.bg_color_b;
+    packet.text.glyphs = glyphs + SEPARATOR_LEN;
+    return hdr.total_len;
+}
+} // namespace
+
+size_t dotmatrix_decode_packet(const uint8_t *src, size_t length, DotMatrixPacket &packet)
+{
+    if (length < 4)
+        return 0;
+
+    // Bytes 2 and 3 are the command and its specifier in every packet type.
+    const uint16_t command = src[2] << 8 | src[3];
+    switch (command)
+    {
+        case 4 << 8 | 1:
+            return decode_image_mode(src, length, packet);
+        case 5 << 8 | 1:
+            return decode_pixel(src, length, packet);
+        case 10 << 8 | 128:
+            return decode_score(src, length, packet);
+        case 0 << 8 | 0:
+            return decode_image(src, length, packet);
+        case 3 << 8 | 0:
+            return decode_text(src, length, packet);
+        default:
+            return 0;
+    }
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Packet encoders for the panel's write characteristic. They only write to the
+// buffer they are given and have no CODAL or SoftDevice dependency, so the wire
+// format can be built off-target and compared with the Python reference in test.py.
+
+// Bytes in front of the pixel data of an image packet.
+constexpr uint32_t DOTMATRIX_IMAGE_HEADER_SIZE = 9;
+
+// Bytes in front of the glyph bitmaps of a text packet (header and metadata).
+constexpr uint32_t DOTMATRIX_TEXT_PREAMBLE_SIZE = 30;
+
+// Packet lengths are 16 bit fields on the wire.
+constexpr uint32_t DOTMATRIX_TEXT_MAX_PACKET_SIZE = 0xFFFF;
+constexpr uint32_t DOTMATRIX_IMAGE_MAX_DATA_SIZE = 0xFFFF - DOTMATRIX_IMAGE_HEADER_SIZE;
+
+// Images larger than this go out as several packets, each with its own header; all but
+// the first are flagged as continuations.
+constexpr uint32_t DOTMATRIX_IMAGE_CHUNK_SIZE = 4096;
+
+constexpr uint32_t DOTMATRIX_PIXEL_PACKET_SIZE = 10;
+constexpr uint32_t DOTMATRIX_SCORE_PACKET_SIZE = 8;
+constexpr uint32_t DOTMATRIX_IMAGE_MODE_PACKET_SIZE = 5;
+
+// Options carried in a text packet. Mode and colour mode values match
+// TextMode and TextColorMode in test.py.
+struct DotMatrixTextStyle
+{
+    uint8_t mode;
+    uint8_t speed;
+    uint8_t colorMode;
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+    uint8_t bgMode;
+    uint8_t bgR;
+    uint8_t bgG;
+    uint8_t bgB;
+};
+
+uint32_t dotmatrix_crc32(const uint8_t *data, size_t length);
+
+// Incremental form of dotmatrix_crc32(): start from DOTMATRIX_CRC32_INIT and
+// invert the result once all data has been fed in.
+constexpr uint32_t DOTMATRIX_CRC32_INIT = 0xFFFFFFFF;
+uint32_t dotmatrix_crc32_update(uint32_t crc, const uint8_t *data, size_t length);
+
+// Each encoder writes one packet to dst and returns its length, or 0 when the
+// request cannot be expressed on the wire.
+size_t dotmatrix_encode_image_mode(uint8_t *dst, bool diy);
+size_t dotmatrix_encode_pixel(uint8_t *dst, uint8_t x, uint8_t y, uint8_t r, uint8_t g, uint8_t b);
+size_t dotmatrix_encode_score(uint8_t *dst, uint16_t score0, uint16_t score1);
+size_t dotmatrix_encode_image_header(uint8_t *dst, uint32_t image_bytes);
+
+// Header of one packet of a chunked image: `chunk_bytes` of the `image_bytes` total.
+size_t dotmatrix_encode_image_chunk_header(uint8_t *dst,
+                                           uint32_t chunk_bytes,
+                                           uint32_t image_bytes,
+                                           bool continuation);
+
+// Header and metadata of a text packet carrying the first `characters` characters
+// of text. On the wire each character then follows as `separator` and its
+// font_data bitmap, so the glyphs can be streamed straight from flash.
+size_t dotmatrix_encode_text_preamble(uint8_t *dst,
+                                      const char *text,
+                                      uint16_t characters,
+                                      const DotMatrixTextStyle &style);
+
+// Text that does not fit in `capacity` bytes is cut at a glyph boundary;
+// `characters` receives the number of glyphs kept.
+size_t dotmatrix_encode_text(uint8_t *dst,
+                             size_t capacity,
+                             const char *text,
+                             size_t length,
+                             const DotMatrixTextStyle &style,
+                             uint16_t &characters);
+
+enum DotMatrixPacketType : uint8_t
+{
+    DOTMATRIX_PACKET_IMAGE_MODE,
+    DOTMATRIX_PACKET_PIXEL,
+    DOTMATRIX_PACKET_SCORE,
+    DOTMATRIX_PACKET_IMAGE,
+    DOTMATRIX_PACKET_TEXT,
+};
+
+// One packet read back off the wire. Pointers refer into the decoded buffer.
+struct DotMatrixPacket
+{
+    struct ImageMode
+    {
+        bool diy;
+    };
+
+    struct Pixel
+    {
+        uint8_t x;
+        uint8_t y;
+        uint8_t r;
+        uint8_t g;
+        uint8_t b;
+    };
+
+    struct Score
+    {
+        uint16_t score0;
+        uint16_t score1;
+    };
+
+    struct Image
+    {
+        uint32_t chunkBytes;
+        uint32_t imageBytes;
+        bool continuation;
+        const uint8_t *data;
+    };
+
+    // Glyph i is the BITMAP_SIZE bytes at glyphs + i * (SEPARATOR_LEN + BITMAP_SIZE).
+    struct Text
+    {
+        uint16_t characters;
+        DotMatrixTextStyle style;
+        const uint8_t *glyphs;
+    };
+
+    DotMatrixPacketType type;
+    union
+    {
+        ImageMode imageMode;
+        Pixel pixel;
+        Score score;
+        Image image;
+        Text text;
+    };
+};
+
+// Decodes the packet at the start of src, as the panel would read it, and returns its
+// length. Returns 0 when src holds less than a whole packet or the packet is not one
+// the encoders above could have written: unknown command, bad static fields, lengths
+// that disagree, a missing glyph separator or a wrong CRC.
+size_t dotmatrix_decode_packet(const uint8_t *src, size_t length, DotMatrixPacket &packet);
@@ -0,0 +1,449 @@
+#include "DotMatrixRadio.h"
+#include "DotMatrixLog.h"
+
+#include <string.h>
+
+namespace
+{
+// A sender silent for this long is treated as new when it comes back, since it has
+// probably restarted with a different sequence number.
+constexpr uint32_t SENDER_TIMEOUT_MS = 10000;
+
+// Completed sequence numbers remembered per sender, for dropping repeats.
+constexpr int32_t SEQUENCE_WINDOW = 32;
+
+static uint32_t now_ms()
+{
+    return (uint32_t)system_timer_current_time();
+}
+
+static uint32_t read_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void write_le32(uint8_t *p, uint32_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+} // namespace
+
+DotMatrixRadioGateway::DotMatrixRadioGateway(MicroBit &uBit, DotMatrixClient &panel)
+    : uBit_(uBit)
+    , panel_(panel)
+    , started_(false)
+    , drawn_(false)
+    , pendingCommand_(0)
+    , score0_(0)
+    , score1_(0)
+    , imageMode_(false)
+    , connections_(0)
+{
+    memset(senders_, 0, sizeof(senders_));
+    memset(text_, 0, sizeof(text_));
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+int DotMatrixRadioGateway::start()
+{
+    if (started_)
+        return DEVICE_OK;
+
+    const int result = uBit_.radio.enable();
+    if (result != DEVICE_OK)
+    {
+        DOTMATRIX_LOG_ERROR("radio gateway: radio enable failed: %d", result);
+        return result;
+    }
+
+    uBit_.radio.setGroup(DOTMATRIX_RADIO_GROUP);
+    uBit_.messageBus.listen(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_DATAGRAM, this,
+                            &DotMatrixRadioGateway::onDatagram);
+
+    started_ = true;
+    create_fiber(fiberEntry, this);
+    return DEVICE_OK;
+}
+
+DotMatrixRadioStats DotMatrixRadioGateway::stats() const
+{
+    return stats_;
+}
+
+void DotMatrixRadioGateway::onDatagram(MicroBitEvent)
+{
+    PacketBuffer packet = uBit_.radio.datagram.recv();
+    if (packet.length() > 0)
+        receive(packet.getBytes(), packet.length());
+}
+
+void DotMatrixRadioGateway::receive(const uint8_t *datagram, int length)
+{
+    stats_.datagrams++;
+
+    if (length <= DOTMATRIX_RADIO_HEADER_SIZE || length > MICROBIT_RADIO_MAX_PACKET_SIZE)
+    {
+        stats_.malformed++;
+        return;
+    }
+
+    const uint16_t id = datagram[0] | (datagram[1] << 8);
+    const uint8_t sequence = datagram[2];
+    const uint8_t index = datagram[3] >> 4;
+    const uint8_t fragments = (datagram[3] & 0x0F) + 1;
+    const uint8_t *data = &datagram[DOTMATRIX_RADIO_HEADER_SIZE];
+    const uint32_t dataLength = length - DOTMATRIX_RADIO_HEADER_SIZE;
+
+    // Only the last fragment may be short.
+    if (index >= fragments ||
+        (index < fragments - 1 && dataLength != DOTMATRIX_RADIO_FRAGMENT_DATA))
+    {
+        stats_.malformed++;
+        return;
+    }
+
+    Sender &sender = senderFor(id);
+    sender.lastHeardMs = now_ms();
+
+    if (seen(sender, sequence))
+    {
+        stats_.duplicates++;
+        return;
+    }
+
+    if (sender.received == 0 || sender.sequence != sequence || sender.fragments != fragments)
+    {
+        if (sender.received != 0)
+            stats_.incomplete++;
+
+        sender.sequence = sequence;
+        sender.fragments = fragments;
+        sender.received = 0;
+        sender.length = 0;
+    }
+
+    const uint16_t bit = 1 << index;
+    if (sender.received & bit)
+    {
+        stats_.duplicates++;
+        return;
+    }
+
+    memcpy(&sender.data[index * DOTMATRIX_RADIO_FRAGMENT_DATA], data, dataLength);
+    sender.received |= bit;
+    if (index == fragments - 1)
+        sender.length = index * DOTMATRIX_RADIO_FRAGMENT_DATA + dataLength;
+
+    if (sender.received == (1u << fragments) - 1)
+        complete(sender);
+}
+
+DotMatrixRadioGateway::Sender &DotMatrixRadioGateway::senderFor(uint16_t id)
+{
+    const uint32_t now = now_ms();
+    Sender *oldest = &senders_[0];
+
+    for (Sender &sender : senders_)
+    {
+        if (sender.active && sender.id == id)
+        {
+            if (now - sender.lastHeardMs > SENDER_TIMEOUT_MS)
+            {
+                sender.haveSequence = false;
+                sender.received = 0;
+            }
+            return sender;
+        }
+
+        if (!sender.active)
+            oldest = &sender;
+        else if (oldest->active && now - sender.lastHeardMs > now - oldest->lastHeardMs)
+            oldest = &sender;
+    }
+
+    if (oldest->active && oldest->received != 0)
+        stats_.incomplete++;
+
+    oldest->id = id;
+    oldest->active = true;
+    oldest->haveSequence = false;
+    oldest->received = 0;
+    return *oldest;
+}
+
+bool DotMatrixRadioGateway::seen(const Sender &sender, uint8_t sequence) const
+{
+    if (!sender.haveSequence)
+        return false;
+
+    const int32_t behind = (int8_t)(sender.lastSequence - sequence);
+    if (behind < 0 || behind >= SEQUENCE_WINDOW)
+        return false;
+
+    return sender.recent & (1u << behind);
+}
+
+void DotMatrixRadioGateway::complete(Sender &sender)
+{
+    const uint8_t sequence = sender.sequence;
+    const int32_t ahead = (int8_t)(sequence - sender.lastSequence);
+
+    if (!sender.haveSequence || ahead <= -SEQUENCE_WINDOW)
+    {
+        // First message, or the sender restarted its numbering.
+        sender.recent = 1;
+        sender.lastSequence = sequence;
+        sender.haveSequence = true;
+    }
+    else if (ahead > 0)
+    {
+        sender.recent = ahead >= SEQUENCE_WINDOW ? 1 : (sender.recent << ahead) | 1;
+        sender.lastSequence = sequence;
+    }
+    else
+    {
+        sender.recent |= 1u << -ahead;
+    }
+
+    sender.received = 0;
+    stats_.messages++;
+
+    if (!apply(sender.data, sender.length))
+        stats_.malformed++;
+}
+
+bool DotMatrixRadioGateway::apply(const uint8_t *message, uint32_t length)
+{
+    if (length == 0)
+        return false;
+
+    const uint8_t *args = message + 1;
+    const uint32_t argsLength = length - 1;
+
+    switch (message[0])
+    {
+    case DOTMATRIX_RADIO_PIXELS:
+    {
+        if (argsLength < 3)
+            return false;
+
+        const uint8_t x = args[0], y = args[1], count = args[2];
+        if (!DotMatrixPanel::contains(x, y) || count == 0 ||
+            y * DotMatrixPanel::width + x + count > DotMatrixPanel::pixels ||
+            argsLength != 3 + count * 3u)
+            return false;
+
+        panel_.setPixels(x, y, &args[3], count);
+        drawn_ = true;
+        return true;
+    }
+
+    case DOTMATRIX_RADIO_TILE:
+    {
+        if (argsLength < 4)
+            return false;
+
+        const uint8_t x = args[0], y = args[1], w = args[2], h = args[3];
+        if (w == 0 || h == 0 || x + w > (int)DotMatrixPanel::width ||
+            y + h > (int)DotMatrixPanel::height ||
+            argsLength != 4 + w * h * 3u)
+            return false;
+
+        for (uint32_t row = 0; row < h; row++)
+            panel_.setPixels(x, y + row, &args[4 + row * w * 3], w);
+        drawn_ = true;
+        return true;
+    }
+
+    case DOTMATRIX_RADIO_TEXT:
+    {
+        uint32_t characters = argsLength;
+        if (characters > DOTMATRIX_TEXT_MAX_CHARACTERS)
+            characters = DOTMATRIX_TEXT_MAX_CHARACTERS;
+
+        memcpy(text_, args, characters);
+        text_[characters] = '\0';
+        pendingCommand_ = DOTMATRIX_RADIO_TEXT;
+        // Drawing so far stays in the framebuffer for the next image, but the text is
+        // what the panel shows now.
+        drawn_ = false;
+        return true;
+    }
+
+    case DOTMATRIX_RADIO_SCORE:
+        if (argsLength != 8)
+            return false;
+
+        score0_ = read_le32(&args[0]);
+        score1_ = read_le32(&args[4]);
+        pendingCommand_ = DOTMATRIX_RADIO_SCORE;
+        drawn_ = false;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+void DotMatrixRadioGateway::fiberEntry(void *param)
+{
+    static_cast<DotMatrixRadioGateway *>(param)->run();
+}
+
+void DotMatrixRadioGateway::run()
+{
+    while (true)
+    {
+        fiber_sleep(DOTMATRIX_RADIO_BATCH_MS);
+
+        if (!panel_.isReady())
+            continue;
+
+        const uint32_t connections = panel_.stats().connections;
+        if (connections != connections_)
+        {
+            connections_ = connections;
+            imageMode_ = false;
+        }
+
+        const uint8_t command = pendingCommand_;
+        pendingCommand_ = 0;
+
+        if (command == DOTMATRIX_RADIO_TEXT)
+        {
+            ManagedString text(text_);
+            panel_.writeText(text);
+        }
+        else if (command == DOTMATRIX_RADIO_SCORE)
+        {
+            panel_.writeScore(score0_, score1_);
+        }
+
+        if (command)
+        {
+            imageMode_ = false;
+            stats_.batches++;
+        }
+
+        if (drawn_)
+        {
+            drawn_ = false;
+            if (!imageMode_)
+            {
+                panel_.setImageModeDiy();
+                panel_.markDirty(0, 0, DotMatrixPanel::width, DotMatrixPanel::height);
+                imageMode_ = true;
+            }
+            panel_.writeDirty();
+            stats_.batches++;
+        }
+
+        // Whatever arrives while this batch is on the air goes into the next one.
+        panel_.waitForIdle();
+    }
+}
+
+DotMatrixRadioSender::DotMatrixRadioSender(MicroBit &uBit, uint8_t repeats)
+    : uBit_(uBit)
+    , repeats_(repeats ? repeats : 1)
+    , id_(0)
+    , sequence_(0)
+{
+}
+
+int DotMatrixRadioSender::start()
+{
+    const uint32_t serial = microbit_serial_number();
+    id_ = serial ^ (serial >> 16);
+    // A random start keeps a restarted sender's messages from looking like repeats.
+    sequence_ = uBit_.random(256);
+
+    const int result = uBit_.radio.enable();
+    if (result != DEVICE_OK)
+        return result;
+
+    uBit_.radio.setGroup(DOTMATRIX_RADIO_GROUP);
+    return DEVICE_OK;
+}
+
+int DotMatrixRadioSender::pixels(uint8_t x, uint8_t y, const uint8_t *rgb, uint32_t count)
+{
+    if (count == 0 || count > 255)
+        return DEVICE_INVALID_PARAMETER;
+
+    const uint8_t header[] = {x, y, (uint8_t)count};
+    return send(DOTMATRIX_RADIO_PIXELS, header, sizeof(header), rgb, count * 3);
+}
+
+int DotMatrixRadioSender::tile(uint8_t x, uint8_t y, uint8_t w, uint8_t h, const uint8_t *rgb)
+{
+    const uint8_t header[] = {x, y, w, h};
+    return send(DOTMATRIX_RADIO_TILE, header, sizeof(header), rgb, w * h * 3u);
+}
+
+int DotMatrixRadioSender::text(const char *text)
+{
+    uint32_t length = strlen(text);
+    if (length > DOTMATRIX_TEXT_MAX_CHARACTERS)
+        length = DOTMATRIX_TEXT_MAX_CHARACTERS;
+
+    return send(DOTMATRIX_RADIO_TEXT, nullptr, 0, (const uint8_t *)text, length);
+}
+
+int DotMatrixRadioSender::score(uint32_t score0, uint32_t score1)
+{
+    uint8_t scores[8];
+    write_le32(&scores[0], score0);
+    write_le32(&scores[4], score1);
+    return send(DOTMATRIX_RADIO_SCORE, scores, sizeof(scores), nullptr, 0);
+}
+
+int DotMatrixRadioSender::send(uint8_t command, const uint8_t *header, uint32_t headerLength,
+                               const uint8_t *data, uint32_t dataLength)
+{
+    static uint8_t message[DOTMATRIX_RADIO_MAX_MESSAGE];
+
+    const uint32_t length = 1 + headerLength + dataLength;
+    if (length > sizeof(message))
+        return DEVICE_INVALID_PARAMETER;
+
+    message[0] = command;
+    if (headerLength)
+        memcpy(&message[1], header, headerLength);
+    if (dataLength)
+        memcpy(&message[1 + headerLength], data, dataLength);
+
+    const uint32_t fragments =
+        (length + DOTMATRIX_RADIO_FRAGMENT_DATA - 1) / DOTMATRIX_RADIO_FRAGMENT_DATA;
+    const uint8_t sequence = sequence_++;
+
+    // Repeating the whole message rather than each datagram in turn spreads the copies
+    // out, so one burst of interference is less likely to take all of them.
+    for (uint32_t repeat = 0; repeat < repeats_; repeat++)
+    {
+        for (uint32_t index = 0; index < fragments; index++)
+        {
+            const uint32_t offset = index * DOTMATRIX_RADIO_FRAGMENT_DATA;
+            uint32_t size = length - offset;
+            if (size > DOTMATRIX_RADIO_FRAGMENT_DATA)
+                size = DOTMATRIX_RADIO_FRAGMENT_DATA;
+
+            uint8_t datagram[MICROBIT_RADIO_MAX_PACKET_SIZE];
+            datagram[0] = id_;
+            datagram[1] = id_ >> 8;
+            datagram[2] = sequence;
+            datagram[3] = (index << 4) | (fragments - 1);
+            memcpy(&datagram[DOTMATRIX_RADIO_HEADER_SIZE], &message[offset], size);
+
+            const int result =
+                uBit_.radio.datagram.send(datagram, DOTMATRIX_RADIO_HEADER_SIZE + size);
+            if (result != DEVICE_OK)
+                return result;
+        }
+    }
+
+    return DEVICE_OK;
+}
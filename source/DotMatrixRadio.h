@@ -0,0 +1,146 @@
+#pragma once
+
+#include "MicroBit.h"
+#include "DotMatrix.h"
+
+// Draw commands relayed over the micro:bit radio to a gateway that holds the BLE link.
+//
+// A command (a "message") is split into fragments that each fit one datagram:
+//
+//   [sender:2][sequence:1][fragment:1][data...]
+//
+// sender identifies the micro:bit, sequence numbers its messages, and the fragment byte
+// holds the fragment index in the high nibble and the fragment count - 1 in the low one.
+// Reassembled, a message starts with one of the command bytes below.
+
+// [x][y][count][RGB888 x count]: pixels from (x, y) along the row, wrapping.
+#define DOTMATRIX_RADIO_PIXELS 1
+// [x][y][w][h][RGB888 x w x h]: a rectangle, row-major.
+#define DOTMATRIX_RADIO_TILE 2
+// [characters...]
+#define DOTMATRIX_RADIO_TEXT 3
+// [score0:4][score1:4], little-endian.
+#define DOTMATRIX_RADIO_SCORE 4
+
+#define DOTMATRIX_RADIO_HEADER_SIZE 4
+#define DOTMATRIX_RADIO_FRAGMENT_DATA (MICROBIT_RADIO_MAX_PACKET_SIZE - DOTMATRIX_RADIO_HEADER_SIZE)
+#define DOTMATRIX_RADIO_MAX_FRAGMENTS 16
+#define DOTMATRIX_RADIO_MAX_MESSAGE (DOTMATRIX_RADIO_MAX_FRAGMENTS * DOTMATRIX_RADIO_FRAGMENT_DATA)
+
+#ifndef DOTMATRIX_RADIO_GROUP
+#define DOTMATRIX_RADIO_GROUP 42
+#endif
+
+// Senders the gateway reassembles for at once; the one heard from least recently makes
+// room for a new one.
+#ifndef DOTMATRIX_RADIO_MAX_SENDERS
+#define DOTMATRIX_RADIO_MAX_SENDERS 4
+#endif
+
+// Shortest time between two panel updates. Commands received in between are drawn into
+// the framebuffer and go out together.
+#ifndef DOTMATRIX_RADIO_BATCH_MS
+#define DOTMATRIX_RADIO_BATCH_MS 50
+#endif
+
+struct DotMatrixRadioStats
+{
+    uint32_t datagrams;
+    uint32_t messages;
+    // Fragments and messages seen before, from senders repeating for reliability.
+    uint32_t duplicates;
+    uint32_t malformed;
+    // Messages abandoned with fragments missing.
+    uint32_t incomplete;
+    // Panel updates sent; each covers every message drawn since the previous one.
+    uint32_t batches;
+};
+
+// Receives draw commands from any number of radio senders and forwards them to the
+// panel. Radio handling only draws into the framebuffer or records the latest text and
+// score; the gateway's own fiber does the BLE writes, so senders never wait on the link.
+class DotMatrixRadioGateway
+{
+public:
+    DotMatrixRadioGateway(MicroBit &uBit, DotMatrixClient &panel);
+
+    // Enables the radio and starts the gateway fiber.
+    int start();
+
+    DotMatrixRadioStats stats() const;
+
+private:
+    struct Sender
+    {
+        uint16_t id;
+        bool active;
+        uint32_t lastHeardMs;
+
+        // Most recent completed sequence number, and which of the 32 before it completed.
+        uint8_t lastSequence;
+        uint32_t recent;
+        bool haveSequence;
+
+        // Message being reassembled.
+        uint8_t sequence;
+        uint8_t fragments;
+        uint16_t received;
+        uint16_t length;
+        uint8_t data[DOTMATRIX_RADIO_MAX_MESSAGE];
+    };
+
+    MicroBit &uBit_;
+    DotMatrixClient &panel_;
+    bool started_;
+
+    Sender senders_[DOTMATRIX_RADIO_MAX_SENDERS];
+
+    // Work for the gateway fiber. Text and scores each replace what the panel shows, so
+    // only the latest of either is kept.
+    bool drawn_;
+    uint8_t pendingCommand_;
+    char text_[DOTMATRIX_TEXT_MAX_CHARACTERS + 1];
+    uint32_t score0_;
+    uint32_t score1_;
+    // False after text or a score, or a reconnect, until the panel is put back into
+    // image mode.
+    bool imageMode_;
+    uint32_t connections_;
+
+    DotMatrixRadioStats stats_;
+
+    void onDatagram(MicroBitEvent);
+    void receive(const uint8_t *datagram, int length);
+    Sender &senderFor(uint16_t id);
+    bool seen(const Sender &sender, uint8_t sequence) const;
+    void complete(Sender &sender);
+    bool apply(const uint8_t *message, uint32_t length);
+
+    static void fiberEntry(void *param);
+    void run();
+};
+
+// Sends draw commands to a gateway. Each datagram goes out `repeats` times, since the
+// radio has no acknowledgements; the gateway drops the copies.
+class DotMatrixRadioSender
+{
+public:
+    explicit DotMatrixRadioSender(MicroBit &uBit, uint8_t repeats = 2);
+
+    // Enables the radio on the gateway's group.
+    int start();
+
+    int pixels(uint8_t x, uint8_t y, const uint8_t *rgb, uint32_t count);
+    int tile(uint8_t x, uint8_t y, uint8_t w, uint8_t h, const uint8_t *rgb);
+    int text(const char *text);
+    int score(uint32_t score0, uint32_t score1);
+
+private:
+    MicroBit &uBit_;
+    uint8_t repeats_;
+    uint16_t id_;
+    uint8_t sequence_;
+
+    int send(uint8_t command, const uint8_t *header, uint32_t headerLength,
+             const uint8_t *data, uint32_t dataLength);
+};
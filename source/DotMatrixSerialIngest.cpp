@@ -0,0 +1,279 @@
+#include "DotMatrixSerialIngest.h"
+#include "DotMatrixProtocol.h"
+
+#include <string.h>
+
+namespace
+{
+constexpr uint32_t PANEL_PIXELS = DotMatrixPanel::pixels;
+constexpr uint32_t HEADER_SIZE = 2;
+constexpr uint32_t CRC_SIZE = 4;
+constexpr uint32_t RUN_HEADER_SIZE = 3;
+
+// Bytes pulled from the serial driver per read.
+constexpr uint32_t READ_CHUNK = 64;
+
+// Largest receive buffer the serial driver takes; about 2.5 ms of data at 1 Mbaud.
+constexpr uint8_t RX_BUFFER_SIZE = 254;
+
+constexpr uint32_t REPORT_INTERVAL_MS = 1000;
+
+static uint32_t now_ms()
+{
+    return (uint32_t)system_timer_current_time();
+}
+
+static uint32_t read_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+} // namespace
+
+DotMatrixSerialIngest::DotMatrixSerialIngest(MicroBit &uBit, DotMatrixClient &panel,
+                                             DotMatrixFrameScheduler &scheduler)
+    : uBit_(uBit)
+    , panel_(panel)
+    , scheduler_(scheduler)
+    , haveSequence_(false)
+    , lastSequence_(0)
+    , ended_(false)
+    , lastPacketMs_(0)
+    , statsSinceMs_(0)
+{
+    memset(&stats_, 0, sizeof(stats_));
+    reset();
+}
+
+void DotMatrixSerialIngest::run(uint32_t baud, uint32_t restoreBaud)
+{
+    memset(&stats_, 0, sizeof(stats_));
+    statsSinceMs_ = now_ms();
+    lastPacketMs_ = statsSinceMs_;
+    haveSequence_ = false;
+    ended_ = false;
+    reset();
+
+    if (panel_.isReady())
+        panel_.setImageModeDiy();
+    scheduler_.start();
+    scheduler_.resetStats();
+
+    // The host switches baud once it sees this line, so it has to be out first.
+    uBit_.serial.printf("ingest %d\r\n", (int)baud);
+    while (uBit_.serial.txBufferedSize() > 0)
+        fiber_sleep(1);
+    fiber_sleep(2);
+
+    uBit_.serial.setRxBufferSize(RX_BUFFER_SIZE);
+    uBit_.serial.setBaudrate(baud);
+
+    uint32_t nextReportMs = statsSinceMs_ + REPORT_INTERVAL_MS;
+    uint8_t chunk[READ_CHUNK];
+
+    while (!ended_)
+    {
+        const int count = uBit_.serial.read(chunk, sizeof(chunk), ASYNC);
+        if (count > 0)
+        {
+            stats_.bytesReceived += count;
+            for (int i = 0; i < count && !ended_; i++)
+                receive(chunk[i]);
+        }
+
+        const uint32_t now = now_ms();
+        if (count <= 0 && now - lastPacketMs_ > DOTMATRIX_INGEST_IDLE_TIMEOUT_MS)
+            break;
+
+        if ((int32_t)(now - nextReportMs) >= 0)
+        {
+            report("ingest:");
+            nextReportMs = now + REPORT_INTERVAL_MS;
+        }
+
+        // Other fibers, the transmit fiber above all, still need to run while data
+        // keeps arriving.
+        if (count > 0)
+            schedule();
+        else
+            fiber_sleep(1);
+    }
+
+    report(ended_ ? "ingest done:" : "ingest timeout:");
+    while (uBit_.serial.txBufferedSize() > 0)
+        fiber_sleep(1);
+    fiber_sleep(2);
+
+    uBit_.serial.setBaudrate(restoreBaud);
+}
+
+DotMatrixIngestStats DotMatrixSerialIngest::stats() const
+{
+    DotMatrixIngestStats stats = stats_;
+    stats.elapsedMs = now_ms() - statsSinceMs_;
+    return stats;
+}
+
+void DotMatrixSerialIngest::reset()
+{
+    length_ = 0;
+    blockRemaining_ = 0;
+    blockZero_ = false;
+    overflow_ = false;
+}
+
+// COBS is decoded as bytes arrive, so the packet is complete the moment its delimiter is.
+void DotMatrixSerialIngest::receive(uint8_t byte)
+{
+    if (byte == 0)
+    {
+        endPacket();
+        reset();
+        return;
+    }
+
+    if (blockRemaining_ == 0)
+    {
+        if (blockZero_)
+            append(0);
+        blockRemaining_ = byte - 1;
+        blockZero_ = byte != 0xFF;
+        return;
+    }
+
+    append(byte);
+    blockRemaining_--;
+}
+
+void DotMatrixSerialIngest::append(uint8_t byte)
+{
+    if (length_ < sizeof(packet_))
+        packet_[length_++] = byte;
+    else
+        overflow_ = true;
+}
+
+void DotMatrixSerialIngest::endPacket()
+{
+    // Back-to-back delimiters are allowed; hosts send one first to resynchronise.
+    if (length_ == 0 && blockRemaining_ == 0 && !blockZero_)
+        return;
+
+    if (overflow_ || blockRemaining_ != 0 || length_ < HEADER_SIZE + CRC_SIZE)
+    {
+        stats_.framingErrors++;
+        return;
+    }
+
+    const uint32_t body = length_ - CRC_SIZE;
+    if (dotmatrix_crc32(packet_, body) != read_le32(&packet_[body]))
+    {
+        stats_.crcErrors++;
+        return;
+    }
+
+    const uint8_t type = packet_[0];
+    const uint8_t sequence = packet_[1];
+    const uint8_t *payload = &packet_[HEADER_SIZE];
+    const uint32_t payloadLength = body - HEADER_SIZE;
+
+    lastPacketMs_ = now_ms();
+    if (haveSequence_ && sequence == lastSequence_)
+    {
+        // Sent twice; it has already been applied.
+        stats_.duplicates++;
+        return;
+    }
+
+    if (haveSequence_)
+        stats_.sequenceGaps += (uint8_t)(sequence - lastSequence_ - 1);
+    haveSequence_ = true;
+    lastSequence_ = sequence;
+
+    switch (type)
+    {
+    case DOTMATRIX_INGEST_FULL:
+        if (payloadLength != PANEL_PIXELS * 3)
+        {
+            stats_.framingErrors++;
+            return;
+        }
+        panel_.setPixels(0, 0, payload, PANEL_PIXELS);
+        stats_.fullFrames++;
+        scheduler_.submit();
+        break;
+
+    case DOTMATRIX_INGEST_DELTA:
+        if (!applyDelta(payload, payloadLength))
+        {
+            stats_.framingErrors++;
+            return;
+        }
+        stats_.deltaFrames++;
+        scheduler_.submit();
+        break;
+
+    case DOTMATRIX_INGEST_END:
+        ended_ = true;
+        break;
+
+    default:
+        stats_.framingErrors++;
+        break;
+    }
+}
+
+// Checks every run before drawing any, so a malformed delta leaves the frame untouched.
+bool DotMatrixSerialIngest::applyDelta(const uint8_t *payload, uint32_t length)
+{
+    for (uint32_t pass = 0; pass < 2; pass++)
+    {
+        uint32_t offset = 0;
+        while (offset < length)
+        {
+            if (length - offset < RUN_HEADER_SIZE)
+                return false;
+
+            const uint8_t x = payload[offset];
+            const uint8_t y = payload[offset + 1];
+            const uint8_t count = payload[offset + 2];
+            offset += RUN_HEADER_SIZE;
+
+            if (pass == 0)
+            {
+                if (!DotMatrixPanel::contains(x, y) || count == 0 ||
+                    y * DotMatrixPanel::width + x + count > PANEL_PIXELS ||
+                    length - offset < count * 3u)
+                    return false;
+            }
+            else
+            {
+                panel_.setPixels(x, y, &payload[offset], count);
+            }
+
+            offset += count * 3;
+        }
+    }
+
+    return true;
+}
+
+void DotMatrixSerialIngest::report(const char *prefix)
+{
+    const DotMatrixIngestStats s = stats();
+    const DotMatrixFrameStats frames = scheduler_.stats();
+    const uint32_t rate = s.elapsedMs ? (uint64_t)s.bytesReceived * 1000 / s.elapsedMs : 0;
+
+    uBit_.serial.printf("%s rx_bytes_per_s %d full %d delta %d crc_errors %d framing_errors %d "
+                        "gaps %d duplicates %d panel_fps %d.%02d dropped %d\r\n",
+                        prefix,
+                        (int)rate,
+                        (int)s.fullFrames,
+                        (int)s.deltaFrames,
+                        (int)s.crcErrors,
+                        (int)s.framingErrors,
+                        (int)s.sequenceGaps,
+                        (int)s.duplicates,
+                        (int)(frames.fpsX100 / 100),
+                        (int)(frames.fpsX100 % 100),
+                        (int)frames.dropped);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "MicroBit.h"
+#include "DotMatrix.h"
+#include "DotMatrixFrameScheduler.h"
+
+// Frames streamed from a host over the serial port (see serial_send.py). Each packet is
+// COBS-encoded and ends with a zero byte. Decoded, it is
+//
+//   [type:1][sequence:1][payload][crc:4]
+//
+// where crc is dotmatrix_crc32() of everything before it, little-endian.
+
+// Payload: the whole panel as RGB888, row-major.
+#define DOTMATRIX_INGEST_FULL 1
+
+// Payload: runs of [x:1][y:1][count:1][RGB888 x count], each starting at (x, y) and
+// continuing along the row, wrapping onto the next.
+#define DOTMATRIX_INGEST_DELTA 2
+
+// No payload: leave ingest mode.
+#define DOTMATRIX_INGEST_END 3
+
+#ifndef DOTMATRIX_INGEST_BAUD
+#define DOTMATRIX_INGEST_BAUD 1000000
+#endif
+
+// Ingest mode ends after this long without a valid packet, in case the host went away.
+#define DOTMATRIX_INGEST_IDLE_TIMEOUT_MS 5000
+
+// Largest decoded packet: a full frame plus header and CRC.
+#define DOTMATRIX_INGEST_MAX_PACKET (2 + DotMatrixPanel::frameBytes + 4)
+
+struct DotMatrixIngestStats
+{
+    uint32_t elapsedMs;
+    uint32_t bytesReceived;
+    uint32_t fullFrames;
+    uint32_t deltaFrames;
+    uint32_t crcErrors;
+    // Bad COBS, oversized packets and malformed payloads.
+    uint32_t framingErrors;
+    // Packets missing between two that arrived, going by their sequence numbers.
+    uint32_t sequenceGaps;
+    // Packets repeating the sequence number of the one before, which are dropped.
+    uint32_t duplicates;
+};
+
+// Receives frames into the panel's framebuffer and hands them to a frame scheduler, so
+// the next frame is decoded while the previous one is on the air. A frame the link
+// could not keep up with is replaced by the next rather than queued.
+class DotMatrixSerialIngest
+{
+public:
+    DotMatrixSerialIngest(MicroBit &uBit, DotMatrixClient &panel,
+                          DotMatrixFrameScheduler &scheduler);
+
+    // Switches the serial port to `baud` and applies packets until the host sends END
+    // or goes quiet, then switches back to `restoreBaud`. Prints a status line once a
+    // second. Blocks the calling fiber.
+    void run(uint32_t baud, uint32_t restoreBaud);
+
+    DotMatrixIngestStats stats() const;
+
+private:
+    MicroBit &uBit_;
+    DotMatrixClient &panel_;
+    DotMatrixFrameScheduler &scheduler_;
+
+    // Decoded packet being received.
+    uint8_t packet_[DOTMATRIX_INGEST_MAX_PACKET];
+    uint32_t length_;
+    // Bytes left in the current COBS block, and whether a zero follows it.
+    uint8_t blockRemaining_;
+    bool blockZero_;
+    bool overflow_;
+
+    bool haveSequence_;
+    uint8_t lastSequence_;
+    bool ended_;
+    uint32_t lastPacketMs_;
+
+    DotMatrixIngestStats stats_;
+    uint32_t statsSinceMs_;
+
+    void reset();
+    void receive(uint8_t byte);
+    void append(uint8_t byte);
+    void endPacket();
+    bool applyDelta(const uint8_t *payload, uint32_t length);
+    void report(const char *prefix);
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+// Frames computed rather than stored. DotMatrixClient::writeImage(shader) evaluates the
+// shader straight into the outgoing chunks, a span at a time, so content that is a
+// function of position and time needs no framebuffer.
+
+// Longest span a shader is asked for. Spans never cross a row.
+#define DOTMATRIX_SHADER_SPAN 64
+
+// Fills `count` RGB888 pixels of row `y`, starting at column `x`. `t` is the frame time
+// in ms, the same for every span of a frame.
+typedef void (*DotMatrixSpanShader)(uint32_t x, uint32_t y, uint32_t count, uint32_t t,
+                                    uint8_t *rgb, void *context);
+
+// One pixel at a time: simpler to write, but a call per pixel.
+typedef void (*DotMatrixPixelShader)(uint32_t x, uint32_t y, uint32_t t, uint8_t *rgb,
+                                     void *context);
+
+// Exactly one of `span` and `pixel` is set.
+struct DotMatrixShader
+{
+    DotMatrixSpanShader span;
+    DotMatrixPixelShader pixel;
+    void *context;
+};
+
+// Angles are in 256ths of a turn, so they wrap for free in a uint8_t.
+extern const int8_t dotmatrix_sin_table[256];
+
+// -127..127
+static inline int dotmatrix_sin8(uint8_t angle)
+{
+    return dotmatrix_sin_table[angle];
+}
+
+static inline int dotmatrix_cos8(uint8_t angle)
+{
+    return dotmatrix_sin_table[(uint8_t)(angle + 64)];
+}
+
+// The sine shifted to 0..254, for use as a colour channel.
+static inline uint8_t dotmatrix_wave8(uint8_t angle)
+{
+    return dotmatrix_sin_table[angle] + 127;
+}
@@ -0,0 +1,82 @@
+#include "DotMatrixTrace.h"
+
+#include "nrf.h"
+
+namespace
+{
+struct TraceEvent
+{
+    uint32_t cycles;
+    uint8_t point;
+    char phase;
+    uint16_t arg;
+};
+
+static_assert((DOTMATRIX_TRACE_BUFFER_EVENTS & (DOTMATRIX_TRACE_BUFFER_EVENTS - 1)) == 0,
+              "DOTMATRIX_TRACE_BUFFER_EVENTS must be a power of two");
+
+const char *const TRACE_POINT_NAMES[DOTMATRIX_TRACE_POINT_COUNT] = {
+    "text",
+    "text preamble+crc",
+    "image",
+    "frame copy",
+    "gattc write",
+    "resources stall",
+    "write rsp",
+};
+
+static TraceEvent trace_buffer[DOTMATRIX_TRACE_BUFFER_EVENTS];
+
+// Free-running count of events recorded; the buffer holds the last ones.
+static uint32_t trace_next = 0;
+static volatile bool trace_paused = false;
+} // namespace
+
+void dotmatrix_cycle_counter_enable()
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+void dotmatrix_trace_record(uint8_t point, char phase, uint16_t arg)
+{
+    if (trace_paused)
+        return;
+
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    TraceEvent &event = trace_buffer[trace_next++ & (DOTMATRIX_TRACE_BUFFER_EVENTS - 1)];
+    event.cycles = DWT->CYCCNT;
+    event.point = point;
+    event.phase = phase;
+    event.arg = arg;
+    __set_PRIMASK(primask);
+}
+
+void dotmatrix_trace_dump(MicroBit &uBit)
+{
+    // Nothing is recorded while the dump yields to the serial port.
+    trace_paused = true;
+
+    const uint32_t count = trace_next < DOTMATRIX_TRACE_BUFFER_EVENTS ? trace_next
+                                                                     : DOTMATRIX_TRACE_BUFFER_EVENTS;
+
+    uBit.serial.printf("TRACE BEGIN %d %d\r\n", (int)SystemCoreClock, (int)count);
+    for (int i = 0; i < DOTMATRIX_TRACE_POINT_COUNT; i++)
+        uBit.serial.printf("N %d %s\r\n", i, TRACE_POINT_NAMES[i]);
+
+    for (uint32_t i = trace_next - count; i != trace_next; i++)
+    {
+        const TraceEvent &event = trace_buffer[i & (DOTMATRIX_TRACE_BUFFER_EVENTS - 1)];
+        // Cycle counts go out in hex, as they use all 32 bits.
+        uBit.serial.printf("T %x %d %c %d\r\n",
+                           (unsigned int)event.cycles,
+                           event.point,
+                           event.phase,
+                           event.arg);
+    }
+    uBit.serial.printf("TRACE END\r\n");
+
+    trace_next = 0;
+    trace_paused = false;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "MicroBit.h"
+
+// Set to 0 to compile every trace point out.
+#ifndef DOTMATRIX_TRACE
+#define DOTMATRIX_TRACE 1
+#endif
+
+// Most recent trace events kept; older ones are overwritten. Must be a power of two.
+#ifndef DOTMATRIX_TRACE_BUFFER_EVENTS
+#define DOTMATRIX_TRACE_BUFFER_EVENTS 256
+#endif
+
+enum DotMatrixTracePoint : uint8_t
+{
+    DOTMATRIX_TRACE_TEXT,
+    DOTMATRIX_TRACE_TEXT_PREAMBLE, // header and CRC over the glyph stream
+    DOTMATRIX_TRACE_IMAGE,
+    DOTMATRIX_TRACE_FRAME_COPY,    // framebuffer snapshot and image header
+    DOTMATRIX_TRACE_GATTC_WRITE,   // one sd_ble_gattc_write call; arg is its length
+    DOTMATRIX_TRACE_STALL,         // waiting out NRF_ERROR_RESOURCES
+    DOTMATRIX_TRACE_WRITE_RSP,     // write request until its response
+    DOTMATRIX_TRACE_POINT_COUNT,
+};
+
+// Starts the DWT cycle counter that timestamps trace events.
+void dotmatrix_cycle_counter_enable();
+
+void dotmatrix_trace_record(uint8_t point, char phase, uint16_t arg);
+
+// Prints the buffered events over serial, oldest first, and empties the buffer.
+// trace_to_chrome.py turns the output into Chrome trace JSON.
+void dotmatrix_trace_dump(MicroBit &uBit);
+
+class DotMatrixTraceScope
+{
+public:
+    DotMatrixTraceScope(uint8_t point, uint16_t arg) : point_(point)
+    {
+        dotmatrix_trace_record(point, 'B', arg);
+    }
+
+    ~DotMatrixTraceScope() { dotmatrix_trace_record(point_, 'E', 0); }
+
+private:
+    const uint8_t point_;
+};
+
+#define DOTMATRIX_TRACE_CONCAT_(a, b) a##b
+#define DOTMATRIX_TRACE_CONCAT(a, b) DOTMATRIX_TRACE_CONCAT_(a, b)
+
+#if CONFIG_ENABLED(DOTMATRIX_TRACE)
+#define DOTMATRIX_TRACE_BEGIN(point, arg) dotmatrix_trace_record(point, 'B', arg)
+#define DOTMATRIX_TRACE_END(point) dotmatrix_trace_record(point, 'E', 0)
+// Traces from here to the end of the enclosing block.
+#define DOTMATRIX_TRACE_SCOPE(point, arg)                                                          \
+    DotMatrixTraceScope DOTMATRIX_TRACE_CONCAT(dotmatrix_trace_scope_, __LINE__)(point, arg)
+#else
+#define DOTMATRIX_TRACE_BEGIN(point, arg) ((void)0)
+#define DOTMATRIX_TRACE_END(point) ((void)0)
+#define DOTMATRIX_TRACE_SCOPE(point, arg) ((void)0)
+#endif
@@ -0,0 +1,313 @@
+#include "DotMatrixTween.h"
+#include "DotMatrixCompositor.h"
+#include "DotMatrixShader.h"
+#include "DotMatrixWidgets.h"
+
+#include "nrf.h"
+
+#include <string.h>
+
+namespace
+{
+constexpr uint32_t ONE = 65536;
+
+// Two full swings of the spring over the tween.
+constexpr uint32_t SPRING_TURNS_X256 = 512;
+
+static inline uint32_t mul_q16(uint32_t a, uint32_t b)
+{
+    return (uint32_t)(((uint64_t)a * b) >> 16);
+}
+
+static void set_int32(int32_t value, void *context)
+{
+    *static_cast<int32_t *>(context) = value;
+}
+
+// The value of a track `t` ms in. Returns true once it has reached its last keyframe.
+static bool evaluate(const DotMatrixKeyframe *frames, uint8_t count, bool loop, uint32_t t,
+                     int32_t &value)
+{
+    const uint32_t end = frames[count - 1].timeMs;
+    if (loop && end > 0)
+    {
+        t %= end;
+    }
+    else if (t >= end)
+    {
+        value = frames[count - 1].value;
+        return true;
+    }
+
+    if (t < frames[0].timeMs)
+    {
+        value = frames[0].value;
+        return false;
+    }
+
+    uint32_t i = 1;
+    while (frames[i].timeMs <= t)
+        i++;
+
+    const DotMatrixKeyframe &from = frames[i - 1];
+    const DotMatrixKeyframe &to = frames[i];
+    const uint32_t progress = ((uint64_t)(t - from.timeMs) << 16) / (to.timeMs - from.timeMs);
+    const int64_t delta = (int64_t)to.value - from.value;
+    value = from.value + (int32_t)((delta * dotmatrix_ease(to.easing, progress)) >> 16);
+    return false;
+}
+} // namespace
+
+int32_t dotmatrix_ease(DotMatrixEasing easing, uint32_t progress)
+{
+    const uint32_t p = progress < ONE ? progress : ONE;
+
+    switch (easing)
+    {
+        case DOTMATRIX_EASE_IN:
+            return mul_q16(p, p);
+
+        case DOTMATRIX_EASE_OUT:
+            return mul_q16(p, 2 * ONE - p);
+
+        case DOTMATRIX_EASE_IN_OUT:
+            // Smoothstep: 3p^2 - 2p^3.
+            return mul_q16(mul_q16(p, p), 3 * ONE - 2 * p);
+
+        case DOTMATRIX_EASE_SPRING:
+        {
+            // 1 - (1 - p)^6 cos(2 turns * p): starts fast, overshoots, rings down to 1.
+            const uint32_t q = ONE - p;
+            const uint32_t q2 = mul_q16(q, q);
+            const uint32_t envelope = mul_q16(mul_q16(q2, q2), q2);
+            const int cosine = dotmatrix_cos8((uint8_t)((p * SPRING_TURNS_X256) >> 16));
+            return (int32_t)ONE - (int32_t)(((int64_t)envelope * cosine) / 127);
+        }
+
+        default:
+            return p;
+    }
+}
+
+void dotmatrix_apply_widget_x(int32_t value, void *widget)
+{
+    DotMatrixWidget &w = *static_cast<DotMatrixWidget *>(widget);
+    w.setPosition(value, w.bounds().y0);
+}
+
+void dotmatrix_apply_widget_y(int32_t value, void *widget)
+{
+    DotMatrixWidget &w = *static_cast<DotMatrixWidget *>(widget);
+    w.setPosition(w.bounds().x0, value);
+}
+
+void dotmatrix_apply_counter(int32_t value, void *counter)
+{
+    static_cast<DotMatrixCounter *>(counter)->setValue(value);
+}
+
+void dotmatrix_apply_gauge(int32_t value, void *gauge)
+{
+    static_cast<DotMatrixBarGauge *>(gauge)->setValue(value);
+}
+
+void dotmatrix_apply_layer_opacity(int32_t value, void *layer)
+{
+    const uint8_t opacity = value < 0 ? 0 : value > 255 ? 255 : value;
+    static_cast<DotMatrixLayer *>(layer)->setOpacity(opacity);
+}
+
+uint32_t dotmatrix_render_scene(void *scene)
+{
+    return static_cast<DotMatrixScene *>(scene)->render();
+}
+
+uint32_t dotmatrix_render_compositor(void *compositor)
+{
+    return static_cast<DotMatrixCompositor *>(compositor)->compose();
+}
+
+DotMatrixAnimator::DotMatrixAnimator(DotMatrixFrameScheduler &scheduler)
+    : scheduler_(scheduler)
+    , render_(nullptr)
+    , renderContext_(nullptr)
+    , started_(false)
+{
+    memset(tweens_, 0, sizeof(tweens_));
+    resetStats();
+}
+
+void DotMatrixAnimator::setRender(DotMatrixRender render, void *context)
+{
+    render_ = render;
+    renderContext_ = context;
+}
+
+void DotMatrixAnimator::start()
+{
+    if (started_)
+        return;
+
+    started_ = true;
+    create_fiber(fiberEntry, this);
+}
+
+void DotMatrixAnimator::fiberEntry(void *param)
+{
+    DotMatrixAnimator *animator = static_cast<DotMatrixAnimator *>(param);
+    while (true)
+    {
+        animator->scheduler_.waitForNextFrame();
+        animator->step();
+    }
+}
+
+int DotMatrixAnimator::add(const DotMatrixKeyframe *frames, uint8_t count, bool loop,
+                           DotMatrixTweenApply apply, void *context)
+{
+    if (count == 0 || apply == nullptr)
+        return DEVICE_INVALID_PARAMETER;
+
+    // Replace a tween on the same property, otherwise take a free slot.
+    int slot = -1;
+    for (uint32_t i = 0; i < DOTMATRIX_MAX_TWEENS; i++)
+    {
+        const Tween &t = tweens_[i];
+        if (t.active && t.apply == apply && t.context == context)
+        {
+            slot = i;
+            break;
+        }
+        if (!t.active && slot < 0)
+            slot = i;
+    }
+    if (slot < 0)
+        return DEVICE_NO_RESOURCES;
+
+    Tween &t = tweens_[slot];
+    t.frames = frames;
+    t.count = count;
+    t.loop = loop;
+    t.apply = apply;
+    t.context = context;
+    // Timed from the current slot, so a tween started while drawing a frame is in step
+    // with everything else in it.
+    t.startMs = scheduler_.frameTimeMs();
+    t.applied = false;
+    t.active = true;
+    t.generation++;
+
+    return slot | (t.generation << 8);
+}
+
+int DotMatrixAnimator::tween(int32_t from, int32_t to, uint32_t durationMs,
+                             DotMatrixEasing easing, DotMatrixTweenApply apply, void *context,
+                             uint32_t delayMs)
+{
+    // Copied into the slot once add() has picked one.
+    const DotMatrixKeyframe ends[2] = {{delayMs, from, DOTMATRIX_EASE_LINEAR},
+                                       {delayMs + durationMs, to, easing}};
+
+    const int handle = add(ends, 2, false, apply, context);
+    if (handle < 0)
+        return handle;
+
+    Tween &t = tweens_[handle & 0xFF];
+    memcpy(t.ends, ends, sizeof(ends));
+    t.frames = t.ends;
+    return handle;
+}
+
+int DotMatrixAnimator::tween(int32_t *value, int32_t to, uint32_t durationMs,
+                             DotMatrixEasing easing, uint32_t delayMs)
+{
+    return tween(*value, to, durationMs, easing, set_int32, value, delayMs);
+}
+
+int DotMatrixAnimator::keyframes(const DotMatrixKeyframe *frames, uint8_t count, bool loop,
+                                 DotMatrixTweenApply apply, void *context)
+{
+    return add(frames, count, loop, apply, context);
+}
+
+int DotMatrixAnimator::find(int handle) const
+{
+    const int slot = handle & 0xFF;
+    if (handle < 0 || slot >= DOTMATRIX_MAX_TWEENS)
+        return -1;
+
+    const Tween &t = tweens_[slot];
+    return t.active && t.generation == (uint8_t)(handle >> 8) ? slot : -1;
+}
+
+void DotMatrixAnimator::cancel(int handle)
+{
+    const int slot = find(handle);
+    if (slot >= 0)
+        tweens_[slot].active = false;
+}
+
+bool DotMatrixAnimator::isRunning(int handle) const
+{
+    return find(handle) >= 0;
+}
+
+bool DotMatrixAnimator::isAnimating() const
+{
+    for (uint32_t i = 0; i < DOTMATRIX_MAX_TWEENS; i++)
+        if (tweens_[i].active)
+            return true;
+    return false;
+}
+
+uint32_t DotMatrixAnimator::step()
+{
+    const uint32_t start = DWT->CYCCNT;
+    const uint32_t now = scheduler_.frameTimeMs();
+
+    for (uint32_t i = 0; i < DOTMATRIX_MAX_TWEENS; i++)
+    {
+        Tween &t = tweens_[i];
+        if (!t.active)
+            continue;
+
+        const int32_t elapsed = now - t.startMs;
+        int32_t value;
+        const bool done = evaluate(t.frames, t.count, t.loop, elapsed > 0 ? elapsed : 0, value);
+        if (done)
+            t.active = false;
+
+        if (!t.applied || value != t.last)
+        {
+            t.last = value;
+            t.applied = true;
+            t.apply(value, t.context);
+            stats_.applied++;
+        }
+    }
+
+    const uint32_t changed = render_ ? render_(renderContext_) : 0;
+    if (changed)
+    {
+        scheduler_.submit();
+        stats_.submitted++;
+    }
+
+    const uint32_t cycles = DWT->CYCCNT - start;
+    stats_.frames++;
+    stats_.lastCycles = cycles;
+    if (cycles > stats_.maxCycles)
+        stats_.maxCycles = cycles;
+
+    return changed;
+}
+
+DotMatrixAnimatorStats DotMatrixAnimator::stats() const
+{
+    return stats_;
+}
+
+void DotMatrixAnimator::resetStats()
+{
+    memset(&stats_, 0, sizeof(stats_));
+}
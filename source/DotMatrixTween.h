@@ -0,0 +1,138 @@
+#pragma once
+
+#include "DotMatrixFrameScheduler.h"
+
+class DotMatrixWidget;
+class DotMatrixCounter;
+class DotMatrixBarGauge;
+class DotMatrixLayer;
+
+// Tweens and keyframe tracks on integer properties, stepped once per frame slot of a
+// DotMatrixFrameScheduler. Every property is set for the slot's time, then the app's
+// render function runs once and the frame is submitted if anything changed, however
+// many properties moved.
+
+// Tweens running at once.
+#define DOTMATRIX_MAX_TWEENS 16
+
+enum DotMatrixEasing : uint8_t
+{
+    DOTMATRIX_EASE_LINEAR,
+    DOTMATRIX_EASE_IN,
+    DOTMATRIX_EASE_OUT,
+    DOTMATRIX_EASE_IN_OUT,
+    // Overshoots by about a fifth, then settles in two damped swings.
+    DOTMATRIX_EASE_SPRING,
+};
+
+// Eased progress in Q16: 0 at the start and 65536 at the end. `progress` is clamped to
+// 0..65536; only the spring goes outside that range.
+int32_t dotmatrix_ease(DotMatrixEasing easing, uint32_t progress);
+
+// The value at `timeMs` on a track, eased into from the previous keyframe.
+struct DotMatrixKeyframe
+{
+    uint32_t timeMs;
+    int32_t value;
+    DotMatrixEasing easing;
+};
+
+// Sets an animated property. Called only when the value changes.
+typedef void (*DotMatrixTweenApply)(int32_t value, void *context);
+
+// Draws the frame after the properties are set; returns the pixels that changed, as
+// DotMatrixScene::render() and DotMatrixCompositor::compose() do.
+typedef uint32_t (*DotMatrixRender)(void *context);
+
+// Appliers for common properties; the context is the object.
+void dotmatrix_apply_widget_x(int32_t value, void *widget);
+void dotmatrix_apply_widget_y(int32_t value, void *widget);
+void dotmatrix_apply_counter(int32_t value, void *counter);
+void dotmatrix_apply_gauge(int32_t value, void *gauge);
+// Clamped to 0..255.
+void dotmatrix_apply_layer_opacity(int32_t value, void *layer);
+
+// Render functions; the context is a DotMatrixScene or DotMatrixCompositor.
+uint32_t dotmatrix_render_scene(void *scene);
+uint32_t dotmatrix_render_compositor(void *compositor);
+
+struct DotMatrixAnimatorStats
+{
+    uint32_t frames;
+    // Frames in which something changed and was submitted.
+    uint32_t submitted;
+    // Property updates, all frames together.
+    uint32_t applied;
+    // Setting properties and rendering, per frame.
+    uint32_t lastCycles;
+    uint32_t maxCycles;
+};
+
+class DotMatrixAnimator
+{
+public:
+    explicit DotMatrixAnimator(DotMatrixFrameScheduler &scheduler);
+
+    void setRender(DotMatrixRender render, void *context);
+
+    // Starts a fiber that calls step() every frame slot. Apps with their own frame loop
+    // call step() after waitForNextFrame() instead.
+    void start();
+
+    // Animates from `from` to `to`. A tween already running on the same apply and
+    // context is replaced, so retargeting a property mid-flight is just another call.
+    // Returns a handle, or DEVICE_NO_RESOURCES when DOTMATRIX_MAX_TWEENS are running.
+    int tween(int32_t from, int32_t to, uint32_t durationMs, DotMatrixEasing easing,
+              DotMatrixTweenApply apply, void *context, uint32_t delayMs = 0);
+    // Animates a plain variable, such as a sprite coordinate, from its current value.
+    int tween(int32_t *value, int32_t to, uint32_t durationMs, DotMatrixEasing easing,
+              uint32_t delayMs = 0);
+    // Plays a track of `count` keyframes in time order. The array is not copied and must
+    // outlive the animation. A looping track starts over from its last keyframe's time.
+    int keyframes(const DotMatrixKeyframe *frames, uint8_t count, bool loop,
+                  DotMatrixTweenApply apply, void *context);
+
+    // Stops where it is; the property keeps its last value.
+    void cancel(int handle);
+    bool isRunning(int handle) const;
+    bool isAnimating() const;
+
+    // Sets every property for the current frame slot, renders once and submits the
+    // frame if it changed. Returns the pixels changed.
+    uint32_t step();
+
+    DotMatrixAnimatorStats stats() const;
+    void resetStats();
+
+private:
+    struct Tween
+    {
+        const DotMatrixKeyframe *frames;
+        // Storage for the two keyframes of tween().
+        DotMatrixKeyframe ends[2];
+        DotMatrixTweenApply apply;
+        void *context;
+        uint32_t startMs;
+        int32_t last;
+        uint8_t count;
+        uint8_t generation;
+        bool loop;
+        bool active;
+        bool applied;
+    };
+
+    DotMatrixFrameScheduler &scheduler_;
+    DotMatrixRender render_;
+    void *renderContext_;
+    bool started_;
+
+    Tween tweens_[DOTMATRIX_MAX_TWEENS];
+    DotMatrixAnimatorStats stats_;
+
+    int add(const DotMatrixKeyframe *frames, uint8_t count, bool loop,
+            DotMatrixTweenApply apply, void *context);
+    // The slot of a running tween, or -1.
+    int find(int handle) const;
+
+    static void fiberEntry(void *param);
+};
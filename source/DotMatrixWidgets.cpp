@@ -0,0 +1,605 @@
+#include "DotMatrixWidgets.h"
+
+#include "nrf.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+// 3x5 glyphs for ASCII 32..95, rows top to bottom, three bits each with the leftmost
+// column in the highest bit.
+const uint16_t SMALL_FONT[64] = {
+    0x0000, 0x2482, 0x5a00, 0x5f7d, 0x3c9e, 0x52a5, 0x2aab, 0x2400,
+    0x1491, 0x4494, 0x0aa8, 0x05d0, 0x0014, 0x01c0, 0x0002, 0x12a4,
+    0x7b6f, 0x2c97, 0x73e7, 0x72cf, 0x5bc9, 0x79cf, 0x79ef, 0x7292,
+    0x7bef, 0x7bcf, 0x0410, 0x0414, 0x1511, 0x0e38, 0x4454, 0x72c2,
+    0x2be3, 0x2bed, 0x6bae, 0x3923, 0x6b6e, 0x79a7, 0x79a4, 0x396b,
+    0x5bed, 0x7497, 0x126a, 0x5bad, 0x4927, 0x5fed, 0x6b6d, 0x2b6a,
+    0x6ba4, 0x2b73, 0x6bad, 0x388e, 0x7492, 0x5b6f, 0x5b6a, 0x5bfd,
+    0x5aad, 0x5a92, 0x72a7, 0x3493, 0x4889, 0x6496, 0x2a00, 0x0007,
+};
+
+constexpr DotMatrixColour WHITE = {255, 255, 255};
+constexpr DotMatrixColour BLACK = {0, 0, 0};
+
+// Room for the old and new area of every widget.
+constexpr uint32_t MAX_DAMAGE = DOTMATRIX_SCENE_MAX_WIDGETS * 2;
+
+static inline int min_int(int a, int b)
+{
+    return a < b ? a : b;
+}
+
+static inline int max_int(int a, int b)
+{
+    return a > b ? a : b;
+}
+
+static bool contains(const DotMatrixRect &rect, int x, int y)
+{
+    return x >= rect.x0 && x < rect.x1 && y >= rect.y0 && y < rect.y1;
+}
+
+static bool intersects(const DotMatrixRect &a, const DotMatrixRect &b)
+{
+    return !a.isEmpty() && !b.isEmpty() && a.x0 < b.x1 && b.x0 < a.x1 && a.y0 < b.y1 &&
+           b.y0 < a.y1;
+}
+
+static bool same_rect(const DotMatrixRect &a, const DotMatrixRect &b)
+{
+    return a.x0 == b.x0 && a.y0 == b.y0 && a.x1 == b.x1 && a.y1 == b.y1;
+}
+
+static DotMatrixRect make_rect(int x, int y, int w, int h)
+{
+    return {(int16_t)x, (int16_t)y, (int16_t)(x + w), (int16_t)(y + h)};
+}
+} // namespace
+
+bool dotmatrix_small_glyph_pixel(char c, int x, int y)
+{
+    if (c >= 'a' && c <= 'z')
+        c -= 'a' - 'A';
+    if (c < 32 || c > 95 || x < 0 || y < 0 || x >= DOTMATRIX_SMALL_GLYPH_WIDTH ||
+        y >= DOTMATRIX_SMALL_GLYPH_HEIGHT)
+        return false;
+
+    const uint32_t bit = (DOTMATRIX_SMALL_GLYPH_HEIGHT - 1 - y) * DOTMATRIX_SMALL_GLYPH_WIDTH +
+                         (DOTMATRIX_SMALL_GLYPH_WIDTH - 1 - x);
+    return (SMALL_FONT[c - 32] >> bit) & 1;
+}
+
+DotMatrixCanvas::DotMatrixCanvas(DotMatrixClient &panel, const DotMatrixRect &bounds)
+    : panel_(panel)
+    , bounds_(bounds)
+    , changed_(0)
+{
+}
+
+int DotMatrixCanvas::width() const
+{
+    return bounds_.x1 - bounds_.x0;
+}
+
+int DotMatrixCanvas::height() const
+{
+    return bounds_.y1 - bounds_.y0;
+}
+
+void DotMatrixCanvas::plot(int x, int y, const DotMatrixColour &colour)
+{
+    const int px = bounds_.x0 + x;
+    const int py = bounds_.y0 + y;
+    if (!contains(bounds_, px, py) || !DotMatrixPanel::contains(px, py))
+        return;
+
+    if (panel_.updatePixel(px, py, colour.r, colour.g, colour.b))
+        changed_++;
+}
+
+void DotMatrixCanvas::scroll(DotMatrixScrollDirection direction, uint8_t amount,
+                             const DotMatrixColour &fill)
+{
+    if (panel_.scroll(bounds_, direction, amount, false, fill).isEmpty())
+        return;
+
+    // Every pixel that moved goes out again.
+    const int w = min_int(bounds_.x1, DotMatrixPanel::width) - max_int(bounds_.x0, 0);
+    const int h = min_int(bounds_.y1, DotMatrixPanel::height) - max_int(bounds_.y0, 0);
+    changed_ += w * h;
+}
+
+uint32_t DotMatrixCanvas::changed() const
+{
+    return changed_;
+}
+
+DotMatrixWidget::DotMatrixWidget(int x, int y, int w, int h)
+    : foreground_(WHITE)
+    , background_(BLACK)
+    , bounds_(make_rect(x, y, w, h))
+    , painted_{0, 0, 0, 0}
+    , visible_(true)
+    , dirty_(true)
+    , full_(true)
+{
+}
+
+const DotMatrixRect &DotMatrixWidget::bounds() const
+{
+    return bounds_;
+}
+
+void DotMatrixWidget::setPosition(int x, int y)
+{
+    if (x == bounds_.x0 && y == bounds_.y0)
+        return;
+
+    bounds_ = make_rect(x, y, bounds_.x1 - bounds_.x0, bounds_.y1 - bounds_.y0);
+    invalidate();
+}
+
+bool DotMatrixWidget::isVisible() const
+{
+    return visible_;
+}
+
+void DotMatrixWidget::setVisible(bool visible)
+{
+    if (visible == visible_)
+        return;
+
+    visible_ = visible;
+    invalidate();
+}
+
+void DotMatrixWidget::setColours(const DotMatrixColour &foreground,
+                                 const DotMatrixColour &background)
+{
+    foreground_ = foreground;
+    background_ = background;
+    invalidate();
+}
+
+bool DotMatrixWidget::isDirty() const
+{
+    return dirty_;
+}
+
+void DotMatrixWidget::invalidate()
+{
+    dirty_ = true;
+    full_ = true;
+}
+
+void DotMatrixWidget::invalidatePart()
+{
+    dirty_ = true;
+}
+
+bool DotMatrixWidget::fullPaint() const
+{
+    return full_;
+}
+
+DotMatrixLabel::DotMatrixLabel(int x, int y, int w, DotMatrixAlign align)
+    : DotMatrixWidget(x, y, w, DOTMATRIX_SMALL_GLYPH_HEIGHT)
+    , length_(0)
+    , align_(align)
+{
+    text_[0] = 0;
+}
+
+void DotMatrixLabel::setText(const char *text)
+{
+    const uint32_t length = strnlen(text, DOTMATRIX_LABEL_MAX_CHARACTERS);
+    if (length == length_ && memcmp(text, text_, length) == 0)
+        return;
+
+    memcpy(text_, text, length);
+    text_[length] = 0;
+    length_ = length;
+    invalidate();
+}
+
+const char *DotMatrixLabel::text() const
+{
+    return text_;
+}
+
+void DotMatrixLabel::paint(DotMatrixCanvas &canvas)
+{
+    const int textWidth = length_ ? length_ * DOTMATRIX_SMALL_ADVANCE - 1 : 0;
+
+    int origin = 0;
+    if (align_ == DOTMATRIX_ALIGN_RIGHT)
+        origin = canvas.width() - textWidth;
+    else if (align_ == DOTMATRIX_ALIGN_CENTRE)
+        origin = (canvas.width() - textWidth) / 2;
+
+    for (int y = 0; y < canvas.height(); y++)
+    {
+        for (int x = 0; x < canvas.width(); x++)
+        {
+            const int tx = x - origin;
+            const bool inked = tx >= 0 && tx < textWidth &&
+                               dotmatrix_small_glyph_pixel(text_[tx / DOTMATRIX_SMALL_ADVANCE],
+                                                           tx % DOTMATRIX_SMALL_ADVANCE, y);
+            canvas.plot(x, y, inked ? foreground_ : background_);
+        }
+    }
+}
+
+DotMatrixCounter::DotMatrixCounter(int x, int y, uint8_t digits)
+    : DotMatrixLabel(x, y, digits * DOTMATRIX_SMALL_ADVANCE - 1, DOTMATRIX_ALIGN_RIGHT)
+    , value_(0)
+{
+    setValue(0);
+}
+
+void DotMatrixCounter::setValue(int32_t value)
+{
+    value_ = value;
+
+    const uint32_t digits = (bounds().x1 - bounds().x0 + 1) / DOTMATRIX_SMALL_ADVANCE;
+    char text[DOTMATRIX_LABEL_MAX_CHARACTERS + 1];
+    const int length = snprintf(text, sizeof(text), "%ld", (long)value);
+
+    if (length < 0 || (uint32_t)length > digits)
+    {
+        const uint32_t n = digits < DOTMATRIX_LABEL_MAX_CHARACTERS ? digits
+                                                                   : DOTMATRIX_LABEL_MAX_CHARACTERS;
+        memset(text, '#', n);
+        text[n] = 0;
+    }
+
+    setText(text);
+}
+
+int32_t DotMatrixCounter::value() const
+{
+    return value_;
+}
+
+DotMatrixBarGauge::DotMatrixBarGauge(int x, int y, int w, int h, bool vertical)
+    : DotMatrixWidget(x, y, w, h)
+    , min_(0)
+    , max_(100)
+    , value_(0)
+    , vertical_(vertical)
+{
+}
+
+void DotMatrixBarGauge::setRange(int32_t min, int32_t max)
+{
+    min_ = min;
+    max_ = max > min ? max : min + 1;
+    invalidate();
+}
+
+void DotMatrixBarGauge::setValue(int32_t value)
+{
+    // Only a change in the filled length needs a repaint.
+    const int before = filled();
+    value_ = value;
+    if (filled() != before)
+        invalidate();
+}
+
+int32_t DotMatrixBarGauge::value() const
+{
+    return value_;
+}
+
+int DotMatrixBarGauge::filled() const
+{
+    const DotMatrixRect &b = bounds();
+    const int length = vertical_ ? b.y1 - b.y0 : b.x1 - b.x0;
+    const int32_t value = value_ < min_ ? min_ : value_ > max_ ? max_ : value_;
+    return ((int64_t)(value - min_) * length + (max_ - min_) / 2) / (max_ - min_);
+}
+
+void DotMatrixBarGauge::paint(DotMatrixCanvas &canvas)
+{
+    const int fill = filled();
+
+    for (int y = 0; y < canvas.height(); y++)
+    {
+        for (int x = 0; x < canvas.width(); x++)
+        {
+            const bool on = vertical_ ? canvas.height() - 1 - y < fill : x < fill;
+            canvas.plot(x, y, on ? foreground_ : background_);
+        }
+    }
+}
+
+DotMatrixSparkline::DotMatrixSparkline(int x, int y, int w, int h)
+    : DotMatrixWidget(x, y, min_int(w, DotMatrixPanel::width), h)
+    , count_(0)
+    , head_(0)
+    , pending_(0)
+    , min_(0)
+    , max_(100)
+{
+}
+
+void DotMatrixSparkline::setRange(int16_t min, int16_t max)
+{
+    min_ = min;
+    max_ = max > min ? max : min + 1;
+    invalidate();
+}
+
+void DotMatrixSparkline::push(int16_t sample)
+{
+    const uint32_t capacity = bounds().x1 - bounds().x0;
+
+    samples_[head_] = sample;
+    head_ = (head_ + 1) % capacity;
+    if (count_ < capacity)
+        count_++;
+    if (pending_ < capacity)
+        pending_++;
+
+    invalidatePart();
+}
+
+int DotMatrixSparkline::row(uint32_t i) const
+{
+    const uint32_t capacity = bounds().x1 - bounds().x0;
+    const int height = bounds().y1 - bounds().y0;
+
+    int32_t sample = samples_[(head_ + capacity - count_ + i) % capacity];
+    sample = sample < min_ ? min_ : sample > max_ ? max_ : sample;
+    return height - 1 - (sample - min_) * (height - 1) / (max_ - min_);
+}
+
+void DotMatrixSparkline::paintColumn(DotMatrixCanvas &canvas, int x)
+{
+    // The newest sample sits in the rightmost column.
+    const int first = canvas.width() - count_;
+
+    int lo = canvas.height();
+    int hi = -1;
+    if (x >= first)
+    {
+        // Joined to the previous sample by a vertical run, so steep changes stay a line.
+        const int i = x - first;
+        const int here = row(i);
+        const int previous = i > 0 ? row(i - 1) : here;
+        lo = min_int(here, previous);
+        hi = max_int(here, previous);
+    }
+
+    for (int y = 0; y < canvas.height(); y++)
+        canvas.plot(x, y, y >= lo && y <= hi ? foreground_ : background_);
+}
+
+void DotMatrixSparkline::paint(DotMatrixCanvas &canvas)
+{
+    // Columns already on the panel move left with the block move; only the new ones are
+    // painted.
+    int x = 0;
+    if (!fullPaint() && pending_ < canvas.width())
+    {
+        canvas.scroll(DOTMATRIX_SCROLL_LEFT, pending_, background_);
+        x = canvas.width() - pending_;
+
+        // The oldest sample shown has lost the one it was joined to.
+        if (count_ == canvas.width())
+            paintColumn(canvas, 0);
+    }
+
+    for (; x < canvas.width(); x++)
+        paintColumn(canvas, x);
+
+    pending_ = 0;
+}
+
+DotMatrixTicker::DotMatrixTicker(int x, int y, int w)
+    : DotMatrixWidget(x, y, w, DOTMATRIX_SMALL_GLYPH_HEIGHT)
+    , text_("")
+    , textWidth_(0)
+    , offset_(0)
+    , pending_(0)
+{
+}
+
+void DotMatrixTicker::setText(const char *text)
+{
+    const uint32_t length = strlen(text);
+
+    text_ = text;
+    textWidth_ = length ? length * DOTMATRIX_SMALL_ADVANCE - 1 : 0;
+    offset_ = 0;
+    pending_ = 0;
+    invalidate();
+}
+
+void DotMatrixTicker::tick()
+{
+    if (textWidth_ == 0)
+        return;
+
+    // One cycle is the text plus a widget's width of blank before it comes in again.
+    const uint32_t width = bounds().x1 - bounds().x0;
+    offset_ = (offset_ + 1) % (width + textWidth_);
+    if (pending_ < width)
+        pending_++;
+
+    invalidatePart();
+}
+
+bool DotMatrixTicker::inked(int x, int y) const
+{
+    const uint32_t width = bounds().x1 - bounds().x0;
+    const uint32_t column = (offset_ + x) % (width + textWidth_);
+    if (column < width)
+        return false;
+
+    const uint32_t tx = column - width;
+    return dotmatrix_small_glyph_pixel(text_[tx / DOTMATRIX_SMALL_ADVANCE],
+                                       tx % DOTMATRIX_SMALL_ADVANCE, y);
+}
+
+void DotMatrixTicker::paint(DotMatrixCanvas &canvas)
+{
+    int x = 0;
+    if (!fullPaint() && pending_ < canvas.width())
+    {
+        canvas.scroll(DOTMATRIX_SCROLL_LEFT, pending_, background_);
+        x = canvas.width() - pending_;
+    }
+
+    for (; x < canvas.width(); x++)
+        for (int y = 0; y < canvas.height(); y++)
+            canvas.plot(x, y, inked(x, y) ? foreground_ : background_);
+
+    pending_ = 0;
+}
+
+DotMatrixIcon::DotMatrixIcon(int x, int y, const DotMatrixIconBitmap &bitmap)
+    : DotMatrixWidget(x, y, bitmap.width, bitmap.height)
+    , bitmap_(bitmap)
+{
+}
+
+void DotMatrixIcon::setBitmap(const DotMatrixIconBitmap &bitmap)
+{
+    if (bitmap.rows == bitmap_.rows && bitmap.width == bitmap_.width &&
+        bitmap.height == bitmap_.height)
+        return;
+
+    bitmap_ = bitmap;
+    invalidate();
+}
+
+void DotMatrixIcon::paint(DotMatrixCanvas &canvas)
+{
+    for (int y = 0; y < canvas.height(); y++)
+    {
+        for (int x = 0; x < canvas.width(); x++)
+        {
+            const bool inked = x < bitmap_.width && y < bitmap_.height &&
+                               ((bitmap_.rows[y] >> x) & 1);
+            canvas.plot(x, y, inked ? foreground_ : background_);
+        }
+    }
+}
+
+DotMatrixScene::DotMatrixScene(DotMatrixClient &panel)
+    : panel_(panel)
+    , count_(0)
+    , background_(BLACK)
+{
+    resetStats();
+}
+
+int DotMatrixScene::add(DotMatrixWidget &widget)
+{
+    if (count_ == DOTMATRIX_SCENE_MAX_WIDGETS)
+        return DEVICE_NO_RESOURCES;
+
+    widgets_[count_++] = &widget;
+    widget.invalidate();
+    return DEVICE_OK;
+}
+
+void DotMatrixScene::setBackground(const DotMatrixColour &colour)
+{
+    background_ = colour;
+}
+
+uint32_t DotMatrixScene::clear(const DotMatrixRect &area, const DotMatrixRect &keep)
+{
+    DotMatrixCanvas canvas(panel_, area);
+    for (int y = area.y0; y < area.y1; y++)
+        for (int x = area.x0; x < area.x1; x++)
+            if (!contains(keep, x, y))
+                canvas.plot(x - area.x0, y - area.y0, background_);
+    return canvas.changed();
+}
+
+uint32_t DotMatrixScene::render()
+{
+    const uint32_t start = DWT->CYCCNT;
+
+    DotMatrixRect damage[MAX_DAMAGE];
+    uint32_t damaged = 0;
+    uint32_t changed = 0;
+
+    // Uncover what moved or hidden widgets leave behind. Pixels the widget is about to
+    // paint again are skipped, so they are only written once.
+    for (uint32_t i = 0; i < count_; i++)
+    {
+        DotMatrixWidget &widget = *widgets_[i];
+        if (!widget.dirty_ || widget.painted_.isEmpty())
+            continue;
+
+        const DotMatrixRect keep = widget.visible_ ? widget.bounds_ : DotMatrixRect{0, 0, 0, 0};
+        if (same_rect(widget.painted_, keep))
+            continue;
+
+        changed += clear(widget.painted_, keep);
+        damage[damaged++] = widget.painted_;
+        widget.painted_ = {0, 0, 0, 0};
+    }
+
+    // Paint dirty widgets, and anything drawn over an area that changed underneath it.
+    for (uint32_t i = 0; i < count_; i++)
+    {
+        DotMatrixWidget &widget = *widgets_[i];
+        if (!widget.visible_)
+        {
+            widget.dirty_ = false;
+            continue;
+        }
+
+        bool underneath = false;
+        for (uint32_t d = 0; d < damaged && !underneath; d++)
+            underneath = intersects(widget.bounds_, damage[d]);
+        if (!widget.dirty_ && !underneath)
+            continue;
+
+        // A partial paint relies on the widget's last paint still being in place.
+        if (underneath || !same_rect(widget.painted_, widget.bounds_))
+            widget.full_ = true;
+
+        DotMatrixCanvas canvas(panel_, widget.bounds_);
+        widget.paint(canvas);
+        changed += canvas.changed();
+
+        widget.painted_ = widget.bounds_;
+        widget.dirty_ = false;
+        widget.full_ = false;
+        damage[damaged++] = widget.bounds_;
+        stats_.widgetsPainted++;
+    }
+
+    const uint32_t cycles = DWT->CYCCNT - start;
+    stats_.renders++;
+    stats_.pixelsChanged += changed;
+    stats_.lastCycles = cycles;
+    if (cycles > stats_.maxCycles)
+        stats_.maxCycles = cycles;
+
+    return changed;
+}
+
+int DotMatrixScene::update()
+{
+    render();
+    return panel_.writeDirty();
+}
+
+DotMatrixSceneStats DotMatrixScene::stats() const
+{
+    return stats_;
+}
+
+void DotMatrixScene::resetStats()
+{
+    memset(&stats_, 0, sizeof(stats_));
+}
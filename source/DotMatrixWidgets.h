@@ -0,0 +1,272 @@
+#pragma once
+
+#include "DotMatrix.h"
+
+// Retained-mode widgets for dashboards. Each widget keeps its bounds and a dirty flag,
+// and DotMatrixScene repaints only the dirty ones. Every pixel is written once per paint
+// through DotMatrixClient::updatePixel(), so only pixels that really change reach the
+// panel's dirty region and writeDirty() sends the smallest update the protocol allows.
+
+// Widgets a scene can hold.
+#define DOTMATRIX_SCENE_MAX_WIDGETS 16
+
+// Labels and counters use a built-in 3x5 font on a 4 pixel pitch.
+#define DOTMATRIX_SMALL_GLYPH_WIDTH 3
+#define DOTMATRIX_SMALL_GLYPH_HEIGHT 5
+#define DOTMATRIX_SMALL_ADVANCE 4
+
+#define DOTMATRIX_LABEL_MAX_CHARACTERS 16
+
+// True when column `x`, row `y` of character `c` is inked in the small font. Lower case
+// draws as upper case; characters without a glyph are blank.
+bool dotmatrix_small_glyph_pixel(char c, int x, int y);
+
+enum DotMatrixAlign : uint8_t
+{
+    DOTMATRIX_ALIGN_LEFT,
+    DOTMATRIX_ALIGN_CENTRE,
+    DOTMATRIX_ALIGN_RIGHT,
+};
+
+// Where a widget paints: widget coordinates, clipped to its bounds and the panel.
+class DotMatrixCanvas
+{
+public:
+    DotMatrixCanvas(DotMatrixClient &panel, const DotMatrixRect &bounds);
+
+    int width() const;
+    int height() const;
+
+    // Each pixel should be plotted once per paint, or a pixel that goes to another colour
+    // and back would count as changed.
+    void plot(int x, int y, const DotMatrixColour &colour);
+
+    // Moves the whole canvas with DotMatrixClient::scroll(), filling the strip uncovered
+    // with `fill`. Everything under the canvas is sent again.
+    void scroll(DotMatrixScrollDirection direction, uint8_t amount, const DotMatrixColour &fill);
+
+    // Pixels whose stored colour changed.
+    uint32_t changed() const;
+
+private:
+    DotMatrixClient &panel_;
+    const DotMatrixRect bounds_;
+    uint32_t changed_;
+};
+
+class DotMatrixWidget
+{
+public:
+    DotMatrixWidget(int x, int y, int w, int h);
+    virtual ~DotMatrixWidget() {}
+
+    const DotMatrixRect &bounds() const;
+    void setPosition(int x, int y);
+
+    bool isVisible() const;
+    void setVisible(bool visible);
+
+    void setColours(const DotMatrixColour &foreground, const DotMatrixColour &background);
+
+    bool isDirty() const;
+    // Asks for a full repaint on the next render.
+    void invalidate();
+
+protected:
+    DotMatrixColour foreground_;
+    DotMatrixColour background_;
+
+    // Asks for a repaint on the next render that may update only part of the widget.
+    void invalidatePart();
+    // True when paint() must plot the whole canvas: the widget was invalidated, moved,
+    // or something under it changed. Otherwise what the last paint left is still there.
+    bool fullPaint() const;
+
+    // Plots every pixel of the canvas exactly once, or only what changed when fullPaint()
+    // is false.
+    virtual void paint(DotMatrixCanvas &canvas) = 0;
+
+private:
+    DotMatrixRect bounds_;
+    // Where the last paint went, so a moved or hidden widget's old pixels are cleared.
+    DotMatrixRect painted_;
+    bool visible_;
+    bool dirty_;
+    bool full_;
+
+    friend class DotMatrixScene;
+};
+
+// Text in the small font, one line.
+class DotMatrixLabel : public DotMatrixWidget
+{
+public:
+    DotMatrixLabel(int x, int y, int w, DotMatrixAlign align = DOTMATRIX_ALIGN_LEFT);
+
+    // Repaints only if the text differs. Text past DOTMATRIX_LABEL_MAX_CHARACTERS is dropped.
+    void setText(const char *text);
+    const char *text() const;
+
+protected:
+    virtual void paint(DotMatrixCanvas &canvas);
+
+private:
+    char text_[DOTMATRIX_LABEL_MAX_CHARACTERS + 1];
+    uint8_t length_;
+    DotMatrixAlign align_;
+};
+
+// A right-aligned number in a fixed number of character cells. A value too wide for
+// them shows as #s.
+class DotMatrixCounter : public DotMatrixLabel
+{
+public:
+    DotMatrixCounter(int x, int y, uint8_t digits);
+
+    void setValue(int32_t value);
+    int32_t value() const;
+
+private:
+    int32_t value_;
+};
+
+// Filled in proportion to a value between min and max, left to right or bottom to top.
+class DotMatrixBarGauge : public DotMatrixWidget
+{
+public:
+    DotMatrixBarGauge(int x, int y, int w, int h, bool vertical = false);
+
+    void setRange(int32_t min, int32_t max);
+    void setValue(int32_t value);
+    int32_t value() const;
+
+protected:
+    virtual void paint(DotMatrixCanvas &canvas);
+
+private:
+    int32_t min_;
+    int32_t max_;
+    int32_t value_;
+    bool vertical_;
+
+    // Pixels filled along the gauge for the current value.
+    int filled() const;
+};
+
+// The last w samples as a line, newest on the right. A push scrolls the line left and
+// paints only the new column.
+class DotMatrixSparkline : public DotMatrixWidget
+{
+public:
+    DotMatrixSparkline(int x, int y, int w, int h);
+
+    // Values outside the range are drawn at its edge.
+    void setRange(int16_t min, int16_t max);
+    void push(int16_t sample);
+
+protected:
+    virtual void paint(DotMatrixCanvas &canvas);
+
+private:
+    int16_t samples_[DotMatrixPanel::width];
+    uint8_t count_;
+    uint8_t head_;
+    // Samples pushed since the last paint.
+    uint8_t pending_;
+    int16_t min_;
+    int16_t max_;
+
+    // Row of sample `i`, counting from the oldest one shown.
+    int row(uint32_t i) const;
+    void paintColumn(DotMatrixCanvas &canvas, int x);
+};
+
+// Text in the small font crawling right to left, one column per tick(). It enters at the
+// right edge and leaves completely before coming round again. Each tick scrolls the
+// widget and paints only the column coming in.
+class DotMatrixTicker : public DotMatrixWidget
+{
+public:
+    DotMatrixTicker(int x, int y, int w);
+
+    // The text is not copied and must stay valid while it is shown.
+    void setText(const char *text);
+    void tick();
+
+protected:
+    virtual void paint(DotMatrixCanvas &canvas);
+
+private:
+    const char *text_;
+    uint32_t textWidth_;
+    uint32_t offset_;
+    // Ticks since the last paint.
+    uint8_t pending_;
+
+    // Whether canvas pixel (x, y) is inked at the current offset.
+    bool inked(int x, int y) const;
+};
+
+// A 1-bit image up to 16 pixels wide: bit n of rows[y] set when column n is inked.
+struct DotMatrixIconBitmap
+{
+    uint8_t width;
+    uint8_t height;
+    const uint16_t *rows;
+};
+
+class DotMatrixIcon : public DotMatrixWidget
+{
+public:
+    DotMatrixIcon(int x, int y, const DotMatrixIconBitmap &bitmap);
+
+    void setBitmap(const DotMatrixIconBitmap &bitmap);
+
+protected:
+    virtual void paint(DotMatrixCanvas &canvas);
+
+private:
+    DotMatrixIconBitmap bitmap_;
+};
+
+struct DotMatrixSceneStats
+{
+    uint32_t renders;
+    uint32_t widgetsPainted;
+    uint32_t pixelsChanged;
+    uint32_t lastCycles;
+    uint32_t maxCycles;
+};
+
+// Widgets on a background colour, painted in the order they were added, so later ones
+// draw over earlier ones where they overlap.
+class DotMatrixScene
+{
+public:
+    explicit DotMatrixScene(DotMatrixClient &panel);
+
+    // The widget must outlive the scene.
+    int add(DotMatrixWidget &widget);
+
+    void setBackground(const DotMatrixColour &colour);
+
+    // Repaints dirty widgets into the framebuffer, and any widget overlapping one that
+    // moved or was repainted. Returns the number of pixels that changed.
+    uint32_t render();
+
+    // render(), then writeDirty(). Apps pacing frames with DotMatrixFrameScheduler call
+    // render() and submit() instead.
+    int update();
+
+    DotMatrixSceneStats stats() const;
+    void resetStats();
+
+private:
+    DotMatrixClient &panel_;
+    DotMatrixWidget *widgets_[DOTMATRIX_SCENE_MAX_WIDGETS];
+    uint32_t count_;
+    DotMatrixColour background_;
+    DotMatrixSceneStats stats_;
+
+    uint32_t clear(const DotMatrixRect &area, const DotMatrixRect &keep);
+};
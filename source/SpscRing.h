@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+
+// Fixed-size queue with one producer and one consumer and no locks, so the producer
+// may be an interrupt handler while a fiber consumes. Fibers are scheduled
+// cooperatively, so several producer fibers can share one queue as long as none of
+// them yields inside push().
+template <typename T, uint32_t N> class SpscRing
+{
+    static_assert(N != 0 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+    SpscRing() : head_(0), tail_(0) {}
+
+    // Returns false, leaving the queue unchanged, when it is full.
+    bool push(const T &item)
+    {
+        const uint32_t head = head_;
+        if (head - tail_ == N)
+            return false;
+
+        items_[head & (N - 1)] = item;
+        // The item must be in place before the consumer can see the new head.
+        __sync_synchronize();
+        head_ = head + 1;
+        return true;
+    }
+
+    // Returns false when the queue is empty.
+    bool pop(T &item)
+    {
+        const uint32_t tail = tail_;
+        if (head_ == tail)
+            return false;
+
+        __sync_synchronize();
+        item = items_[tail & (N - 1)];
+        // Finish reading the slot before the producer may reuse it.
+        __sync_synchronize();
+        tail_ = tail + 1;
+        return true;
+    }
+
+    bool empty() const { return head_ == tail_; }
+    bool full() const { return head_ - tail_ == N; }
+    uint32_t size() const { return head_ - tail_; }
+
+private:
+    T items_[N];
+
+    // Free-running counts; N divides 2^32, so they index correctly across wrap-around.
+    volatile uint32_t head_;
+    volatile uint32_t tail_;
+};
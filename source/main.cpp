@@ -1,23 +1,259 @@
 #include "MicroBit.h"
 #include "DotMatrix.h"
+#include "DotMatrixAssets.h"
+#include "DotMatrixConsole.h"
+#include "DotMatrixFrameScheduler.h"
+#include "DotMatrixLog.h"
+#include "DotMatrixPlaylist.h"
+#include "DotMatrixRadio.h"
+#include "DotMatrixSerialIngest.h"
+#include "DotMatrixTrace.h"
+#include "samples/Tests.h"
+
+#include <stdlib.h>
+#include <string.h>
 
 MicroBit uBit;
 static DotMatrixClient dotMatrix(uBit);
-
-static bool connected = false;
+static DotMatrixFrameScheduler frameScheduler(dotMatrix, 20);
+static DotMatrixAssetStore assets;
+static DotMatrixPlaylist playlist(dotMatrix);
 
 extern "C" void log_string(const char *str)
 {
     uBit.serial.printf("%s\r\n", str);
 }
 
+static void trace_command(MicroBit &uBit, const char *)
+{
+    dotmatrix_trace_dump(uBit);
+}
+
+static void stats_command(MicroBit &uBit, const char *args)
+{
+    if (strcmp(args, "reset") == 0)
+    {
+        dotMatrix.resetStats();
+        uBit.serial.printf("stats reset\r\n");
+        return;
+    }
+
+    const DotMatrixStats s = dotMatrix.stats();
+    uBit.serial.printf("elapsed_ms %d\r\n", (int)s.elapsedMs);
+    uBit.serial.printf("bytes_sent %d\r\n", (int)s.bytesSent);
+    uBit.serial.printf("writes_sent %d\r\n", (int)s.writesSent);
+    uBit.serial.printf("packets_sent %d\r\n", (int)s.packetsSent);
+    uBit.serial.printf("packets_failed %d\r\n", (int)s.packetsFailed);
+    uBit.serial.printf("avg_bytes_per_s %d\r\n", (int)s.averageBytesPerSecond);
+    uBit.serial.printf("peak_bytes_per_s %d\r\n", (int)s.peakBytesPerSecond);
+    uBit.serial.printf("stalls %d\r\n", (int)s.stalls);
+    uBit.serial.printf("stall_time_us %d\r\n", (int)s.stallTimeUs);
+    uBit.serial.printf("connections %d\r\n", (int)s.connections);
+    uBit.serial.printf("mtu %d\r\n", s.mtu);
+    uBit.serial.printf("chunk_size %d\r\n", s.chunkSize);
+    for (int i = 0; i < DOTMATRIX_WRITE_RSP_BUCKETS; i++)
+    {
+        const char *bound = i < DOTMATRIX_WRITE_RSP_BUCKETS - 1 ? "lt" : "ge";
+        const int ms = i < DOTMATRIX_WRITE_RSP_BUCKETS - 1 ? 1 << i : 1 << (i - 1);
+        uBit.serial.printf("write_rsp_%s_%dms %d\r\n", bound, ms, (int)s.writeRspHistogram[i]);
+    }
+}
+
+// "ingest [baud]": takes frames from serial_send.py until it finishes.
+static void ingest_command(MicroBit &uBit, const char *args)
+{
+    static DotMatrixSerialIngest ingest(uBit, dotMatrix, frameScheduler);
+
+    const uint32_t baud = *args ? strtoul(args, nullptr, 10) : DOTMATRIX_INGEST_BAUD;
+
+    playlist.setPaused(true);
+    ingest.run(baud, 115200);
+    playlist.setPaused(false);
+}
+
+// "brightness [0-255]": shows or sets the panel brightness and resends the frame.
+static void brightness_command(MicroBit &uBit, const char *args)
+{
+    if (*args)
+    {
+        const uint32_t level = strtoul(args, nullptr, 10);
+        dotMatrix.setBrightness(level > 255 ? 255 : level);
+        if (dotMatrix.isReady())
+            dotMatrix.writeImage();
+    }
+
+    uBit.serial.printf("brightness %d\r\n", (int)dotMatrix.brightness());
+}
+
+// The greeting, then everything in flash that can be shown.
+static void load_playlist()
+{
+    playlist.clear();
+    playlist.addText("Hello, World!");
+    for (uint32_t i = 0; i < assets.count(); i++)
+    {
+        DotMatrixAsset a;
+        assets.get(i, a);
+        if (a.format != DOTMATRIX_ASSET_RAW)
+            playlist.addAsset(a);
+    }
+}
+
+static const char *const ASSET_FORMATS[] = {"raw", "image", "animation", "text"};
+
+// "assets [erase]": lists the assets in flash, or erases them all.
+static void assets_command(MicroBit &uBit, const char *args)
+{
+    if (strcmp(args, "erase") == 0)
+    {
+        // The playlist reads its assets in place, so it must not be sending one while the
+        // flash is erased, and must not keep any afterwards.
+        playlist.setPaused(true);
+        dotMatrix.waitForIdle();
+        const int rc = assets.erase();
+        if (rc == DEVICE_OK)
+            load_playlist();
+        playlist.setPaused(false);
+
+        uBit.serial.printf(rc == DEVICE_OK ? "assets erased\r\n" : "erase failed %d\r\n", rc);
+        return;
+    }
+
+    for (uint32_t i = 0; i < assets.count(); i++)
+    {
+        DotMatrixAsset a;
+        assets.get(i, a);
+
+        // Names are not NUL-terminated in flash.
+        char name[DOTMATRIX_ASSET_NAME_MAX + 1];
+        memcpy(name, a.name, a.nameLength);
+        name[a.nameLength] = 0;
+
+        uBit.serial.printf("%s %s %d bytes%s", name,
+                           a.format <= DOTMATRIX_ASSET_TEXT ? ASSET_FORMATS[a.format] : "?",
+                           (int)a.length, a.compressed ? " compressed" : "");
+        if (a.format == DOTMATRIX_ASSET_ANIMATION)
+            uBit.serial.printf(", %d frames at %d ms", a.frames, a.frameMs);
+        uBit.serial.printf("\r\n");
+    }
+    uBit.serial.printf("%d assets, %d bytes free, %d skipped\r\n",
+                       (int)assets.count(),
+                       (int)assets.freeBytes(),
+                       (int)assets.skipped());
+}
+
+// "show <name>": shows an image or text asset, or plays an animation once.
+static void show_command(MicroBit &uBit, const char *args)
+{
+    static DotMatrixAssetStream stream;
+
+    DotMatrixAsset a;
+    if (assets.find(args, a) != DEVICE_OK)
+    {
+        uBit.serial.printf("no asset %s\r\n", args);
+        return;
+    }
+    if (!dotMatrix.isReady())
+    {
+        uBit.serial.printf("panel not connected\r\n");
+        return;
+    }
+
+    if (a.format == DOTMATRIX_ASSET_TEXT)
+    {
+        ManagedString text((const char *)a.data, a.length);
+        dotMatrix.writeText(text);
+        return;
+    }
+
+    // A count of 0 opens as one frame.
+    const uint32_t frames = a.frames ? a.frames : 1;
+    dotMatrix.setImageModeDiy();
+    for (uint32_t frame = 0; frame < frames; frame++)
+    {
+        const uint32_t start = system_timer_current_time();
+
+        // The stream is read while the frame is sent, so the last one must be out first.
+        dotMatrix.waitForIdle();
+        if (stream.open(a, frame) != DEVICE_OK)
+        {
+            uBit.serial.printf("%s is not an image for this panel\r\n", args);
+            return;
+        }
+        stream.show(dotMatrix);
+
+        const uint32_t elapsed = system_timer_current_time() - start;
+        if (frame + 1 < frames && elapsed < a.frameMs)
+            uBit.sleep(a.frameMs - elapsed);
+    }
+}
+
+// "playlist [reset]": shows or resets playlist timing.
+static void playlist_command(MicroBit &uBit, const char *args)
+{
+    if (strcmp(args, "reset") == 0)
+    {
+        playlist.resetStats();
+        uBit.serial.printf("playlist stats reset\r\n");
+        return;
+    }
+
+    const DotMatrixPlaylistStats s = playlist.stats();
+    uBit.serial.printf("items %d\r\n", (int)s.items);
+    uBit.serial.printf("skipped %d\r\n", (int)s.skipped);
+    uBit.serial.printf("last_error_ms %d\r\n", (int)s.lastErrorMs);
+    uBit.serial.printf("avg_error_ms %d\r\n", (int)s.averageErrorMs);
+    uBit.serial.printf("max_error_ms %d\r\n", (int)s.maxErrorMs);
+    uBit.serial.printf("frames %d\r\n", (int)s.frames);
+    uBit.serial.printf("late_frames %d\r\n", (int)s.lateFrames);
+    uBit.serial.printf("text_lead_ms %d\r\n", (int)s.textLeadMs);
+    uBit.serial.printf("image_lead_ms %d\r\n", (int)s.imageLeadMs);
+}
+
+#if CONFIG_ENABLED(DOTMATRIX_RADIO_GATEWAY)
+static DotMatrixRadioGateway radioGateway(uBit, dotMatrix);
+
+static void radio_command(MicroBit &uBit, const char *)
+{
+    const DotMatrixRadioStats s = radioGateway.stats();
+    uBit.serial.printf("datagrams %d\r\n", (int)s.datagrams);
+    uBit.serial.printf("messages %d\r\n", (int)s.messages);
+    uBit.serial.printf("duplicates %d\r\n", (int)s.duplicates);
+    uBit.serial.printf("malformed %d\r\n", (int)s.malformed);
+    uBit.serial.printf("incomplete %d\r\n", (int)s.incomplete);
+    uBit.serial.printf("batches %d\r\n", (int)s.batches);
+}
+#endif
+
+static const DotMatrixCommand commands[] = {
+    {"trace", trace_command},
+    {"stats", stats_command},
+    {"ingest", ingest_command},
+    {"brightness", brightness_command},
+    {"assets", assets_command},
+    {"show", show_command},
+    {"playlist", playlist_command},
+#if CONFIG_ENABLED(DOTMATRIX_RADIO_GATEWAY)
+    {"radio", radio_command},
+#endif
+};
+
 
 
 int main()
 {
     uBit.init();
+
+#if CONFIG_ENABLED(DOTMATRIX_RADIO_SENDER)
+    // Senders only talk to a gateway, so they never start BLE.
+    radio_sender_demo();
+#endif
+
     uBit.serial.setBaudrate(115200);
     uBit.serial.printf("BLE Scanner Starting...\r\n");
+    dotmatrix_log_start(uBit);
+    assets.mount();
+    dotmatrix_console_start(uBit, commands, sizeof(commands) / sizeof(commands[0]));
 
     dotMatrix.fillTestPattern();
 
@@ -34,18 +270,18 @@ int main()
         fiber_sleep(100); // Small delay to let connection stabilize
 
         dotMatrix.onConnected();
-
-        connected = true;
     });
 
     uBit.messageBus.listen(MICROBIT_ID_BLE, MICROBIT_BLE_EVT_DISCONNECTED, [](MicroBitEvent) {
-        connected = false;
         dotMatrix.onDisconnected();
         uBit.serial.printf("Device lost!\r\n");
         uBit.display.print('L');
     });
 
     uBit.messageBus.listen(MICROBIT_ID_BUTTON_A, MICROBIT_BUTTON_EVT_CLICK, [](MicroBitEvent) {
+        // Held for one image's time before the playlist carries on.
+        playlist.setPaused(true);
+        dotMatrix.waitForIdle();
         dotMatrix.setImageModeDiy();
         dotMatrix.clearDisplay();
 
@@ -68,28 +304,55 @@ int main()
         }
 
         dotMatrix.writeImage();
+        dotMatrix.waitForIdle();
+        uBit.sleep(DOTMATRIX_PLAYLIST_IMAGE_MS);
+        playlist.setPaused(false);
+    });
+
+    uBit.messageBus.listen(MICROBIT_ID_BUTTON_B, MICROBIT_BUTTON_EVT_CLICK, [](MicroBitEvent) {
+        DotMatrixObserverTiming t = dotMatrix.observerTiming();
+        uBit.serial.printf("Observer: %d events, avg %d cycles, max %d cycles, %d dropped\r\n",
+                           (int)t.events,
+                           t.events ? (int)(t.totalCycles / t.events) : 0,
+                           (int)t.maxCycles,
+                           (int)t.dropped);
     });
 
     uBit.bleManager.listenForDevice(ManagedString("IDM-68B955"));
 
+#if CONFIG_ENABLED(DOTMATRIX_BENCHMARK)
+    dotmatrix_benchmark(dotMatrix);
+#endif
 
-    while (true)
-    {
-        if (connected && dotMatrix.isReady())
-        {
-            uBit.serial.printf("Writing image...\r\n");
+#if CONFIG_ENABLED(DOTMATRIX_RADIO_GATEWAY)
+    radioGateway.start();
+#endif
 
-            ManagedString s = ManagedString("Hello, World!");
+#if CONFIG_ENABLED(DOTMATRIX_SPECTRUM)
+    spectrum_visualiser(dotMatrix);
+#endif
 
-            dotMatrix.writeText(s);
-            uBit.sleep(1520*s.length()); // 95 * width of each character
-            // dotMatrix.setImageModeDiy();
-            // dotMatrix.writeImage();
-        }
-        uBit.sleep(5000);
-    }
+#if CONFIG_ENABLED(DOTMATRIX_SHADER_DEMO)
+    shader_demo(dotMatrix);
+#endif
+
+#if CONFIG_ENABLED(DOTMATRIX_DASHBOARD)
+    dashboard_demo(dotMatrix);
+#endif
+
+#if CONFIG_ENABLED(DOTMATRIX_LAYER_DEMO)
+    layer_demo(dotMatrix);
+#endif
 
+#if CONFIG_ENABLED(DOTMATRIX_TWEEN_DEMO)
+    tween_demo(dotMatrix);
+#endif
 
+    // The gateway owns the panel in its builds; the playlist would draw over what it relays.
+#if !CONFIG_ENABLED(DOTMATRIX_RADIO_GATEWAY)
+    load_playlist();
+    playlist.start();
+#endif
 
     // while (true)
     // {
@@ -0,0 +1,81 @@
+#include "MicroBit.h"
+#include "Tests.h"
+#include "DotMatrixFrameScheduler.h"
+#include "DotMatrixWidgets.h"
+
+#if CONFIG_ENABLED(DOTMATRIX_DASHBOARD)
+
+// A sensor dashboard built from widgets: uptime, temperature with its history, and the
+// light level. Only what changed between frames is repainted and sent.
+
+namespace
+{
+static_assert(DotMatrixPanel::width >= 32, "the dashboard is laid out for 32x32 and up");
+
+constexpr uint32_t DASHBOARD_FPS = 5;
+constexpr uint32_t SAMPLE_MS = 200;
+// A sparkline column every two seconds.
+constexpr uint32_t HISTORY_EVERY = 10;
+
+// 5x5 thermometer.
+const uint16_t THERMOMETER_ROWS[] = {0x04, 0x04, 0x04, 0x0e, 0x0e};
+const DotMatrixIconBitmap THERMOMETER = {5, 5, THERMOMETER_ROWS};
+
+constexpr DotMatrixColour TITLE = {0, 160, 255};
+constexpr DotMatrixColour WARM = {255, 120, 0};
+constexpr DotMatrixColour LIGHT = {255, 220, 0};
+constexpr DotMatrixColour BLACK = {0, 0, 0};
+} // namespace
+
+void dashboard_demo(DotMatrixClient &panel)
+{
+    static DotMatrixFrameScheduler scheduler(panel, DASHBOARD_FPS);
+    static DotMatrixScene scene(panel);
+
+    static DotMatrixLabel title(0, 0, DotMatrixPanel::width, DOTMATRIX_ALIGN_CENTRE);
+    static DotMatrixIcon icon(0, 7, THERMOMETER);
+    static DotMatrixCounter temperature(6, 7, 3);
+    static DotMatrixCounter uptime(DotMatrixPanel::width - 15, 7, 4);
+    static DotMatrixSparkline history(0, 14, DotMatrixPanel::width, DotMatrixPanel::height - 20);
+    static DotMatrixBarGauge light(0, DotMatrixPanel::height - 4, DotMatrixPanel::width, 4);
+
+    title.setText("SENSORS");
+    title.setColours(TITLE, BLACK);
+    icon.setColours(WARM, BLACK);
+    temperature.setColours(WARM, BLACK);
+    history.setColours(WARM, BLACK);
+    history.setRange(10, 35);
+    light.setColours(LIGHT, BLACK);
+    light.setRange(0, 255);
+
+    scene.add(title);
+    scene.add(icon);
+    scene.add(temperature);
+    scene.add(uptime);
+    scene.add(history);
+    scene.add(light);
+
+    while (!panel.isReady())
+        uBit.sleep(100);
+
+    panel.setImageModeDiy();
+    panel.clearDisplay();
+    scheduler.start();
+
+    for (uint32_t tick = 0;; tick++)
+    {
+        const int celsius = uBit.thermometer.getTemperature();
+        temperature.setValue(celsius);
+        uptime.setValue(system_timer_current_time() / 1000);
+        light.setValue(uBit.display.readLightLevel());
+        if (tick % HISTORY_EVERY == 0)
+            history.push(celsius);
+
+        if (scene.render())
+            scheduler.submit();
+
+        uBit.sleep(SAMPLE_MS);
+    }
+}
+
+#endif
@@ -0,0 +1,361 @@
+#include "MicroBit.h"
+#include "Tests.h"
+#include "DotMatrix.h"
+#include "DotMatrixPixelFormat.h"
+#include "DotMatrixTrace.h"
+#include "DotMatrixWidgets.h"
+#include "ShaderEffects.h"
+
+#include "ble_gap.h"
+
+#include <stdio.h>
+
+// Fixed workload for comparing firmware versions on the same panel. Each case prints one
+// CSV row; times run from the first call until the transmit fiber has handed the last
+// write to the SoftDevice. Pixel format kernels, shaders, colour correction and scrolling
+// are timed first, without the link.
+
+namespace
+{
+constexpr uint32_t FRAME_ITERATIONS = 10;
+constexpr uint32_t PIXEL_BURST = 64;
+constexpr uint32_t SCORE_ITERATIONS = 20;
+constexpr uint32_t DIGIT_ITERATIONS = 10;
+constexpr uint32_t TEXT_LENGTHS[] = {1, 8, 16, DOTMATRIX_TEXT_MAX_CHARACTERS};
+
+// How long the app's own listeners get to reconnect before the case gives up.
+constexpr uint32_t RECONNECT_TIMEOUT_MS = 30000;
+
+constexpr uint32_t FORMAT_ITERATIONS = 10;
+constexpr uint32_t FORMAT_SPAN = 64;
+
+static uint64_t case_start_us;
+
+// Large enough for a frame in any format, and an RGB888 span as sendImage() uses.
+static uint8_t format_frame[DotMatrixRgb888::bytes(DotMatrixPanel::pixels)];
+static uint8_t format_span[FORMAT_SPAN * 3];
+
+// Cycles to store a frame pixel by pixel, and to expand it to RGB888 span by span.
+template <typename Format>
+static void pixel_format()
+{
+    const uint32_t pixels = DotMatrixPanel::pixels;
+
+    uint32_t start = DWT->CYCCNT;
+    for (uint32_t i = 0; i < FORMAT_ITERATIONS; i++)
+        for (uint32_t p = 0; p < pixels; p++)
+            Format::set(format_frame, p, p * 7, p * 3 + i, p >> 2);
+    const uint32_t setCycles = (DWT->CYCCNT - start) / FORMAT_ITERATIONS;
+
+    start = DWT->CYCCNT;
+    for (uint32_t i = 0; i < FORMAT_ITERATIONS; i++)
+        for (uint32_t first = 0; first < pixels; first += FORMAT_SPAN)
+            Format::expand(format_frame, first, FORMAT_SPAN, format_span);
+    const uint32_t expandCycles = (DWT->CYCCNT - start) / FORMAT_ITERATIONS;
+
+    uBit.serial.printf("%s,%d,%d,%d,%d,%d.%02d\r\n",
+                       Format::name,
+                       (int)pixels,
+                       (int)Format::bytes(pixels),
+                       (int)setCycles,
+                       (int)expandCycles,
+                       (int)(expandCycles / pixels),
+                       (int)(expandCycles * 100 / pixels % 100));
+}
+
+// Cycles to evaluate a whole frame in spans, as DotMatrixClient emits a shader frame.
+static void shader_frame_cycles(const char *name, const DotMatrixShader &shader)
+{
+    const uint32_t start = DWT->CYCCNT;
+    for (uint32_t i = 0; i < FORMAT_ITERATIONS; i++)
+    {
+        for (uint32_t y = 0; y < DotMatrixPanel::height; y++)
+        {
+            for (uint32_t x = 0; x < DotMatrixPanel::width; x += FORMAT_SPAN)
+            {
+                const uint32_t count = DotMatrixPanel::width - x < FORMAT_SPAN
+                                           ? DotMatrixPanel::width - x
+                                           : FORMAT_SPAN;
+                if (shader.span)
+                {
+                    shader.span(x, y, count, i * 40, format_span, shader.context);
+                }
+                else
+                {
+                    for (uint32_t p = 0; p < count; p++)
+                        shader.pixel(x + p, y, i * 40, &format_span[p * 3], shader.context);
+                }
+            }
+        }
+    }
+    const uint32_t cycles = (DWT->CYCCNT - start) / FORMAT_ITERATIONS;
+
+    uBit.serial.printf("%s,%d,%d\r\n", name, (int)cycles, (int)(cycles / DotMatrixPanel::pixels));
+}
+
+// Cycles to rebuild the correction tables, as a brightness change does, and to apply
+// them to a frame as it is sent.
+static void colour_correction()
+{
+    static DotMatrixColourCorrection colour;
+
+    uint32_t start = DWT->CYCCNT;
+    colour.setBrightness(128);
+    const uint32_t rebuildCycles = DWT->CYCCNT - start;
+
+    start = DWT->CYCCNT;
+    for (uint32_t i = 0; i < FORMAT_ITERATIONS; i++)
+        for (uint32_t first = 0; first < DotMatrixPanel::pixels; first += FORMAT_SPAN)
+            DotMatrixColourCorrection::apply(colour.tables(), format_span, FORMAT_SPAN);
+    const uint32_t applyCycles = (DWT->CYCCNT - start) / FORMAT_ITERATIONS;
+
+    uBit.serial.printf("# colour correction, gamma %d.%02d\r\n", DOTMATRIX_GAMMA_X100 / 100,
+                       DOTMATRIX_GAMMA_X100 % 100);
+    uBit.serial.printf("rebuild_cycles,apply_cycles_per_frame\r\n");
+    uBit.serial.printf("%d,%d\r\n", (int)rebuildCycles, (int)applyCycles);
+}
+
+// Cycles to shift the framebuffer one column, by DotMatrixClient::scroll() and by reading
+// and writing every pixel, as code without it would.
+static void scrolling(DotMatrixClient &panel)
+{
+    const DotMatrixColour black = {0, 0, 0};
+
+    uint32_t start = DWT->CYCCNT;
+    for (uint32_t i = 0; i < FORMAT_ITERATIONS; i++)
+        panel.scroll(DOTMATRIX_SCROLL_LEFT, 1, false, black);
+    const uint32_t scrollCycles = (DWT->CYCCNT - start) / FORMAT_ITERATIONS;
+
+    uint8_t rgb[3];
+    start = DWT->CYCCNT;
+    for (uint32_t i = 0; i < FORMAT_ITERATIONS; i++)
+    {
+        for (uint32_t y = 0; y < DotMatrixPanel::height; y++)
+        {
+            for (uint32_t x = 0; x + 1 < DotMatrixPanel::width; x++)
+            {
+                panel.getPixel(x + 1, y, rgb);
+                panel.setPixel(x, y, rgb[0], rgb[1], rgb[2]);
+            }
+            panel.setPixel(DotMatrixPanel::width - 1, y, 0, 0, 0);
+        }
+    }
+    const uint32_t redrawCycles = (DWT->CYCCNT - start) / FORMAT_ITERATIONS;
+
+    uBit.serial.printf("# scroll one column, %s\r\n", DotMatrixFramebufferFormat::name);
+    uBit.serial.printf("scroll_cycles,redraw_cycles\r\n");
+    uBit.serial.printf("%d,%d\r\n", (int)scrollCycles, (int)redrawCycles);
+}
+
+static void shaders()
+{
+    uBit.serial.printf("# shaders\r\n");
+    uBit.serial.printf("shader,cycles_per_frame,cycles_per_pixel\r\n");
+
+    shader_frame_cycles("plasma", {shader_plasma, nullptr, nullptr});
+    shader_frame_cycles("gradient", {nullptr, shader_gradient, nullptr});
+    shader_frame_cycles("test_pattern", {shader_test_pattern, nullptr, nullptr});
+}
+
+static void pixel_formats()
+{
+    static_assert(DotMatrixPanel::pixels % FORMAT_SPAN == 0, "spans must tile the frame");
+
+    dotmatrix_cycle_counter_enable();
+    DotMatrixIndexed8::resetPalette();
+
+    uBit.serial.printf("# pixel formats, %s in use\r\n", DotMatrixFramebufferFormat::name);
+    uBit.serial.printf("format,pixels,storage_bytes,set_cycles,expand_cycles,"
+                       "expand_cycles_per_pixel\r\n");
+
+    pixel_format<DotMatrixRgb888>();
+    pixel_format<DotMatrixRgb565>();
+    pixel_format<DotMatrixIndexed8>();
+    pixel_format<DotMatrixMono>();
+}
+
+static void case_begin(DotMatrixClient &panel)
+{
+    panel.waitForIdle();
+    panel.resetStats();
+    case_start_us = system_timer_current_time_us();
+}
+
+static void case_end(DotMatrixClient &panel, const char *name, uint32_t iterations)
+{
+    panel.waitForIdle();
+    const uint32_t elapsed = (uint32_t)(system_timer_current_time_us() - case_start_us);
+    const DotMatrixStats stats = panel.stats();
+    const uint32_t rate = elapsed ? (uint64_t)stats.bytesSent * 1000000 / elapsed : 0;
+
+    uBit.serial.printf("%s,%d,%d,%d,%d,%d,%d,%d\r\n",
+                       name,
+                       (int)iterations,
+                       (int)elapsed,
+                       (int)(elapsed / iterations),
+                       (int)stats.bytesSent,
+                       (int)rate,
+                       (int)stats.stalls,
+                       (int)stats.packetsFailed);
+}
+
+static void wait_until_ready(DotMatrixClient &panel)
+{
+    while (!panel.isReady())
+        uBit.sleep(100);
+
+    // Let the MTU exchange that follows discovery settle.
+    uBit.sleep(500);
+}
+
+static void full_frames(DotMatrixClient &panel)
+{
+    panel.setImageModeDiy();
+
+    case_begin(panel);
+    for (uint32_t i = 0; i < FRAME_ITERATIONS; i++)
+    {
+        panel.fillTestPattern();
+        panel.writeImage();
+        // Latest-wins would merge back-to-back frames, so each is sent before the next.
+        panel.waitForIdle();
+    }
+    case_end(panel, "full_frame", FRAME_ITERATIONS);
+}
+
+static void shader_frames(DotMatrixClient &panel)
+{
+    case_begin(panel);
+    for (uint32_t i = 0; i < FRAME_ITERATIONS; i++)
+    {
+        panel.writeImage(shader_plasma);
+        panel.waitForIdle();
+    }
+    case_end(panel, "shader_frame", FRAME_ITERATIONS);
+}
+
+static void pixel_burst(DotMatrixClient &panel)
+{
+    case_begin(panel);
+    for (uint32_t i = 0; i < PIXEL_BURST; i++)
+        panel.writePixel(i % DotMatrixPanel::width, i / DotMatrixPanel::width, 255, 0, 255);
+    case_end(panel, "pixel_burst", PIXEL_BURST);
+}
+
+// A dashboard where only a counter's last digit changes: time from setValue() to the
+// update being on the air, then the scene's render cost.
+static void widget_digit(DotMatrixClient &panel)
+{
+    static DotMatrixScene scene(panel);
+    static DotMatrixLabel label(0, 0, DotMatrixPanel::width, DOTMATRIX_ALIGN_CENTRE);
+    static DotMatrixCounter counter(0, 8, 4);
+    static DotMatrixBarGauge gauge(0, 16, DotMatrixPanel::width, 4);
+
+    label.setText("SCORE");
+    gauge.setValue(60);
+    scene.add(label);
+    scene.add(counter);
+    scene.add(gauge);
+
+    panel.setImageModeDiy();
+    panel.clearDisplay();
+    scene.render();
+    panel.writeImage();
+    panel.waitForIdle();
+    scene.resetStats();
+
+    case_begin(panel);
+    for (uint32_t i = 1; i <= DIGIT_ITERATIONS; i++)
+    {
+        counter.setValue(1230 + i % 10);
+        scene.update();
+        panel.waitForIdle();
+    }
+    case_end(panel, "widget_digit", DIGIT_ITERATIONS);
+
+    const DotMatrixSceneStats stats = scene.stats();
+    uBit.serial.printf("# widget_digit render %d cycles (max %d), %d pixels changed per update\r\n",
+                       (int)stats.lastCycles,
+                       (int)stats.maxCycles,
+                       (int)(stats.renders ? stats.pixelsChanged / stats.renders : 0));
+}
+
+static void text_lengths(DotMatrixClient &panel)
+{
+    const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+    for (uint32_t length : TEXT_LENGTHS)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "text_%d", (int)length);
+
+        ManagedString text(alphabet, length);
+        case_begin(panel);
+        panel.writeText(text);
+        case_end(panel, name, 1);
+    }
+}
+
+static void scoreboard(DotMatrixClient &panel)
+{
+    case_begin(panel);
+    for (uint32_t i = 0; i < SCORE_ITERATIONS; i++)
+        panel.writeScore(i, SCORE_ITERATIONS - i);
+    case_end(panel, "scoreboard", SCORE_ITERATIONS);
+}
+
+// Drops the link and times until the first full frame after the app has reconnected.
+static void reconnect(DotMatrixClient &panel)
+{
+    case_begin(panel);
+
+    sd_ble_gap_disconnect(uBit.bleManager.getCentralConnectionHandle(),
+                          BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+    while (panel.isReady())
+        uBit.sleep(10);
+
+    const uint64_t deadline = system_timer_current_time() + RECONNECT_TIMEOUT_MS;
+    while (!panel.isReady())
+    {
+        if (system_timer_current_time() > deadline)
+        {
+            uBit.serial.printf("reconnect_first_frame,1,timeout,,,,,\r\n");
+            return;
+        }
+        uBit.sleep(10);
+    }
+
+    panel.setImageModeDiy();
+    panel.fillTestPattern();
+    panel.writeImage();
+    case_end(panel, "reconnect_first_frame", 1);
+}
+} // namespace
+
+void dotmatrix_benchmark(DotMatrixClient &panel)
+{
+    pixel_formats();
+    shaders();
+    colour_correction();
+    scrolling(panel);
+
+    wait_until_ready(panel);
+
+    const DotMatrixStats link = panel.stats();
+    uBit.serial.printf("# dotmatrix benchmark, built %s %s, mtu %d, chunk %d\r\n",
+                       __DATE__,
+                       __TIME__,
+                       link.mtu,
+                       link.chunkSize);
+    uBit.serial.printf("case,iterations,total_us,us_per_op,bytes,bytes_per_s,stalls,failed\r\n");
+
+    full_frames(panel);
+    shader_frames(panel);
+    pixel_burst(panel);
+    widget_digit(panel);
+    text_lengths(panel);
+    scoreboard(panel);
+    reconnect(panel);
+
+    uBit.serial.printf("# done\r\n");
+}
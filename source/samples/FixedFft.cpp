@@ -0,0 +1,152 @@
+#include "FixedFft.h"
+
+#include "nrf.h"
+
+#include <math.h>
+
+namespace
+{
+static_assert((FIXED_FFT_SIZE & (FIXED_FFT_SIZE - 1)) == 0 && (FIXED_FFT_SIZE & 0x55555555),
+              "FIXED_FFT_SIZE must be a power of four");
+
+// W^k = cos(2 pi k / N) - j sin(2 pi k / N), packed as (cos, sin). The radix-4
+// butterflies reach up to W^(3N/4 - 3).
+static uint32_t twiddles[FIXED_FFT_SIZE * 3 / 4];
+
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+
+// (a + b) / 2 and (a - b) / 2 on both halves.
+static inline uint32_t half_add(uint32_t a, uint32_t b)
+{
+    return __SHADD16(a, b);
+}
+
+static inline uint32_t half_sub(uint32_t a, uint32_t b)
+{
+    return __SHSUB16(a, b);
+}
+
+// (a - j b) / 2
+static inline uint32_t half_sub_jb(uint32_t a, uint32_t b)
+{
+    return __SHSAX(a, b);
+}
+
+// (a + j b) / 2
+static inline uint32_t half_add_jb(uint32_t a, uint32_t b)
+{
+    return __SHASX(a, b);
+}
+
+static inline uint32_t complex_mul(uint32_t x, uint32_t w)
+{
+    const int32_t re = __SMUAD(x, w);
+    const int32_t im = __SMUSDX(w, x);
+    return __PKHBT(__SSAT(re >> 15, 16), __SSAT(im >> 15, 16), 16);
+}
+
+static inline uint32_t power(uint32_t x)
+{
+    return __SMUAD(x, x);
+}
+
+#else
+
+static inline uint32_t half_add(uint32_t a, uint32_t b)
+{
+    return fixed_fft_pack((fixed_fft_re(a) + fixed_fft_re(b)) >> 1,
+                          (fixed_fft_im(a) + fixed_fft_im(b)) >> 1);
+}
+
+static inline uint32_t half_sub(uint32_t a, uint32_t b)
+{
+    return fixed_fft_pack((fixed_fft_re(a) - fixed_fft_re(b)) >> 1,
+                          (fixed_fft_im(a) - fixed_fft_im(b)) >> 1);
+}
+
+static inline uint32_t half_sub_jb(uint32_t a, uint32_t b)
+{
+    return fixed_fft_pack((fixed_fft_re(a) + fixed_fft_im(b)) >> 1,
+                          (fixed_fft_im(a) - fixed_fft_re(b)) >> 1);
+}
+
+static inline uint32_t half_add_jb(uint32_t a, uint32_t b)
+{
+    return fixed_fft_pack((fixed_fft_re(a) - fixed_fft_im(b)) >> 1,
+                          (fixed_fft_im(a) + fixed_fft_re(b)) >> 1);
+}
+
+static inline int16_t saturate(int32_t value)
+{
+    return value > 32767 ? 32767 : value < -32768 ? -32768 : value;
+}
+
+static inline uint32_t complex_mul(uint32_t x, uint32_t w)
+{
+    const int32_t xr = fixed_fft_re(x), xi = fixed_fft_im(x);
+    const int32_t c = fixed_fft_re(w), s = fixed_fft_im(w);
+    return fixed_fft_pack(saturate((xr * c + xi * s) >> 15), saturate((xi * c - xr * s) >> 15));
+}
+
+static inline uint32_t power(uint32_t x)
+{
+    const int32_t re = fixed_fft_re(x), im = fixed_fft_im(x);
+    return re * re + im * im;
+}
+
+#endif
+} // namespace
+
+void fixed_fft_init()
+{
+    const float step = 2.0f * (float)M_PI / FIXED_FFT_SIZE;
+    for (uint32_t k = 0; k < sizeof(twiddles) / sizeof(twiddles[0]); k++)
+        twiddles[k] = fixed_fft_pack((int16_t)lrintf(32767.0f * cosf(step * k)),
+                                     (int16_t)lrintf(32767.0f * sinf(step * k)));
+}
+
+void fixed_fft_q15(uint32_t *x)
+{
+    for (uint32_t n1 = FIXED_FFT_SIZE, step = 1; n1 > 1; n1 >>= 2, step <<= 2)
+    {
+        const uint32_t n2 = n1 >> 2;
+
+        for (uint32_t j = 0; j < n2; j++)
+        {
+            const uint32_t w1 = twiddles[j * step];
+            const uint32_t w2 = twiddles[2 * j * step];
+            const uint32_t w3 = twiddles[3 * j * step];
+
+            for (uint32_t i = j; i < FIXED_FFT_SIZE; i += n1)
+            {
+                const uint32_t a = x[i];
+                const uint32_t b = x[i + n2];
+                const uint32_t c = x[i + 2 * n2];
+                const uint32_t d = x[i + 3 * n2];
+
+                const uint32_t t0 = half_add(a, c);
+                const uint32_t t1 = half_sub(a, c);
+                const uint32_t t2 = half_add(b, d);
+                const uint32_t t3 = half_sub(b, d);
+
+                x[i] = half_add(t0, t2);
+                x[i + n2] = complex_mul(half_sub_jb(t1, t3), w1);
+                x[i + 2 * n2] = complex_mul(half_sub(t0, t2), w2);
+                x[i + 3 * n2] = complex_mul(half_add_jb(t1, t3), w3);
+            }
+        }
+    }
+}
+
+uint32_t fixed_fft_bin(uint32_t k)
+{
+    uint32_t index = 0;
+    for (uint32_t n = FIXED_FFT_SIZE; n > 1; n >>= 2, k >>= 2)
+        index = (index << 2) | (k & 3);
+    return index;
+}
+
+uint32_t fixed_fft_power(uint32_t value)
+{
+    return power(value);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+// Points in the transform; must be a power of four.
+#define FIXED_FFT_SIZE 256
+
+// Complex Q15 value packed into one word, real part in the low halfword, so the
+// Cortex-M4 SIMD instructions can work on both parts at once.
+inline uint32_t fixed_fft_pack(int16_t re, int16_t im)
+{
+    return (uint16_t)re | ((uint32_t)(uint16_t)im << 16);
+}
+
+inline int16_t fixed_fft_re(uint32_t value)
+{
+    return (int16_t)(value & 0xFFFF);
+}
+
+inline int16_t fixed_fft_im(uint32_t value)
+{
+    return (int16_t)(value >> 16);
+}
+
+// Builds the twiddle table; call once before the first transform.
+void fixed_fft_init();
+
+// In-place radix-4 decimation-in-frequency FFT of FIXED_FFT_SIZE packed values. Each
+// stage halves twice, so the result is scaled by 1/FIXED_FFT_SIZE and cannot overflow
+// for inputs of magnitude below 1.0. Bins come out in base-4 digit-reversed order.
+void fixed_fft_q15(uint32_t *data);
+
+// Position of frequency bin k in the transformed data.
+uint32_t fixed_fft_bin(uint32_t k);
+
+// |X|^2 of a packed value, in Q30.
+uint32_t fixed_fft_power(uint32_t value);
@@ -0,0 +1,136 @@
+#include "MicroBit.h"
+#include "Tests.h"
+#include "DotMatrixCompositor.h"
+#include "DotMatrixFrameScheduler.h"
+#include "DotMatrixTrace.h"
+#include "DotMatrixWidgets.h"
+
+// A ball bouncing over a gradient, under a translucent status bar with a blinking link
+// indicator. Each frame only the ball's old and new squares, and the indicator when it
+// blinks, are composited and sent.
+
+namespace
+{
+constexpr int PANEL_WIDTH = DotMatrixPanel::width;
+constexpr int PANEL_HEIGHT = DotMatrixPanel::height;
+
+constexpr uint32_t LAYER_FPS = 20;
+constexpr uint32_t REPORT_MS = 2000;
+constexpr uint32_t BLINK_MS = 500;
+
+constexpr int BALL_SIZE = 4;
+constexpr int BAR_HEIGHT = DOTMATRIX_SMALL_GLYPH_HEIGHT + 2;
+
+constexpr DotMatrixColour BALL = {255, 255, 255};
+constexpr DotMatrixColour BAR = {0, 0, 0};
+constexpr DotMatrixColour TEXT = {0, 200, 255};
+constexpr DotMatrixColour LINK = {0, 255, 0};
+// Content is keyed on black, so the ball's trail is cleared to it.
+constexpr DotMatrixColour KEY = {0, 0, 0};
+
+static void draw_background(DotMatrixLayer &layer)
+{
+    for (int y = 0; y < PANEL_HEIGHT; y++)
+    {
+        const uint8_t level = y * 255 / (PANEL_HEIGHT - 1);
+        const DotMatrixColour colour = {(uint8_t)(level / 2), 0, (uint8_t)(255 - level)};
+        layer.fillRect({0, (int16_t)y, PANEL_WIDTH, (int16_t)(y + 1)}, colour);
+    }
+}
+
+static void draw_status_bar(DotMatrixLayer &layer)
+{
+    layer.setBlend(DOTMATRIX_BLEND_ALPHA);
+    layer.clear();
+    layer.fillRect({0, 0, PANEL_WIDTH, BAR_HEIGHT}, BAR, 160);
+
+    const char *text = "LINK";
+    for (int c = 0; text[c]; c++)
+        for (int y = 0; y < DOTMATRIX_SMALL_GLYPH_HEIGHT; y++)
+            for (int x = 0; x < DOTMATRIX_SMALL_GLYPH_WIDTH; x++)
+                if (dotmatrix_small_glyph_pixel(text[c], x, y))
+                    layer.setPixel(1 + c * DOTMATRIX_SMALL_ADVANCE + x, 1 + y, TEXT);
+}
+
+static void draw_link(DotMatrixLayer &layer, bool on)
+{
+    const int16_t x = PANEL_WIDTH - 4;
+    layer.fillRect({x, 2, (int16_t)(x + 2), 4}, on ? LINK : BAR, on ? 255 : 160);
+}
+
+static DotMatrixRect ball_rect(int x, int y)
+{
+    return {(int16_t)x, (int16_t)y, (int16_t)(x + BALL_SIZE), (int16_t)(y + BALL_SIZE)};
+}
+} // namespace
+
+void layer_demo(DotMatrixClient &panel)
+{
+    static DotMatrixFrameScheduler scheduler(panel, LAYER_FPS);
+    static DotMatrixCompositor compositor(panel);
+
+    DotMatrixLayer &background = compositor.layer(DOTMATRIX_LAYER_BACKGROUND);
+    DotMatrixLayer &content = compositor.layer(DOTMATRIX_LAYER_CONTENT);
+    DotMatrixLayer &overlay = compositor.layer(DOTMATRIX_LAYER_OVERLAY);
+
+    draw_background(background);
+    content.setBlend(DOTMATRIX_BLEND_KEY, KEY);
+    content.clear();
+    draw_status_bar(overlay);
+
+    dotmatrix_cycle_counter_enable();
+
+    while (!panel.isReady())
+        uBit.sleep(100);
+
+    panel.setImageModeDiy();
+    scheduler.start();
+
+    int x = 0, y = BAR_HEIGHT - 2;
+    int dx = 1, dy = 1;
+    bool link = false;
+    uint64_t blinkAt = system_timer_current_time();
+    uint64_t reportAt = blinkAt + REPORT_MS;
+
+    while (true)
+    {
+        scheduler.waitForNextFrame();
+
+        content.fillRect(ball_rect(x, y), KEY);
+        if (x + dx < 0 || x + dx > PANEL_WIDTH - BALL_SIZE)
+            dx = -dx;
+        if (y + dy < 0 || y + dy > PANEL_HEIGHT - BALL_SIZE)
+            dy = -dy;
+        x += dx;
+        y += dy;
+        content.fillRect(ball_rect(x, y), BALL);
+
+        const uint64_t now = system_timer_current_time();
+        if (now >= blinkAt)
+        {
+            link = !link;
+            draw_link(overlay, link);
+            blinkAt = now + BLINK_MS;
+        }
+
+        if (compositor.compose())
+            scheduler.submit();
+
+        if (now >= reportAt)
+        {
+            const DotMatrixCompositorStats stats = compositor.stats();
+            const DotMatrixFrameStats frames = scheduler.stats();
+            uBit.serial.printf("layers: compose %d cycles (avg %d, max %d), %d pixels per frame, "
+                               "%d.%02d fps\r\n",
+                               (int)stats.lastCycles,
+                               (int)(stats.frames ? stats.totalCycles / stats.frames : 0),
+                               (int)stats.maxCycles,
+                               (int)(stats.frames ? stats.pixelsComposed / stats.frames : 0),
+                               (int)(frames.fpsX100 / 100),
+                               (int)(frames.fpsX100 % 100));
+            compositor.resetStats();
+            scheduler.resetStats();
+            reportAt = now + REPORT_MS;
+        }
+    }
+}
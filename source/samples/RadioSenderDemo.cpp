@@ -0,0 +1,66 @@
+#include "MicroBit.h"
+#include "Tests.h"
+#include "DotMatrixRadio.h"
+
+// Drives a radio gateway from a second micro:bit: a bouncing 4x4 tile in this sender's
+// colour, button A for a greeting and button B to bump the score.
+
+namespace
+{
+constexpr uint8_t TILE_SIZE = 4;
+constexpr uint32_t FRAME_MS = 100;
+constexpr int LIMIT_X = DotMatrixPanel::width - TILE_SIZE;
+constexpr int LIMIT_Y = DotMatrixPanel::height - TILE_SIZE;
+
+static void fill(uint8_t *rgb, uint32_t pixels, uint8_t r, uint8_t g, uint8_t b)
+{
+    for (uint32_t i = 0; i < pixels; i++)
+    {
+        rgb[i * 3] = r;
+        rgb[i * 3 + 1] = g;
+        rgb[i * 3 + 2] = b;
+    }
+}
+} // namespace
+
+void radio_sender_demo()
+{
+    static DotMatrixRadioSender sender(uBit);
+    if (sender.start() != DEVICE_OK)
+    {
+        uBit.display.scroll("NO RADIO");
+        return;
+    }
+
+    const uint32_t serial = microbit_serial_number();
+    const uint8_t r = serial, g = serial >> 8, b = serial >> 16;
+
+    uint8_t tile[TILE_SIZE * TILE_SIZE * 3];
+    uint8_t blank[TILE_SIZE * TILE_SIZE * 3] = {0};
+    fill(tile, TILE_SIZE * TILE_SIZE, r, g, b);
+
+    int x = uBit.random(LIMIT_X), y = uBit.random(LIMIT_Y);
+    int dx = 1, dy = 1;
+    uint32_t score = 0;
+
+    while (true)
+    {
+        if (uBit.buttonA.isPressed())
+            sender.text("Hello over radio!");
+
+        if (uBit.buttonB.isPressed())
+            sender.score(++score, 0);
+
+        sender.tile(x, y, TILE_SIZE, TILE_SIZE, blank);
+
+        if (x + dx < 0 || x + dx > LIMIT_X)
+            dx = -dx;
+        if (y + dy < 0 || y + dy > LIMIT_Y)
+            dy = -dy;
+        x += dx;
+        y += dy;
+
+        sender.tile(x, y, TILE_SIZE, TILE_SIZE, tile);
+        uBit.sleep(FRAME_MS);
+    }
+}
@@ -0,0 +1,83 @@
+#include "ShaderEffects.h"
+#include "Tests.h"
+
+namespace
+{
+// One sine period across the panel.
+constexpr uint32_t STEP = 256 / DotMatrixPanel::width;
+
+constexpr uint32_t DEMO_REPORT_MS = 2000;
+} // namespace
+
+void shader_plasma(uint32_t x, uint32_t y, uint32_t count, uint32_t t, uint8_t *rgb, void *)
+{
+    // A turn every 4 s; the row term is the same for the whole span.
+    const uint8_t phase = t >> 4;
+    const int row = dotmatrix_sin8(y * STEP - phase);
+
+    for (uint32_t i = 0; i < count; i++, rgb += 3)
+    {
+        const uint32_t px = x + i;
+        const int v = dotmatrix_sin8(px * STEP + phase) + row +
+                      dotmatrix_cos8((px + y) * STEP / 2 + phase * 2);
+
+        // -381..381 to a little over a turn of hue.
+        const uint8_t hue = (v * 3) >> 2;
+        rgb[0] = dotmatrix_wave8(hue);
+        rgb[1] = dotmatrix_wave8(hue + 85);
+        rgb[2] = dotmatrix_wave8(hue + 170);
+    }
+}
+
+void shader_gradient(uint32_t x, uint32_t y, uint32_t t, uint8_t *rgb, void *)
+{
+    rgb[0] = x * 255 / (DotMatrixPanel::width - 1);
+    rgb[1] = y * 255 / (DotMatrixPanel::height - 1);
+    rgb[2] = dotmatrix_wave8(t >> 3);
+}
+
+void shader_test_pattern(uint32_t, uint32_t y, uint32_t count, uint32_t, uint8_t *rgb, void *)
+{
+    const uint8_t r = y % 3 == 0 ? 255 : 0;
+    const uint8_t g = y % 3 == 1 ? 255 : 0;
+    const uint8_t b = y % 3 == 2 ? 255 : 0;
+
+    for (uint32_t i = 0; i < count; i++, rgb += 3)
+    {
+        rgb[0] = r;
+        rgb[1] = g;
+        rgb[2] = b;
+    }
+}
+
+// Plasma as fast as the link takes it, with the frame rate every two seconds.
+void shader_demo(DotMatrixClient &panel)
+{
+    while (!panel.isReady())
+        uBit.sleep(100);
+
+    panel.setImageModeDiy();
+
+    uint32_t frames = 0;
+    uint64_t since = system_timer_current_time();
+    while (true)
+    {
+        if (panel.writeImage(shader_plasma) == DEVICE_OK)
+            frames++;
+        panel.waitForIdle();
+
+        const uint64_t now = system_timer_current_time();
+        if (now - since >= DEMO_REPORT_MS)
+        {
+            const uint32_t fpsX100 = frames * 100000 / (uint32_t)(now - since);
+            uBit.serial.printf("shader: %d.%02d fps\r\n", (int)(fpsX100 / 100),
+                               (int)(fpsX100 % 100));
+            frames = 0;
+            since = now;
+        }
+
+        // Let a dropped link come back without spinning.
+        while (!panel.isReady())
+            uBit.sleep(100);
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "DotMatrix.h"
+#include "DotMatrixShader.h"
+
+// Effects for DotMatrixClient::writeImage(shader). None of them uses the context.
+
+// Three interfering sine waves, cycling through the colour wheel.
+void shader_plasma(uint32_t x, uint32_t y, uint32_t count, uint32_t t, uint8_t *rgb,
+                   void *context);
+
+// Red across, green down, blue pulsing with time. Written per pixel.
+void shader_gradient(uint32_t x, uint32_t y, uint32_t t, uint8_t *rgb, void *context);
+
+// Red, green and blue rows, as DotMatrixClient::fillTestPattern() draws them.
+void shader_test_pattern(uint32_t x, uint32_t y, uint32_t count, uint32_t t, uint8_t *rgb,
+                         void *context);
@@ -0,0 +1,284 @@
+#include "SpectrumVisualiser.h"
+#include "Tests.h"
+
+#include "nrf.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace
+{
+constexpr uint32_t PANEL_HEIGHT = DotMatrixPanel::height;
+
+// Bars cover bins 1..N/2 - 1; bin 0 is the microphone's DC offset.
+constexpr uint32_t FIRST_BIN = 1;
+constexpr uint32_t LAST_BIN = FIXED_FFT_SIZE / 2;
+
+// Bin power is scaled by 1/N^2, so a full-scale tone lands near 2^26 and the 8-bit
+// microphone's noise floor near 2^8. Levels are log2 of power in sixteenths.
+constexpr uint32_t LEVEL_FLOOR = 9 * 16;
+constexpr uint32_t LEVEL_RANGE = 16 * 16;
+
+// Hann window in Q15.
+static int16_t window[FIXED_FFT_SIZE];
+
+static void build_window()
+{
+    for (uint32_t i = 0; i < FIXED_FFT_SIZE; i++)
+        window[i] = (int16_t)lrintf(32767.0f * 0.5f *
+                                    (1.0f - cosf(2.0f * (float)M_PI * i / FIXED_FFT_SIZE)));
+}
+
+static uint32_t log2_q4(uint32_t value)
+{
+    if (value == 0)
+        return 0;
+
+    const uint32_t exponent = 31 - __builtin_clz(value);
+    const uint32_t mantissa = ((value << (31 - exponent)) >> 27) & 0xF;
+    return exponent * 16 + mantissa;
+}
+
+static uint8_t bar_height(uint32_t power)
+{
+    const uint32_t level = log2_q4(power);
+    if (level <= LEVEL_FLOOR)
+        return 0;
+
+    const uint32_t height = (level - LEVEL_FLOOR) * PANEL_HEIGHT / LEVEL_RANGE;
+    return height > PANEL_HEIGHT ? PANEL_HEIGHT : height;
+}
+
+// Green up to half height, yellow, then red in the top fifth, counting rows from the bottom.
+static void bar_colour(uint32_t row, uint8_t &r, uint8_t &g, uint8_t &b)
+{
+    r = row < PANEL_HEIGHT / 2 ? 0 : 255;
+    g = row < PANEL_HEIGHT * 4 / 5 ? 200 : 0;
+    b = 0;
+}
+} // namespace
+
+SpectrumVisualiser::SpectrumVisualiser(DataSource &source, DotMatrixFrameScheduler &scheduler,
+                                       DotMatrixClient &panel)
+    : upstream_(source)
+    , scheduler_(scheduler)
+    , panel_(panel)
+    , started_(false)
+    , fill_(0)
+    , windowReady_(false)
+{
+    fixed_fft_init();
+    build_window();
+
+    memset(heights_, 0, sizeof(heights_));
+    memset(peaks_, 0, sizeof(peaks_));
+    memset(peakAge_, 0, sizeof(peakAge_));
+    memset(&timing_, 0, sizeof(timing_));
+
+    // Log-spaced edges from FIRST_BIN to LAST_BIN. The low bars would share bins, so each
+    // edge is pushed at least one bin past the previous one.
+    const float ratio = (float)LAST_BIN / FIRST_BIN;
+    barEdges_[0] = FIRST_BIN;
+    for (uint32_t i = 1; i <= SPECTRUM_BARS; i++)
+    {
+        uint32_t edge = lrintf(FIRST_BIN * powf(ratio, (float)i / SPECTRUM_BARS));
+        if (edge <= barEdges_[i - 1])
+            edge = barEdges_[i - 1] + 1;
+        barEdges_[i] = edge;
+    }
+    barEdges_[SPECTRUM_BARS] = LAST_BIN;
+
+    source.connect(*this);
+}
+
+void SpectrumVisualiser::start()
+{
+    if (started_)
+        return;
+
+    started_ = true;
+    create_fiber(fiberEntry, this);
+}
+
+int SpectrumVisualiser::pullRequest()
+{
+    ManagedBuffer buffer = upstream_.pull();
+    const int format = upstream_.getFormat();
+    const bool wide = format == DATASTREAM_FORMAT_16BIT_SIGNED;
+
+    if (!wide && format != DATASTREAM_FORMAT_8BIT_SIGNED)
+        return DEVICE_OK;
+
+    const uint8_t *data = buffer.getBytes();
+    const int count = buffer.length() / (wide ? 2 : 1);
+
+    for (int i = 0; i < count; i++)
+    {
+        int16_t sample;
+        if (wide)
+            memcpy(&sample, data + 2 * i, sizeof(sample));
+        else
+            sample = (int16_t)((int8_t)data[i] * 256);
+
+        samples_[fill_++] = sample;
+        if (fill_ < FIXED_FFT_SIZE)
+            continue;
+
+        fill_ = 0;
+
+        // The fiber is still working on the last window; this one is skipped rather than
+        // queued, so the bars always show the most recent audio.
+        if (windowReady_)
+        {
+            timing_.skipped++;
+            continue;
+        }
+
+        for (uint32_t n = 0; n < FIXED_FFT_SIZE; n++)
+            fft_[n] = fixed_fft_pack((int16_t)((samples_[n] * window[n]) >> 15), 0);
+
+        windowReady_ = true;
+        MicroBitEvent(SPECTRUM_VISUALISER_ID, SPECTRUM_EVT_WINDOW_READY);
+    }
+
+    return DEVICE_OK;
+}
+
+SpectrumTiming SpectrumVisualiser::timing() const
+{
+    return timing_;
+}
+
+void SpectrumVisualiser::fiberEntry(void *param)
+{
+    static_cast<SpectrumVisualiser *>(param)->run();
+}
+
+void SpectrumVisualiser::run()
+{
+    while (true)
+    {
+        // pullRequest() can set the flag from the ADC interrupt at any moment, so it is
+        // checked and the wait registered with interrupts off. Otherwise a window landing
+        // in between leaves the flag set with nobody woken, and every later one skipped.
+        const uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        const bool ready = windowReady_;
+        if (!ready)
+            fiber_wake_on_event(SPECTRUM_VISUALISER_ID, SPECTRUM_EVT_WINDOW_READY);
+        __set_PRIMASK(primask);
+
+        if (!ready)
+        {
+            schedule();
+            continue;
+        }
+
+        transform();
+        updateBars();
+        windowReady_ = false;
+
+        scheduler_.submit();
+    }
+}
+
+void SpectrumVisualiser::transform()
+{
+    const uint32_t start = DWT->CYCCNT;
+    fixed_fft_q15(fft_);
+    const uint32_t cycles = DWT->CYCCNT - start;
+
+    timing_.frames++;
+    timing_.lastCycles = cycles;
+    timing_.totalCycles += cycles;
+    if (cycles > timing_.maxCycles)
+        timing_.maxCycles = cycles;
+}
+
+void SpectrumVisualiser::updateBars()
+{
+    for (uint32_t bar = 0; bar < SPECTRUM_BARS; bar++)
+    {
+        uint32_t power = 0;
+        for (uint32_t k = barEdges_[bar]; k < barEdges_[bar + 1]; k++)
+        {
+            const uint32_t p = fixed_fft_power(fft_[fixed_fft_bin(k)]);
+            if (p > power)
+                power = p;
+        }
+
+        const uint8_t height = bar_height(power);
+
+        uint8_t peak = peaks_[bar];
+        if (height >= peak)
+        {
+            peak = height;
+            peakAge_[bar] = 0;
+        }
+        else if (peakAge_[bar] < SPECTRUM_PEAK_HOLD_FRAMES)
+        {
+            peakAge_[bar]++;
+        }
+        else
+        {
+            peak--;
+        }
+
+        // Unchanged columns stay out of the dirty region.
+        if (height != heights_[bar] || peak != peaks_[bar])
+            drawBar(bar, height, peak);
+
+        heights_[bar] = height;
+        peaks_[bar] = peak;
+    }
+}
+
+void SpectrumVisualiser::drawBar(uint32_t bar, uint8_t height, uint8_t peak)
+{
+    for (uint32_t row = 0; row < PANEL_HEIGHT; row++)
+    {
+        const uint8_t y = PANEL_HEIGHT - 1 - row;
+
+        uint8_t r = 0, g = 0, b = 0;
+        if (row < height)
+            bar_colour(row, r, g, b);
+        else if (peak > height && row == peak - 1u)
+            r = g = b = 255;
+
+        panel_.setPixel(bar, y, r, g, b);
+    }
+}
+
+void spectrum_visualiser(DotMatrixClient &panel)
+{
+    static DotMatrixFrameScheduler scheduler(panel, SPECTRUM_FPS);
+    static SplitterChannel *channel = uBit.audio.splitter->createChannel();
+    channel->requestSampleRate(SPECTRUM_SAMPLE_RATE);
+    static SpectrumVisualiser visualiser(*channel, scheduler, panel);
+
+    uBit.audio.requestActivation();
+
+    while (!panel.isReady())
+        uBit.sleep(100);
+
+    panel.setImageModeDiy();
+    panel.clearDisplay();
+    scheduler.start();
+    visualiser.start();
+
+    while (true)
+    {
+        uBit.sleep(2000);
+
+        const SpectrumTiming timing = visualiser.timing();
+        const DotMatrixFrameStats frames = scheduler.stats();
+        uBit.serial.printf("spectrum: fft %d cycles (avg %d, max %d), %d.%02d fps, %d skipped\r\n",
+                           (int)timing.lastCycles,
+                           (int)(timing.frames ? timing.totalCycles / timing.frames : 0),
+                           (int)timing.maxCycles,
+                           (int)(frames.fpsX100 / 100),
+                           (int)(frames.fpsX100 % 100),
+                           (int)timing.skipped);
+        scheduler.resetStats();
+    }
+}
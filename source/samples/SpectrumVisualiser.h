@@ -0,0 +1,73 @@
+#pragma once
+
+#include "MicroBit.h"
+#include "DataStream.h"
+#include "DotMatrix.h"
+#include "DotMatrixFrameScheduler.h"
+#include "FixedFft.h"
+
+#define SPECTRUM_VISUALISER_ID 9510
+#define SPECTRUM_EVT_WINDOW_READY 1
+
+// One bar per panel column.
+#define SPECTRUM_BARS DOTMATRIX_PANEL_WIDTH
+#define SPECTRUM_SAMPLE_RATE 11000
+#define SPECTRUM_FPS 20
+
+// Frames a peak marker stays put before it starts to fall, one row per frame.
+#define SPECTRUM_PEAK_HOLD_FRAMES 10
+
+struct SpectrumTiming
+{
+    uint32_t frames;
+    uint32_t lastCycles;
+    uint32_t maxCycles;
+    uint64_t totalCycles;
+    // Windows that arrived while the previous one was still being transformed.
+    uint32_t skipped;
+};
+
+// Turns a microphone stream into log-spaced spectrum bars on the panel. The sink only
+// copies samples; each full window is transformed and drawn on the visualiser's fiber,
+// and frames go out through the scheduler, so a busy link drops frames instead of
+// holding up the audio pipeline.
+class SpectrumVisualiser : public DataSink
+{
+public:
+    SpectrumVisualiser(DataSource &source, DotMatrixFrameScheduler &scheduler,
+                       DotMatrixClient &panel);
+
+    // Starts the processing fiber.
+    void start();
+
+    virtual int pullRequest();
+
+    SpectrumTiming timing() const;
+
+private:
+    DataSource &upstream_;
+    DotMatrixFrameScheduler &scheduler_;
+    DotMatrixClient &panel_;
+    bool started_;
+
+    int16_t samples_[FIXED_FFT_SIZE];
+    uint32_t fill_;
+
+    // Windowed copy handed to the fiber; owned by the fiber while windowReady_ is set.
+    uint32_t fft_[FIXED_FFT_SIZE];
+    volatile bool windowReady_;
+
+    // First FFT bin of each bar; the last entry is one past the final bin.
+    uint16_t barEdges_[SPECTRUM_BARS + 1];
+    uint8_t heights_[SPECTRUM_BARS];
+    uint8_t peaks_[SPECTRUM_BARS];
+    uint8_t peakAge_[SPECTRUM_BARS];
+
+    SpectrumTiming timing_;
+
+    static void fiberEntry(void *param);
+    void run();
+    void transform();
+    void updateBars();
+    void drawBar(uint32_t bar, uint8_t height, uint8_t peak);
+};
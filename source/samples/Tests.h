@@ -7,6 +7,8 @@
 
 extern MicroBit uBit;
 
+class DotMatrixClient;
+
 void blinky();
 void button_test1();
 void button_test2();
@@ -99,5 +101,12 @@ void stream_test_record();
 void stream_test_recording_sample_rates();
 void stream_test_all();
 void streamer_serial_test();
+void dotmatrix_benchmark(DotMatrixClient &panel);
+void spectrum_visualiser(DotMatrixClient &panel);
+void radio_sender_demo();
+void shader_demo(DotMatrixClient &panel);
+void dashboard_demo(DotMatrixClient &panel);
+void layer_demo(DotMatrixClient &panel);
+void tween_demo(DotMatrixClient &panel);
 
 #endif
@@ -0,0 +1,93 @@
+#include "MicroBit.h"
+#include "Tests.h"
+#include "DotMatrixTrace.h"
+#include "DotMatrixTween.h"
+#include "DotMatrixWidgets.h"
+
+#if CONFIG_ENABLED(DOTMATRIX_TWEEN_DEMO)
+
+// A label slides in, a counter rolls up to a new random total and a gauge springs to
+// match it, every few seconds. All three are set by one animator, one render per frame.
+
+namespace
+{
+static_assert(DotMatrixPanel::width >= 32, "the demo is laid out for 32x32 and up");
+
+constexpr int PANEL_WIDTH = DotMatrixPanel::width;
+
+constexpr uint32_t TWEEN_FPS = 25;
+constexpr uint32_t ROUND_MS = 3000;
+constexpr int32_t MAX_TOTAL = 999;
+
+constexpr DotMatrixColour TITLE = {255, 200, 0};
+constexpr DotMatrixColour TOTAL = {0, 255, 120};
+constexpr DotMatrixColour GAUGE = {0, 120, 255};
+constexpr DotMatrixColour BLACK = {0, 0, 0};
+} // namespace
+
+void tween_demo(DotMatrixClient &panel)
+{
+    static DotMatrixFrameScheduler scheduler(panel, TWEEN_FPS);
+    static DotMatrixScene scene(panel);
+    static DotMatrixAnimator animator(scheduler);
+
+    static DotMatrixLabel title(PANEL_WIDTH, 1, PANEL_WIDTH, DOTMATRIX_ALIGN_CENTRE);
+    static DotMatrixCounter total(PANEL_WIDTH / 2 - 6, 9, 3);
+    static DotMatrixBarGauge gauge(2, 17, PANEL_WIDTH - 4, 4);
+
+    title.setText("SCORE");
+    title.setColours(TITLE, BLACK);
+    total.setColours(TOTAL, BLACK);
+    gauge.setColours(GAUGE, BLACK);
+    gauge.setRange(0, MAX_TOTAL);
+
+    scene.add(title);
+    scene.add(total);
+    scene.add(gauge);
+
+    dotmatrix_cycle_counter_enable();
+    animator.setRender(dotmatrix_render_scene, &scene);
+
+    while (!panel.isReady())
+        uBit.sleep(100);
+
+    panel.setImageModeDiy();
+    panel.clearDisplay();
+    scheduler.start();
+    animator.start();
+
+    int32_t shown = 0;
+    while (true)
+    {
+        const int32_t next = uBit.random(MAX_TOTAL + 1);
+
+        animator.tween(PANEL_WIDTH, 0, 600, DOTMATRIX_EASE_OUT, dotmatrix_apply_widget_x, &title);
+        animator.tween(shown, next, 1200, DOTMATRIX_EASE_IN_OUT, dotmatrix_apply_counter, &total,
+                       300);
+        animator.tween(shown, next, 1200, DOTMATRIX_EASE_SPRING, dotmatrix_apply_gauge, &gauge,
+                       300);
+        shown = next;
+
+        uBit.sleep(ROUND_MS);
+
+        const DotMatrixAnimatorStats stats = animator.stats();
+        const DotMatrixFrameStats frames = scheduler.stats();
+        uBit.serial.printf("tween: %d frames, %d sent, %d property updates, step %d cycles "
+                           "(max %d), %d.%02d fps\r\n",
+                           (int)stats.frames,
+                           (int)stats.submitted,
+                           (int)stats.applied,
+                           (int)stats.lastCycles,
+                           (int)stats.maxCycles,
+                           (int)(frames.fpsX100 / 100),
+                           (int)(frames.fpsX100 % 100));
+        animator.resetStats();
+        scheduler.resetStats();
+
+        // Slide the title back out before the next round.
+        animator.tween(0, -PANEL_WIDTH, 400, DOTMATRIX_EASE_IN, dotmatrix_apply_widget_x, &title);
+        uBit.sleep(500);
+    }
+}
+
+#endif
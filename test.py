@@ -10,8 +10,6 @@ import zlib
 from enum import Enum
 from typing import Tuple, Optional
 
-from PIL import Image, ImageDraw, ImageFont
-
 
 class TextMode(Enum):
     REPLACE = 0
@@ -180,6 +178,9 @@ class TextModule:
         self, text: str, font_path: Optional[str] = None, font_size: Optional[int] = 20
     ) -> bytearray:
         """Converts text to bitmap images suitable for iDotMatrix devices."""
+        # Only rendering needs Pillow; tests/gen_golden.py builds packets without it.
+        from PIL import Image, ImageDraw, ImageFont
+
         if not font_path:
             # using open source font from https://www.fontspace.com/rain-font-f22577
             font_path = "/Users/jamesdevine/Downloads/trueno-font/TruenoLight-E2pg.otf"
@@ -206,7 +207,8 @@ class TextModule:
         return byte_stream
 
 
-resulting_bytes = TextModule().show_text("A")
-print("Resulting bytes:")
-for b in resulting_bytes:
-    print(f"0x{b:02X}", end=" ")
+if __name__ == "__main__":
+    resulting_bytes = TextModule().show_text("A")
+    print("Resulting bytes:")
+    for b in resulting_bytes:
+        print(f"0x{b:02X}", end=" ")
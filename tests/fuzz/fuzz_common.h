@@ -0,0 +1,101 @@
+#pragma once
+
+// Shared by the fuzz targets: each defines LLVMFuzzerTestOneInput, which libFuzzer drives
+// when built with clang and DOTMATRIX_FUZZ, and standalone_main.cpp drives otherwise.
+
+#include "DotMatrixFont.h"
+#include "DotMatrixProtocol.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A failed check aborts, which both drivers report as a crash with the input kept.
+#define FUZZ_CHECK(cond)                                                                       \
+    do                                                                                         \
+    {                                                                                          \
+        if (!(cond))                                                                           \
+        {                                                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);           \
+            abort();                                                                           \
+        }                                                                                      \
+    } while (0)
+
+// Takes fields off the front of the fuzz input; reads past the end return 0.
+class FuzzInput
+{
+public:
+    FuzzInput(const uint8_t *data, size_t size) : data_(data), size_(size)
+    {
+    }
+
+    uint8_t u8()
+    {
+        if (size_ == 0)
+            return 0;
+        size_--;
+        return *data_++;
+    }
+
+    uint16_t u16()
+    {
+        const uint16_t lo = u8();
+        return (uint16_t)(lo | u8() << 8);
+    }
+
+    uint32_t u32()
+    {
+        const uint32_t lo = u16();
+        return lo | (uint32_t)u16() << 16;
+    }
+
+    DotMatrixTextStyle style()
+    {
+        DotMatrixTextStyle s;
+        s.mode = u8();
+        s.speed = u8();
+        s.colorMode = u8();
+        s.r = u8();
+        s.g = u8();
+        s.b = u8();
+        s.bgMode = u8();
+        s.bgR = u8();
+        s.bgG = u8();
+        s.bgB = u8();
+        return s;
+    }
+
+    // The rest of the input.
+    const uint8_t *rest() const
+    {
+        return data_;
+    }
+
+    size_t left() const
+    {
+        return size_;
+    }
+
+private:
+    const uint8_t *data_;
+    size_t size_;
+};
+
+inline bool same_style(const DotMatrixTextStyle &a, const DotMatrixTextStyle &b)
+{
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+// Decodes a packet the encoders wrote, which must come back whole and of the given type.
+inline DotMatrixPacket decode_own(const uint8_t *packet, size_t length, DotMatrixPacketType type)
+{
+    DotMatrixPacket decoded;
+    FUZZ_CHECK(dotmatrix_decode_packet(packet, length, decoded) == length);
+    FUZZ_CHECK(decoded.type == type);
+    // Any shorter prefix is not a packet.
+    DotMatrixPacket partial;
+    FUZZ_CHECK(dotmatrix_decode_packet(packet, length - 1, partial) == 0);
+    return decoded;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
@@ -0,0 +1,150 @@
+// The decoder on arbitrary bytes: it must stay inside the buffer, and whatever it accepts
+// must be exactly what the encoders write for the decoded fields. Half the inputs are
+// taken as they are; the other half build a valid packet and corrupt a few of its bytes,
+// which random bytes alone would rarely get close to.
+
+#include "fuzz_common.h"
+
+namespace
+{
+static uint8_t scratch[DOTMATRIX_TEXT_MAX_PACKET_SIZE];
+
+// The printable character whose glyph is at `glyph`, or 0 for a glyph not in the font.
+static char character_of(const uint8_t *glyph)
+{
+    for (char c = 32; c <= 126; c++)
+    {
+        if (memcmp(glyph, &font_data[glyph_index(c) * BITMAP_SIZE], BITMAP_SIZE) == 0)
+            return c;
+    }
+    return 0;
+}
+
+// Re-encodes a decoded packet into scratch; 0 if it cannot be.
+static size_t reencode(const DotMatrixPacket &p)
+{
+    switch (p.type)
+    {
+        case DOTMATRIX_PACKET_IMAGE_MODE:
+            return dotmatrix_encode_image_mode(scratch, p.imageMode.diy);
+        case DOTMATRIX_PACKET_PIXEL:
+            return dotmatrix_encode_pixel(scratch, p.pixel.x, p.pixel.y, p.pixel.r, p.pixel.g,
+                                          p.pixel.b);
+        case DOTMATRIX_PACKET_SCORE:
+            return dotmatrix_encode_score(scratch, p.score.score0, p.score.score1);
+        case DOTMATRIX_PACKET_IMAGE:
+        {
+            const size_t written = dotmatrix_encode_image_chunk_header(
+                scratch, p.image.chunkBytes, p.image.imageBytes, p.image.continuation);
+            FUZZ_CHECK(written != 0);
+            memcpy(scratch + written, p.image.data, p.image.chunkBytes);
+            return written + p.image.chunkBytes;
+        }
+        case DOTMATRIX_PACKET_TEXT:
+        {
+            // Glyphs another font would draw cannot be turned back into text.
+            static char text[DOTMATRIX_TEXT_MAX_PACKET_SIZE];
+            const size_t glyph_bytes = SEPARATOR_LEN + BITMAP_SIZE;
+            for (uint16_t i = 0; i < p.text.characters; i++)
+            {
+                text[i] = character_of(p.text.glyphs + i * glyph_bytes);
+                if (text[i] == 0)
+                    return 0;
+            }
+            uint16_t characters = 0;
+            const size_t written = dotmatrix_encode_text(scratch, sizeof(scratch), text,
+                                                         p.text.characters, p.text.style,
+                                                         characters);
+            FUZZ_CHECK(characters == p.text.characters);
+            return written;
+        }
+    }
+    FUZZ_CHECK(!"unknown packet type");
+    return 0;
+}
+
+// True if src starts with a packet.
+static bool check_decode(const uint8_t *src, size_t size)
+{
+    DotMatrixPacket packet;
+    const size_t length = dotmatrix_decode_packet(src, size, packet);
+    if (length == 0)
+        return false;
+
+    FUZZ_CHECK(length <= size);
+    const size_t again = reencode(packet);
+    if (again != 0)
+        FUZZ_CHECK(again == length && memcmp(scratch, src, length) == 0);
+    return true;
+}
+
+// A valid packet of the kind the input picks, in scratch.
+static size_t build(FuzzInput &in)
+{
+    switch (in.u8() % 5)
+    {
+        case 0:
+            return dotmatrix_encode_image_mode(scratch, in.u8() & 1);
+        case 1:
+            return dotmatrix_encode_pixel(scratch, in.u8(), in.u8(), in.u8(), in.u8(), in.u8());
+        case 2:
+            return dotmatrix_encode_score(scratch, in.u16(), in.u16());
+        case 3:
+        {
+            const uint32_t chunk = in.u16() % 1024;
+            const size_t written =
+                dotmatrix_encode_image_chunk_header(scratch, chunk, chunk + in.u16(), in.u8() & 1);
+            memset(scratch + written, 0x5A, chunk);
+            return written + chunk;
+        }
+        default:
+        {
+            const DotMatrixTextStyle style = in.style();
+            char text[16];
+            const size_t length = in.u8() % sizeof(text);
+            for (size_t i = 0; i < length; i++)
+                text[i] = (char)in.u8();
+            uint16_t characters = 0;
+            return dotmatrix_encode_text(scratch, sizeof(scratch), text, length, style, characters);
+        }
+    }
+}
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size == 0)
+        return 0;
+
+    if (data[0] & 0x80)
+    {
+        // Exactly the input, so a read past it is caught.
+        uint8_t *copy = (uint8_t *)malloc(size - 1 ? size - 1 : 1);
+        memcpy(copy, data + 1, size - 1);
+        check_decode(copy, size - 1);
+        free(copy);
+        return 0;
+    }
+
+    FuzzInput in(data + 1, size - 1);
+    size_t length = build(in);
+    FUZZ_CHECK(length != 0);
+
+    // Corrupt up to 7 bytes, and maybe cut the packet short.
+    const uint8_t edits = data[0] & 7;
+    for (uint8_t i = 0; i < edits; i++)
+    {
+        const size_t at = in.u16() % length;
+        scratch[at] ^= in.u8() | 1;
+    }
+    if (data[0] & 8)
+        length = in.u16() % (length + 1);
+
+    uint8_t *packet = (uint8_t *)malloc(length ? length : 1);
+    memcpy(packet, scratch, length);
+    const bool decoded = check_decode(packet, length);
+    // Left alone, the packet must be accepted.
+    FUZZ_CHECK(decoded || edits != 0 || (data[0] & 8));
+    free(packet);
+    return 0;
+}
@@ -0,0 +1,42 @@
+// Image packets: a header for any chunk and image size is either refused or decodes back
+// to the same sizes, with the chunk's pixels following it.
+
+#include "fuzz_common.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    FuzzInput in(data, size);
+    const uint32_t chunk_bytes = in.u32() % (2 * DOTMATRIX_IMAGE_MAX_DATA_SIZE);
+    const uint8_t shape = in.u8();
+    const bool continuation = shape & 1;
+    // Mostly the sizes the client sends, sometimes anything.
+    uint32_t image_bytes = in.u32();
+    if (shape & 2)
+        image_bytes = chunk_bytes + image_bytes % (4 * DOTMATRIX_IMAGE_CHUNK_SIZE);
+
+    uint8_t header[DOTMATRIX_IMAGE_HEADER_SIZE];
+    const size_t written =
+        dotmatrix_encode_image_chunk_header(header, chunk_bytes, image_bytes, continuation);
+    if (chunk_bytes > DOTMATRIX_IMAGE_MAX_DATA_SIZE || chunk_bytes > image_bytes)
+    {
+        FUZZ_CHECK(written == 0);
+        return 0;
+    }
+    FUZZ_CHECK(written == DOTMATRIX_IMAGE_HEADER_SIZE);
+
+    // The pixels are whatever input is left, repeated to fill the chunk.
+    const size_t length = written + chunk_bytes;
+    uint8_t *packet = (uint8_t *)malloc(length);
+    memcpy(packet, header, written);
+    for (uint32_t i = 0; i < chunk_bytes; i++)
+        packet[written + i] = in.left() ? in.rest()[i % in.left()] : (uint8_t)i;
+
+    const DotMatrixPacket decoded = decode_own(packet, length, DOTMATRIX_PACKET_IMAGE);
+    FUZZ_CHECK(decoded.image.chunkBytes == chunk_bytes);
+    FUZZ_CHECK(decoded.image.imageBytes == image_bytes);
+    FUZZ_CHECK(decoded.image.continuation == continuation);
+    FUZZ_CHECK(decoded.image.data == packet + written);
+
+    free(packet);
+    return 0;
+}
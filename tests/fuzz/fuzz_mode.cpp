@@ -0,0 +1,19 @@
+// Image mode packets decode back to the same DIY flag.
+
+#include "fuzz_common.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    FuzzInput in(data, size);
+    const bool diy = in.u8() & 1;
+
+    uint8_t *packet = (uint8_t *)malloc(DOTMATRIX_IMAGE_MODE_PACKET_SIZE);
+    const size_t written = dotmatrix_encode_image_mode(packet, diy);
+    FUZZ_CHECK(written == DOTMATRIX_IMAGE_MODE_PACKET_SIZE);
+
+    const DotMatrixPacket decoded = decode_own(packet, written, DOTMATRIX_PACKET_IMAGE_MODE);
+    FUZZ_CHECK(decoded.imageMode.diy == diy);
+
+    free(packet);
+    return 0;
+}
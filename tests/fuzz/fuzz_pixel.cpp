@@ -0,0 +1,24 @@
+// Pixel packets decode back to the same position and colour.
+
+#include "fuzz_common.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    FuzzInput in(data, size);
+    const uint8_t x = in.u8();
+    const uint8_t y = in.u8();
+    const uint8_t r = in.u8();
+    const uint8_t g = in.u8();
+    const uint8_t b = in.u8();
+
+    uint8_t *packet = (uint8_t *)malloc(DOTMATRIX_PIXEL_PACKET_SIZE);
+    const size_t written = dotmatrix_encode_pixel(packet, x, y, r, g, b);
+    FUZZ_CHECK(written == DOTMATRIX_PIXEL_PACKET_SIZE);
+
+    const DotMatrixPacket decoded = decode_own(packet, written, DOTMATRIX_PACKET_PIXEL);
+    FUZZ_CHECK(decoded.pixel.x == x && decoded.pixel.y == y);
+    FUZZ_CHECK(decoded.pixel.r == r && decoded.pixel.g == g && decoded.pixel.b == b);
+
+    free(packet);
+    return 0;
+}
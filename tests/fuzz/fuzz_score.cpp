@@ -0,0 +1,20 @@
+// Scoreboard packets decode back to the same scores.
+
+#include "fuzz_common.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    FuzzInput in(data, size);
+    const uint16_t score0 = in.u16();
+    const uint16_t score1 = in.u16();
+
+    uint8_t *packet = (uint8_t *)malloc(DOTMATRIX_SCORE_PACKET_SIZE);
+    const size_t written = dotmatrix_encode_score(packet, score0, score1);
+    FUZZ_CHECK(written == DOTMATRIX_SCORE_PACKET_SIZE);
+
+    const DotMatrixPacket decoded = decode_own(packet, written, DOTMATRIX_PACKET_SCORE);
+    FUZZ_CHECK(decoded.score.score0 == score0 && decoded.score.score1 == score1);
+
+    free(packet);
+    return 0;
+}
@@ -0,0 +1,46 @@
+// Text packets: any capacity, style and string must encode within the buffer, keep as
+// many glyphs as fit, and decode back to the same style and glyphs.
+
+#include "fuzz_common.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    FuzzInput in(data, size);
+    const DotMatrixTextStyle style = in.style();
+    // Past the 16 bit limit too, to cover the clamp.
+    const size_t capacity = in.u32() % (2 * DOTMATRIX_TEXT_MAX_PACKET_SIZE);
+    const char *text = (const char *)in.rest();
+    const size_t length = in.left();
+
+    // Exactly capacity bytes, so the sanitizers catch any write past them.
+    uint8_t *packet = (uint8_t *)malloc(capacity ? capacity : 1);
+    uint16_t characters = 0xFFFF;
+    const size_t written = dotmatrix_encode_text(packet, capacity, text, length, style, characters);
+
+    if (capacity < DOTMATRIX_TEXT_PREAMBLE_SIZE)
+    {
+        FUZZ_CHECK(written == 0 && characters == 0);
+        free(packet);
+        return 0;
+    }
+
+    const size_t glyph_bytes = SEPARATOR_LEN + BITMAP_SIZE;
+    const size_t usable = capacity < DOTMATRIX_TEXT_MAX_PACKET_SIZE ? capacity
+                                                                     : DOTMATRIX_TEXT_MAX_PACKET_SIZE;
+    const size_t fits = (usable - DOTMATRIX_TEXT_PREAMBLE_SIZE) / glyph_bytes;
+    FUZZ_CHECK(characters == (length < fits ? length : fits));
+    FUZZ_CHECK(written == DOTMATRIX_TEXT_PREAMBLE_SIZE + characters * glyph_bytes);
+    FUZZ_CHECK(written <= usable);
+
+    const DotMatrixPacket decoded = decode_own(packet, written, DOTMATRIX_PACKET_TEXT);
+    FUZZ_CHECK(decoded.text.characters == characters);
+    FUZZ_CHECK(same_style(decoded.text.style, style));
+    for (uint16_t i = 0; i < characters; i++)
+    {
+        const uint8_t *glyph = decoded.text.glyphs + i * glyph_bytes;
+        FUZZ_CHECK(memcmp(glyph, &font_data[glyph_index(text[i]) * BITMAP_SIZE], BITMAP_SIZE) == 0);
+    }
+
+    free(packet);
+    return 0;
+}
@@ -0,0 +1,144 @@
+// Drives a fuzz target without libFuzzer, for compilers that do not have it (gcc).
+//
+//     fuzz_text [-runs=N] [-max_len=N] [-seed=N] [input...]
+//
+// With input files it runs each once, to replay a crash. Otherwise it runs N random
+// inputs and prints exec/s. A failing input is written to crash-<seed>-<run>.
+
+#include <chrono>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_UNDEFINED__)
+#include <sanitizer/common_interface_defs.h>
+#define DOTMATRIX_HAVE_SANITIZER 1
+#endif
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+namespace
+{
+static const uint8_t *current_data;
+static size_t current_size;
+static char crash_path[64];
+
+static void save_crash()
+{
+    if (current_data == nullptr || crash_path[0] == 0)
+        return;
+
+    FILE *f = fopen(crash_path, "wb");
+    if (f)
+    {
+        fwrite(current_data, 1, current_size, f);
+        fclose(f);
+        fprintf(stderr, "input written to %s\n", crash_path);
+    }
+}
+
+static void on_abort(int)
+{
+    save_crash();
+    signal(SIGABRT, SIG_DFL);
+    abort();
+}
+
+// xorshift64*: fast, and the same run for the same seed everywhere.
+static uint64_t next_random(uint64_t &state)
+{
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 2685821657736338717ull;
+}
+
+static bool read_file(const char *path, std::vector<uint8_t> &out)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == nullptr)
+        return false;
+
+    uint8_t buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        out.insert(out.end(), buffer, buffer + n);
+    fclose(f);
+    return true;
+}
+
+static bool option(const char *arg, const char *name, unsigned long long &value)
+{
+    const size_t length = strlen(name);
+    if (strncmp(arg, name, length) != 0)
+        return false;
+    value = strtoull(arg + length, nullptr, 0);
+    return true;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    unsigned long long runs = 100000;
+    unsigned long long max_len = 4096;
+    unsigned long long seed = 1;
+    std::vector<const char *> files;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!option(argv[i], "-runs=", runs) && !option(argv[i], "-max_len=", max_len) &&
+            !option(argv[i], "-seed=", seed))
+            files.push_back(argv[i]);
+    }
+
+    signal(SIGABRT, on_abort);
+#ifdef DOTMATRIX_HAVE_SANITIZER
+    __sanitizer_set_death_callback(save_crash);
+#endif
+
+    if (!files.empty())
+    {
+        for (const char *path : files)
+        {
+            std::vector<uint8_t> input;
+            if (!read_file(path, input))
+            {
+                fprintf(stderr, "cannot read %s\n", path);
+                return 1;
+            }
+            LLVMFuzzerTestOneInput(input.data(), input.size());
+            printf("%s: ok\n", path);
+        }
+        return 0;
+    }
+
+    std::vector<uint8_t> input(max_len);
+    uint64_t state = seed ? seed : 1;
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point start = Clock::now();
+
+    for (unsigned long long run = 0; run < runs; run++)
+    {
+        // Mostly short inputs, with lengths spread over every power of two up to max_len.
+        const uint64_t r = next_random(state);
+        const size_t bound = (size_t)1 << (r % 13);
+        const size_t size = (size_t)((r >> 8) % ((bound < max_len ? bound : max_len) + 1));
+        for (size_t i = 0; i < size; i += 8)
+        {
+            const uint64_t bytes = next_random(state);
+            memcpy(&input[i], &bytes, size - i < 8 ? size - i : 8);
+        }
+
+        snprintf(crash_path, sizeof(crash_path), "crash-%llu-%llu", seed, run);
+        current_data = input.data();
+        current_size = size;
+        LLVMFuzzerTestOneInput(input.data(), size);
+    }
+
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    printf("Done %llu runs in %.2f s: %.0f exec/s\n", runs, seconds, runs / seconds);
+    return 0;
+}
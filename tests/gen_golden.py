@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""Write the golden vectors the host protocol tests compare the C++ encoders against.
+
+    python3 tests/gen_golden.py build/generated/rain-drm3.cpp golden_vectors.h
+
+Text packets come from TextModule._build_string_packet in test.py, fed the glyphs of the
+generated font. The other packets are built here from the iDotMatrix byte layouts, one
+field at a time, rather than from the packed structs the firmware uses.
+"""
+
+from __future__ import annotations
+
+import argparse
+import struct
+import sys
+from pathlib import Path
+from typing import List, Tuple
+
+ROOT = Path(__file__).resolve().parent.parent
+sys.path.insert(0, str(ROOT))
+
+import render_font  # noqa: E402
+from test import TextModule  # noqa: E402
+
+# Matches DOTMATRIX_TEXT_PREAMBLE_SIZE and the per-glyph cost on the wire.
+TEXT_PREAMBLE = 30
+
+# (name, text, mode, speed, colour mode, rgb, background mode, background rgb, capacity)
+TEXT_CASES = [
+    ("hello", "Hello, World!", 1, 95, 0, (255, 255, 255), 0, (0, 0, 0), 4096),
+    ("rgb_on_blue", "A", 0, 10, 1, (255, 0, 0), 1, (0, 0, 255), 4096),
+    ("empty", "", 1, 95, 0, (255, 255, 255), 0, (0, 0, 0), 4096),
+    ("unprintable", "~\t\x7f ", 5, 1, 2, (1, 2, 3), 0, (4, 5, 6), 4096),
+    ("printable_ascii", "".join(chr(c) for c in range(32, 127)), 1, 255, 3, (9, 8, 7), 1,
+     (6, 5, 4), 0xFFFF),
+    # Capacity for 44 glyphs: the rest of the text is cut at a glyph boundary.
+    ("truncated", "The quick brown fox jumps over the lazy dog, twice over.", 1, 95, 0,
+     (255, 255, 255), 0, (0, 0, 0), TEXT_PREAMBLE + 44 * 68),
+]
+
+PIXEL_CASES = [(0, 0, 0, 0, 0), (31, 31, 255, 255, 255), (7, 19, 18, 52, 86), (63, 0, 1, 128, 254)]
+SCORE_CASES = [(0, 0), (1, 2), (999, 1), (0x1234, 0xABCD), (0xFFFF, 0xFFFF)]
+MODE_CASES = [True, False]
+# (chunk bytes, image bytes, continuation)
+IMAGE_CASES = [(768, 768, False), (3072, 3072, False), (4096, 12288, False),
+               (4096, 12288, True), (0, 0, False), (65526, 65526, False)]
+
+
+def load_font(path: Path) -> Tuple[bytes, List[bytes]]:
+    text = path.read_text()
+    length = render_font._extract_declared_glyph_byte_len(text)
+    glyphs = [bytes(g) for g in render_font._extract_font_rows(text, glyph_bytes_len=length)]
+    return TextModule.separator, glyphs
+
+
+def glyph(glyphs: List[bytes], c: str) -> bytes:
+    code = ord(c)
+    return glyphs[code - 32 if 32 <= code <= 126 else 0]
+
+
+def text_packet(separator: bytes, glyphs: List[bytes], case) -> Tuple[bytes, int]:
+    _, text, mode, speed, colour_mode, rgb, bg_mode, bg_rgb, capacity = case
+    kept = min(len(text), (min(capacity, 0xFFFF) - TEXT_PREAMBLE) // (len(separator) + len(glyphs[0])))
+    bitmaps = bytearray()
+    for c in text[:kept]:
+        bitmaps += separator + glyph(glyphs, c)
+    packet = TextModule()._build_string_packet(
+        text_bitmaps=bitmaps,
+        text_mode=mode,
+        speed=speed,
+        text_color_mode=colour_mode,
+        text_color=rgb,
+        text_bg_mode=bg_mode,
+        text_bg_color=bg_rgb,
+    )
+    return bytes(packet), kept
+
+
+def pixel_packet(x: int, y: int, r: int, g: int, b: int) -> bytes:
+    return bytes([10, 0, 5, 1, 0, r, g, b, x, y])
+
+
+def score_packet(score0: int, score1: int) -> bytes:
+    return bytes([8, 0, 10, 128]) + struct.pack("<HH", score0, score1)
+
+
+def mode_packet(diy: bool) -> bytes:
+    return bytes([5, 0, 4, 1, 1 if diy else 0])
+
+
+def image_header(chunk: int, total: int, continuation: bool) -> bytes:
+    return struct.pack("<H", chunk + 9) + bytes([0, 0, 2 if continuation else 0]) + \
+        struct.pack("<I", total)
+
+
+def c_bytes(data: bytes) -> str:
+    return "{" + ", ".join(f"0x{b:02X}" for b in data) + "}" if data else "{0}"
+
+
+def c_string(text: str) -> str:
+    return '"' + "".join(c if c.isalnum() or c in " ,.!~" else f"\\x{ord(c):02x}\"\"" for c in text) + '"'
+
+
+def main() -> int:
+    ap = argparse.ArgumentParser(description=__doc__,
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("font", type=Path, help="font generated by font-gen.py")
+    ap.add_argument("output", type=Path)
+    args = ap.parse_args()
+
+    separator, glyphs = load_font(args.font)
+    out = [
+        f"// Generated by tests/gen_golden.py from test.py and {args.font.name}. Do not edit.",
+        "",
+        "#pragma once",
+        "",
+        "#include <stddef.h>",
+        "#include <stdint.h>",
+        "",
+    ]
+
+    out.append("struct GoldenText\n{\n    const char *name;\n    const char *text;\n"
+               "    size_t length;\n    size_t capacity;\n    uint8_t style[10];\n"
+               "    uint16_t characters;\n    const uint8_t *packet;\n    size_t packetLength;\n};\n")
+    for case in TEXT_CASES:
+        packet, _ = text_packet(separator, glyphs, case)
+        out.append(f"static const uint8_t golden_text_{case[0]}[] = {c_bytes(packet)};")
+    out.append("")
+    out.append("static const GoldenText golden_text[] = {")
+    for case in TEXT_CASES:
+        name, text, mode, speed, colour_mode, rgb, bg_mode, bg_rgb, capacity = case
+        packet, kept = text_packet(separator, glyphs, case)
+        style = [mode, speed, colour_mode, *rgb, bg_mode, *bg_rgb]
+        out.append(f'    {{"{name}", {c_string(text)}, {len(text)}, {capacity}, '
+                   f'{{{", ".join(map(str, style))}}}, {kept}, golden_text_{name}, '
+                   f'{len(packet)}}},')
+    out.append("};\n")
+
+    out.append("struct GoldenPixel\n{\n    uint8_t x, y, r, g, b;\n    uint8_t packet[10];\n};\n")
+    out.append("static const GoldenPixel golden_pixel[] = {")
+    for case in PIXEL_CASES:
+        out.append(f"    {{{', '.join(map(str, case))}, {c_bytes(pixel_packet(*case))}}},")
+    out.append("};\n")
+
+    out.append("struct GoldenScore\n{\n    uint16_t score0, score1;\n    uint8_t packet[8];\n};\n")
+    out.append("static const GoldenScore golden_score[] = {")
+    for case in SCORE_CASES:
+        out.append(f"    {{{case[0]}, {case[1]}, {c_bytes(score_packet(*case))}}},")
+    out.append("};\n")
+
+    out.append("struct GoldenMode\n{\n    bool diy;\n    uint8_t packet[5];\n};\n")
+    out.append("static const GoldenMode golden_mode[] = {")
+    for diy in MODE_CASES:
+        out.append(f"    {{{'true' if diy else 'false'}, {c_bytes(mode_packet(diy))}}},")
+    out.append("};\n")
+
+    out.append("struct GoldenImageHeader\n{\n    uint32_t chunkBytes, imageBytes;\n"
+               "    bool continuation;\n    uint8_t packet[9];\n};\n")
+    out.append("static const GoldenImageHeader golden_image_header[] = {")
+    for chunk, total, continuation in IMAGE_CASES:
+        out.append(f"    {{{chunk}, {total}, {'true' if continuation else 'false'}, "
+                   f"{c_bytes(image_header(chunk, total, continuation))}}},")
+    out.append("};")
+
+    args.output.parent.mkdir(parents=True, exist_ok=True)
+    args.output.write_text("\n".join(out) + "\n")
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -0,0 +1,171 @@
+// Compares every encoder in DotMatrixProtocol.cpp byte for byte with packets built by the
+// Python reference (see gen_golden.py).
+
+#include "DotMatrixProtocol.h"
+#include "golden_vectors.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+static int failures = 0;
+
+static void dump(const char *label, const uint8_t *data, size_t length)
+{
+    printf("  %s (%u bytes):", label, (unsigned)length);
+    for (size_t i = 0; i < length && i < 48; i++)
+        printf(" %02X", data[i]);
+    printf(length > 48 ? " ...\n" : "\n");
+}
+
+static void expect_packet(const char *kind,
+                          const char *name,
+                          const uint8_t *got,
+                          size_t gotLength,
+                          const uint8_t *want,
+                          size_t wantLength)
+{
+    if (gotLength == wantLength && memcmp(got, want, wantLength) == 0)
+        return;
+
+    failures++;
+    printf("FAIL %s %s\n", kind, name);
+    for (size_t i = 0; i < gotLength && i < wantLength; i++)
+    {
+        if (got[i] != want[i])
+        {
+            printf("  first difference at byte %u\n", (unsigned)i);
+            break;
+        }
+    }
+    dump("got", got, gotLength);
+    dump("want", want, wantLength);
+}
+
+static DotMatrixTextStyle make_style(const uint8_t *s)
+{
+    const DotMatrixTextStyle style = {s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], s[8], s[9]};
+    return style;
+}
+
+static void test_text()
+{
+    static uint8_t packet[DOTMATRIX_TEXT_MAX_PACKET_SIZE];
+
+    for (size_t i = 0; i < sizeof(golden_text) / sizeof(golden_text[0]); i++)
+    {
+        const GoldenText &g = golden_text[i];
+        uint16_t characters = 0xFFFF;
+        const size_t length = dotmatrix_encode_text(packet, g.capacity, g.text, g.length,
+                                                    make_style(g.style), characters);
+        expect_packet("text", g.name, packet, length, g.packet, g.packetLength);
+        if (characters != g.characters)
+        {
+            failures++;
+            printf("FAIL text %s: %u characters kept, want %u\n", g.name, characters,
+                   g.characters);
+        }
+    }
+
+    // Too small for the preamble: nothing is written.
+    uint16_t characters = 1;
+    const DotMatrixTextStyle style = make_style(golden_text[0].style);
+    if (dotmatrix_encode_text(packet, DOTMATRIX_TEXT_PREAMBLE_SIZE - 1, "A", 1, style,
+                              characters) != 0 ||
+        characters != 0)
+    {
+        failures++;
+        printf("FAIL text: capacity below the preamble was accepted\n");
+    }
+}
+
+static void test_image_header()
+{
+    for (size_t i = 0; i < sizeof(golden_image_header) / sizeof(golden_image_header[0]); i++)
+    {
+        const GoldenImageHeader &g = golden_image_header[i];
+        uint8_t packet[DOTMATRIX_IMAGE_HEADER_SIZE];
+        char name[48];
+        snprintf(name, sizeof(name), "%u/%u%s", (unsigned)g.chunkBytes, (unsigned)g.imageBytes,
+                 g.continuation ? " continuation" : "");
+
+        const size_t length = dotmatrix_encode_image_chunk_header(packet, g.chunkBytes,
+                                                                  g.imageBytes, g.continuation);
+        expect_packet("image header", name, packet, length, g.packet, sizeof(g.packet));
+
+        if (g.chunkBytes == g.imageBytes && !g.continuation)
+        {
+            const size_t whole = dotmatrix_encode_image_header(packet, g.imageBytes);
+            expect_packet("image header", name, packet, whole, g.packet, sizeof(g.packet));
+        }
+    }
+
+    // Chunks the 16 bit length cannot carry, or larger than the image, are refused.
+    uint8_t packet[DOTMATRIX_IMAGE_HEADER_SIZE];
+    if (dotmatrix_encode_image_chunk_header(packet, DOTMATRIX_IMAGE_MAX_DATA_SIZE + 1,
+                                            DOTMATRIX_IMAGE_MAX_DATA_SIZE + 1, false) != 0 ||
+        dotmatrix_encode_image_chunk_header(packet, 10, 9, false) != 0)
+    {
+        failures++;
+        printf("FAIL image header: impossible chunk was accepted\n");
+    }
+}
+
+static void test_pixel()
+{
+    for (size_t i = 0; i < sizeof(golden_pixel) / sizeof(golden_pixel[0]); i++)
+    {
+        const GoldenPixel &g = golden_pixel[i];
+        uint8_t packet[DOTMATRIX_PIXEL_PACKET_SIZE];
+        char name[32];
+        snprintf(name, sizeof(name), "(%u,%u)", g.x, g.y);
+
+        const size_t length = dotmatrix_encode_pixel(packet, g.x, g.y, g.r, g.g, g.b);
+        expect_packet("pixel", name, packet, length, g.packet, sizeof(g.packet));
+    }
+}
+
+static void test_score()
+{
+    for (size_t i = 0; i < sizeof(golden_score) / sizeof(golden_score[0]); i++)
+    {
+        const GoldenScore &g = golden_score[i];
+        uint8_t packet[DOTMATRIX_SCORE_PACKET_SIZE];
+        char name[32];
+        snprintf(name, sizeof(name), "%u:%u", g.score0, g.score1);
+
+        const size_t length = dotmatrix_encode_score(packet, g.score0, g.score1);
+        expect_packet("score", name, packet, length, g.packet, sizeof(g.packet));
+    }
+}
+
+static void test_mode()
+{
+    for (size_t i = 0; i < sizeof(golden_mode) / sizeof(golden_mode[0]); i++)
+    {
+        const GoldenMode &g = golden_mode[i];
+        uint8_t packet[DOTMATRIX_IMAGE_MODE_PACKET_SIZE];
+
+        const size_t length = dotmatrix_encode_image_mode(packet, g.diy);
+        expect_packet("mode", g.diy ? "diy" : "off", packet, length, g.packet, sizeof(g.packet));
+    }
+}
+} // namespace
+
+int main()
+{
+    test_text();
+    test_image_header();
+    test_pixel();
+    test_score();
+    test_mode();
+
+    if (failures)
+    {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("all packets match the reference\n");
+    return 0;
+}
@@ -0,0 +1,80 @@
+// Measures how fast the encoders build packets on the host. The figures are for comparing
+// changes to DotMatrixProtocol.cpp, not a prediction of the nRF52's speed.
+
+#include "DotMatrixProtocol.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+// Keeps the compiler from dropping encodes whose result is never used.
+static volatile uint32_t sink;
+
+template <typename Encode>
+static void measure(const char *name, size_t packetBytes, Encode encode)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    // Doubles the batch until it runs long enough to time.
+    uint32_t iterations = 64;
+    double seconds = 0;
+    while (true)
+    {
+        const Clock::time_point start = Clock::now();
+        for (uint32_t i = 0; i < iterations; i++)
+            sink += (uint32_t)encode(i);
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (seconds >= 0.2 || iterations >= (1u << 30))
+            break;
+        iterations *= 2;
+    }
+
+    const double rate = iterations / seconds;
+    printf("%-24s %12.0f packets/s %10.1f MB/s\n", name, rate, rate * packetBytes / 1e6);
+}
+} // namespace
+
+int main()
+{
+    static uint8_t packet[DOTMATRIX_TEXT_MAX_PACKET_SIZE];
+    const DotMatrixTextStyle style = {1, 95, 0, 255, 255, 255, 0, 0, 0, 0};
+
+    static const char hello[] = "Hello, World!";
+    uint16_t characters = 0;
+    const size_t helloBytes =
+        dotmatrix_encode_text(packet, sizeof(packet), hello, sizeof(hello) - 1, style, characters);
+    measure("text (13 chars)", helloBytes, [&](uint32_t) {
+        return dotmatrix_encode_text(packet, sizeof(packet), hello, sizeof(hello) - 1, style,
+                                     characters);
+    });
+
+    static char longText[960];
+    for (size_t i = 0; i < sizeof(longText); i++)
+        longText[i] = (char)(32 + i % 95);
+    const size_t longBytes =
+        dotmatrix_encode_text(packet, sizeof(packet), longText, sizeof(longText), style, characters);
+    measure("text (full packet)", longBytes, [&](uint32_t) {
+        return dotmatrix_encode_text(packet, sizeof(packet), longText, sizeof(longText), style,
+                                     characters);
+    });
+
+    measure("crc32 (4 KiB)", DOTMATRIX_IMAGE_CHUNK_SIZE, [&](uint32_t) {
+        return dotmatrix_crc32(packet, DOTMATRIX_IMAGE_CHUNK_SIZE);
+    });
+    measure("image chunk header", DOTMATRIX_IMAGE_HEADER_SIZE, [&](uint32_t i) {
+        return dotmatrix_encode_image_chunk_header(packet, DOTMATRIX_IMAGE_CHUNK_SIZE, 12288,
+                                                   i & 1);
+    });
+    measure("pixel", DOTMATRIX_PIXEL_PACKET_SIZE, [&](uint32_t i) {
+        return dotmatrix_encode_pixel(packet, i & 31, (i >> 5) & 31, i, i >> 8, i >> 16);
+    });
+    measure("score", DOTMATRIX_SCORE_PACKET_SIZE, [&](uint32_t i) {
+        return dotmatrix_encode_score(packet, i, ~i);
+    });
+    measure("image mode", DOTMATRIX_IMAGE_MODE_PACKET_SIZE, [&](uint32_t i) {
+        return dotmatrix_encode_image_mode(packet, i & 1);
+    });
+    return 0;
+}
@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+"""Convert a `trace` console dump into Chrome trace JSON.
+
+    python3 trace_to_chrome.py capture.txt -o trace.json
+    python3 trace_to_chrome.py --port /dev/ttyACM0 -o trace.json
+
+With --port the script sends the `trace` command itself and waits for the dump
+(needs pyserial). Open the result in chrome://tracing or https://ui.perfetto.dev.
+
+Only the lines between "TRACE BEGIN" and "TRACE END" are read, so a capture may
+contain other serial output. Timestamps come from the 32 bit DWT cycle counter and
+are unwrapped on the assumption that events are less than one wrap (about 67 s at
+64 MHz) apart.
+"""
+
+from __future__ import annotations
+
+import argparse
+import json
+import re
+import sys
+from pathlib import Path
+from typing import Dict, Iterable, List
+
+BEGIN = re.compile(r"TRACE BEGIN (\d+) (\d+)")
+NAME = re.compile(r"N (\d+) (.+)")
+EVENT = re.compile(r"T ([0-9a-fA-F]+) (\d+) ([BE]) (\d+)")
+
+
+class TraceFormatError(ValueError):
+    pass
+
+
+def parse(lines: Iterable[str]) -> List[dict]:
+    """Return Chrome trace events for the last complete dump in `lines`."""
+
+    dumps: List[List[dict]] = []
+    hz = 0
+    names: Dict[int, str] = {}
+    raw: List[tuple] = []
+    inside = False
+
+    for line in lines:
+        line = line.strip()
+        m = BEGIN.search(line)
+        if m:
+            hz = int(m.group(1))
+            names, raw, inside = {}, [], True
+            continue
+        if not inside:
+            continue
+        if line.endswith("TRACE END"):
+            dumps.append(to_chrome(hz, names, raw))
+            inside = False
+        elif NAME.fullmatch(line):
+            m = NAME.fullmatch(line)
+            names[int(m.group(1))] = m.group(2)
+        elif EVENT.fullmatch(line):
+            m = EVENT.fullmatch(line)
+            raw.append((int(m.group(1), 16), int(m.group(2)), m.group(3), int(m.group(4))))
+
+    if not dumps:
+        raise TraceFormatError("no complete TRACE BEGIN ... TRACE END block found")
+    return dumps[-1]
+
+
+def to_chrome(hz: int, names: Dict[int, str], raw: List[tuple]) -> List[dict]:
+    if hz <= 0:
+        raise TraceFormatError("dump has no clock rate")
+
+    events: List[dict] = []
+    open_spans: Dict[int, int] = {}
+    last = None
+    elapsed = 0
+
+    for cycles, point, phase, arg in raw:
+        if last is None:
+            last = cycles
+        elapsed += (cycles - last) & 0xFFFFFFFF
+        last = cycles
+
+        # The buffer wraps, so the oldest events may be ends without a beginning.
+        if phase == "E":
+            if not open_spans.get(point):
+                continue
+            open_spans[point] -= 1
+        else:
+            open_spans[point] = open_spans.get(point, 0) + 1
+
+        event = {
+            "name": names.get(point, f"point {point}"),
+            "ph": phase,
+            "ts": elapsed * 1e6 / hz,
+            "pid": 1,
+            "tid": 1,
+        }
+        if phase == "B":
+            event["args"] = {"arg": arg}
+        events.append(event)
+
+    return events
+
+
+def read_port(port: str, baud: int) -> List[str]:
+    import serial
+
+    with serial.Serial(port, baud, timeout=5) as link:
+        link.reset_input_buffer()
+        link.write(b"trace\r\n")
+        lines = []
+        while True:
+            line = link.readline()
+            if not line:
+                raise TraceFormatError("timed out waiting for the trace dump")
+            lines.append(line.decode("latin-1"))
+            if b"TRACE END" in line:
+                return lines
+
+
+def main() -> int:
+    ap = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter
+    )
+    ap.add_argument("capture", type=Path, nargs="?", help="serial capture (default: stdin)")
+    ap.add_argument("--port", help="request the dump from a serial port instead")
+    ap.add_argument("--baud", type=int, default=115200)
+    ap.add_argument("-o", "--output", type=Path, help="JSON file to write (default: stdout)")
+    args = ap.parse_args()
+
+    try:
+        if args.port:
+            lines = read_port(args.port, args.baud)
+        elif args.capture:
+            lines = args.capture.read_text(encoding="latin-1").splitlines()
+        else:
+            lines = sys.stdin.read().splitlines()
+        events = parse(lines)
+    except TraceFormatError as e:
+        print(f"trace_to_chrome.py: {e}", file=sys.stderr)
+        return 1
+
+    text = json.dumps({"traceEvents": events, "displayTimeUnit": "ms"}, indent=1)
+    if args.output:
+        args.output.write_text(text + "\n")
+    else:
+        print(text)
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())